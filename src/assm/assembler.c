@@ -1,5 +1,6 @@
 #include "setup.h"
 #include "assembler.h"
+#include "image.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -7,25 +8,89 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define ASSM_ERR(errcode, errstr)\
     do\
     {\
-        assert (assm);\
-        assm->error.err  = errcode;\
-        assm->error.func = __PRETTY_FUNCTION__;\
-        if (assm->text.word && assm->text.wordid < assm->text.wordsize)\
-            assm->error.word = assm->text.word[assm->text.wordid].str;\
-        assm->error.str  = errstr;\
+        assm_seterr (assm, errcode, __PRETTY_FUNCTION__, errstr);\
         return EXIT_FAILURE;\
     }\
     while (0)
 
+#define ASSM_ARENABLK   0x10000
+#define ASSM_CHUNKSIZE  0x10000
+#define ASSM_MAXTHREADS 0x40
+
+struct assm_chunk
+{
+    assm_t   assm;
+    uint64_t ip;
+    uint64_t addr;
+};
+
+struct assm_pool
+{
+    struct assm_chunk *chunk;
+    size_t             size;
+    size_t             next;
+    enum ASSM_PASSNUM  passnum;
+};
+
+static void        assm_seterr     (assm_t *assm, enum ASSM_ERRORS err, const char *func, const char *str);
 static int         assm_resize     (assm_t *assm);
 static const char *assm_strerror   (enum ASSM_ERRORS err);
 
+static void *arena_alloc (struct assm_arena *arena, size_t size);
+static void  arena_free  (struct assm_arena *arena);
+
+static void        text_rewind  (assm_t *assm);
+static void        text_seek    (assm_t *assm, const char *pos, size_t line);
+static void        text_next    (assm_t *assm);
+static int         text_equal   (const struct assm_word *word, const char *str);
+static const char *text_unitend (const assm_t *assm, const char *pos);
+
+static size_t assm_split       (assm_t *assm, struct assm_chunk *chunk, size_t size);
+static int    assm_run         (assm_t *assm, struct assm_pool *pool, enum ASSM_PASSNUM passnum);
+static void  *assm_worker      (void *arg);
+static int    assm_init        (assm_t *assm);
+static int    assm_pass        (assm_t *assm, enum ASSM_PASSNUM passnum);
+static int    assm_block       (assm_t *assm, const char *end);
+static int    assm_units       (assm_t *assm, enum ASSM_PASSNUM passnum);
+static int    assm_merge       (assm_t *assm, struct assm_pool *pool);
+static int    assm_relax       (assm_t *assm, struct assm_pool *pool);
+static int    assm_relocs      (assm_t *assm, struct assm_pool *pool);
+static int    assm_write_obj   (assm_t *assm, FILE *stream);
+static int    assm_write_img   (assm_t *assm, FILE *stream);
+
+static int cache_load  (assm_t *assm, struct assm_unit *unit);
+static int cache_apply (assm_t *assm, struct assm_unit *unit);
+static int cache_patch (assm_t *assm, struct assm_unit *unit);
+static int cache_store (assm_t *assm, struct assm_unit *unit);
+
+static int    index_build (assm_t *assm, struct assm_symindex *index, const void *table, size_t size,
+                           size_t elemsize, enum ASSM_ERRORS err);
+static size_t index_find  (const struct assm_symindex *index, const void *table, size_t elemsize,
+                           const char *str, size_t size);
+static size_t text_hash   (const char *str, size_t size);
+
 static int word_handler (assm_t *assm);
 
+static int    assm_lex     (assm_t *assm, struct assm_token *tok);
+static int    assm_symbol  (assm_t *assm, enum OBJ_SYMTYPE type, struct assm_token *tok);
+static size_t assm_lookup  (const assm_t *assm, enum OBJ_SYMTYPE type, const char *str, size_t size,
+                            uint64_t *value);
+static int    assm_reloc   (assm_t *assm, uint64_t offset, enum OBJ_SYMTYPE type, const char *str, size_t size);
+static size_t assm_argsize (const struct assm_token *tok);
+static void   assm_emitreg (assm_t *assm, uint8_t code, uint8_t reg);
+static void   assm_emitval (assm_t *assm, uint8_t code, const struct assm_token *tok);
+static void   assm_emitstd (assm_t *assm, uint8_t code);
+
 static int res_handler   (assm_t *assm);
 static int label_handler (assm_t *assm);
 static int func_handler  (assm_t *assm);
@@ -35,6 +100,8 @@ static int poptype_handler  (assm_t *assm, enum PROC_CMDCODES code);
 static int jmptype_handler  (assm_t *assm, enum PROC_CMDCODES code);
 static int calltype_handler (assm_t *assm, enum PROC_CMDCODES code);
 static int stdtype_handler  (assm_t *assm, enum PROC_CMDCODES code);
+static int chantype_handler (assm_t *assm, enum PROC_CMDCODES code);
+static int atomtype_handler (assm_t *assm, enum PROC_CMDCODES code);
 
 #define PROC_GEN_CMD(name, CODE, TYPE)\
     static int name##_##handler (assm_t *assm);
@@ -66,103 +133,56 @@ int assm_create (assm_t *assm, const char *name)
     assert (assm);
     assert (name);
 
-    FILE    *stream = NULL;
-    char    *errstr = NULL;
-    uint8_t  flag   = 0;
+    int          fd     = -1;
+    char        *errstr = NULL;
+    struct stat  st     = {};
 
     do
     {
-        errno  = 0;
+        errno = 0;
 
-        stream = fopen (name, "r");
+        fd = open (name, O_RDONLY);
 
-        if (!stream)
-            break;
-        
-        if (fseek (stream, 0L, SEEK_END) == -1)
+        if (fd == -1)
             break;
 
-        if ( (assm->text.buffsize = ftell (stream) ) == (size_t) -1)
+        if (fstat (fd, &st) == -1)
             break;
 
-        if (fseek (stream, 0L, SEEK_SET) == -1)
-            break;
-        
-        assm->text.buff = calloc (assm->text.buffsize + 1, 1);
+        assm->text.buffsize = (size_t) st.st_size;
 
-        if (!assm->text.buff)
-            break;
-    
-        if (fread (assm->text.buff, 1, assm->text.buffsize, stream) != assm->text.buffsize)
+        if (assm->text.buffsize)
         {
-            errstr = "Can't read data from file";
-            break;
-        }
+            assm->text.buff = mmap (NULL, assm->text.buffsize, PROT_READ, MAP_PRIVATE, fd, 0);
 
-        if (fclose (stream) == EOF)
-            break;
-
-        assm->text.wordsize = 1;
-        for (size_t i = 0; i < assm->text.buffsize; i++) 
-            if (isspace (assm->text.buff[i]) )
-            {
-                assm->text.wordsize++; 
-                assm->text.buff[i] = '\0';
-            }
-
-        assm->text.word = calloc (assm->text.wordsize, sizeof (*assm->text.word) );
-
-        if (!assm->text.word)
-            break;
-
-        assm->text.wordsize = 0;
-        flag                = 1;
-        for (size_t i = 0; i < assm->text.buffsize; i++)
-            if (assm->text.buff[i] && flag)
+            if (assm->text.buff == MAP_FAILED)
             {
-                assm->text.word[assm->text.wordsize].str  = assm->text.buff + i;
-                assm->text.word[assm->text.wordsize].size = strlen (assm->text.buff + i);
-                assm->text.wordsize++;
-                flag = 0;
+                assm->text.buff = NULL;
+                break;
             }
-            else if (!assm->text.buff[i] && !flag)
-                flag = 1;
-
-        assm->text.wordsize++;
-        assm->text.word = realloc (assm->text.word, assm->text.wordsize * sizeof (*assm->text.word) );
-
-        if (!assm->text.word)
-            break;
-    
-        assm->text.word[assm->text.wordsize-1].str = assm->text.buff + assm->text.buffsize;
-
-        assm->code.size = 0x20;
-        assm->code.data = calloc (1, assm->code.size);
-        if (!assm->code.data)
-            break;
 
-        assm->labeltable.capacity = 1;
-        assm->labeltable.data     = calloc (assm->labeltable.capacity, sizeof (*assm->labeltable.data));
-        if (!assm->labeltable.data)
-            break;
+            madvise ( (void *) assm->text.buff, assm->text.buffsize, MADV_SEQUENTIAL);
+        }
+        else
+            assm->text.buff = "";
 
-        assm->restable.capacity = 1;
-        assm->restable.data     = calloc (assm->restable.capacity, sizeof (*assm->restable.data));
-        if (!assm->restable.data)
+        if (close (fd) == -1)
+        {
+            fd = -1;
             break;
+        }
 
-        assm->functable.capacity = 1;
-        assm->functable.data     = calloc (assm->functable.capacity, sizeof (*assm->functable.data));
-        if (!assm->functable.data)
-            break;
+        fd = -1;
 
         assm->log = fopen ("assm.log", "w");
 
         if (!assm->log)
             break;
 
-        strncpy (assm->text.name, name, STRSIZE);
-        
+        strncpy (assm->text.name, name, STRSIZE - 1);
+
+        text_rewind (assm);
+
         return EXIT_SUCCESS;
     }
     while (0);
@@ -170,18 +190,10 @@ int assm_create (assm_t *assm, const char *name)
     if (!errstr)
         errstr = strerror (errno);
 
-    if (stream)
-        fclose (stream);
-    if (assm->log)
-        fclose (assm->log);
-    free (assm->text.buff);
-    free (assm->text.word);
-    free (assm->code.data);
-    free (assm->labeltable.data);
-    free (assm->restable.data);
-    free (assm->functable.data);
+    if (fd != -1)
+        close (fd);
 
-    memset (assm, 0, sizeof (*assm) );
+    assm_delete (assm);
 
     ASSM_ERR (ASSM_ERRSYSTEM, errstr);
 }
@@ -192,12 +204,10 @@ void assm_delete (assm_t *assm)
 
     if (assm->log)
         fclose (assm->log);
-    free (assm->text.buff);
-    free (assm->text.word);
-    free (assm->code.data);  
-    free (assm->labeltable.data);
-    free (assm->restable.data);
-    free (assm->functable.data);
+    if (assm->text.buffsize && assm->text.buff)
+        munmap ( (void *) assm->text.buff, assm->text.buffsize);
+
+    arena_free (&assm->arena);
 
     memset (assm, 0, sizeof (*assm) );
 }
@@ -214,16 +224,16 @@ int assm_write (assm_t *assm)
     FILE *stream        = NULL;
     char *ptr           = NULL;
 
-    strncpy (name, assm->text.name, STRSIZE);
+    strncpy (name, assm->text.name, STRSIZE - 1);
 
     ptr = strchr (name, '.');
 
     if (ptr)
         *ptr = '\0';
 
-    strncat (name, ".proc", STRSIZE - 1);
+    strncat (name, assm->object ? ".obj" : ".proc", STRSIZE - strlen (name) - 1);
 
-    do 
+    do
     {
         errno  = 0;
 
@@ -232,12 +242,20 @@ int assm_write (assm_t *assm)
         if (!stream)
             break;
 
-        if (fwrite (assm->code.data, 1, assm->code.ip, stream) != assm->code.ip)
+        if (assm->object)
+        {
+            if (assm_write_obj (assm, stream) )
+            {
+                errptr = "Can't write object file";
+                break;
+            }
+        }
+        else if (assm_write_img (assm, stream) )
         {
             errptr = "Can't write data to file";
             break;
         }
-        
+
         if (fclose (stream) == EOF)
             break;
 
@@ -254,632 +272,2014 @@ int assm_write (assm_t *assm)
     ASSM_ERR (ASSM_ERRSYSTEM, errptr);
 }
 
-void assm_error (assm_t *assm)
+static int assm_write_obj (assm_t *assm, FILE *stream)
 {
     assert (assm);
+    assert (stream);
 
-    fprintf (stderr, "ERROR: ");
+    struct obj_header     header   = {};
+    struct obj_sym       *sym      = NULL;
+    struct obj_rel       *rel      = NULL;
+    struct assm_symindex  imports  = {};
+    size_t                defined  = assm->labeltable.size + assm->functable.size + assm->restable.size;
+    size_t                capacity = 2;
 
-    if (assm->error.func)
-        fprintf (stderr, "%s: ", assm->error.func);
+    while (capacity < assm->reltable.size * 2)
+        capacity *= 2;
 
-    fprintf (stderr, "%s", assm_strerror (assm->error.err) );
-    
-    if (assm->error.word)
-        fprintf (stderr, ": \"%s\"", assm->error.word);
+    sym          = arena_alloc (&assm->arena, (defined + assm->reltable.size) * sizeof (*sym) + 1);
+    rel          = arena_alloc (&assm->arena, assm->reltable.size * sizeof (*rel) + 1);
+    imports.slot = arena_alloc (&assm->arena, capacity * sizeof (*imports.slot) );
+    imports.mask = capacity - 1;
 
-    if (assm->error.str)
-        fprintf (stderr, ": %s", assm->error.str);
+    if (!sym || !rel || !imports.slot)
+        return EXIT_FAILURE;
 
-    fprintf (stderr, "\n");
-}
+    for (size_t i = 0; i < assm->labeltable.size; i++, header.symcount++)
+    {
+        memcpy (sym[header.symcount].name, assm->labeltable.data[i].name, OBJ_NAMESIZE);
+        sym[header.symcount].type  = OBJ_SYMLABEL;
+        sym[header.symcount].flags = OBJ_SYMDEF;
+        sym[header.symcount].value = assm->labeltable.data[i].ip;
+    }
 
-int assm_translate (assm_t *assm)
-{
-    assert (assm);
-    assert (assm->text.word);
+    for (size_t i = 0; i < assm->functable.size; i++, header.symcount++)
+    {
+        memcpy (sym[header.symcount].name, assm->functable.data[i].name, OBJ_NAMESIZE);
+        sym[header.symcount].type  = OBJ_SYMFUNC;
+        sym[header.symcount].flags = OBJ_SYMDEF;
+        sym[header.symcount].value = assm->functable.data[i].ip;
+    }
 
-    if (assm->error.err)
-        return EXIT_FAILURE;
-    
-    uint8_t flag      = 0;
-    assm->text.wordid = 0;
-    assm->code.ip     = 0;
-    assm->passnum     = ASSM_PASS1;
-    while (assm->text.wordid < assm->text.wordsize)
+    for (size_t i = 0; i < assm->restable.size; i++, header.symcount++)
     {
-        assert (assm->text.wordid < assm->text.wordsize);
-        assert (assm->text.word[assm->text.wordid].str);
+        memcpy (sym[header.symcount].name, assm->restable.data[i].name, OBJ_NAMESIZE);
+        sym[header.symcount].type  = OBJ_SYMRES;
+        sym[header.symcount].flags = OBJ_SYMDEF;
+        sym[header.symcount].value = assm->restable.data[i].addr;
+        sym[header.symcount].size  = assm->restable.data[i].size;
 
-        if (!*assm->text.word[assm->text.wordid].str)
-            break;
+    }
 
-        if (word_handler (assm) )
-            return EXIT_FAILURE;
+    for (size_t i = 0; i < assm->reltable.size; i++, header.relcount++)
+    {
+        struct assm_reltable_elem *elem = &assm->reltable.data[i];
+        size_t                     id   = SIZE_MAX;
 
-        if (assm_resize (assm) )
-            return EXIT_FAILURE;
+        switch (elem->type)
+        {
+            case OBJ_SYMLABEL:
+                id = index_find (&assm->labeltable.index, assm->labeltable.data, sizeof (*assm->labeltable.data),
+                                 elem->str, elem->size);
+                break;
+            case OBJ_SYMFUNC:
+                id = index_find (&assm->functable.index, assm->functable.data, sizeof (*assm->functable.data),
+                                 elem->str, elem->size);
+                if (id != SIZE_MAX)
+                    id += assm->labeltable.size;
+                break;
+            case OBJ_SYMRES:
+                id = index_find (&assm->restable.index, assm->restable.data, sizeof (*assm->restable.data),
+                                 elem->str, elem->size);
+                if (id != SIZE_MAX)
+                    id += assm->labeltable.size + assm->functable.size;
+                break;
+        }
 
-        flag = 0;
-        for (size_t i = 0; !flag && i < PROC_CMDCOUNT && cmdtable[i].handler; i++)
-            if (!strncmp (assm->text.word[assm->text.wordid].str, cmdtable[i].name, STRSIZE) )
-            {
-                flag = 1;
-                if (cmdtable[i].handler (assm) )
-                    return EXIT_FAILURE;
-            }
+        if (id == SIZE_MAX)
+        {
+            size_t slot = (text_hash (elem->str, elem->size) + elem->type) & imports.mask;
 
-        if (!flag)
-            ASSM_ERR (ASSM_ERRCOMMAND, NULL);
-    }
+            while (imports.slot[slot])
+            {
+                struct obj_sym *import = &sym[imports.slot[slot] - 1];
 
-    assm->text.wordid = 0;
-    assm->code.ip     = 0;
-    assm->passnum     = ASSM_PASS2;
-    while (assm->text.wordid < assm->text.wordsize)
-    {
-        assert (assm->text.wordid < assm->text.wordsize);
-        assert (assm->text.word[assm->text.wordid].str);
+                if (import->type == elem->type && !strncmp (import->name, elem->str, elem->size) &&
+                    !import->name[elem->size])
+                    break;
 
-        if (!*assm->text.word[assm->text.wordid].str)
-            break;
+                slot = (slot + 1) & imports.mask;
+            }
 
-        flag = 0;
-        for (size_t i = 0; !flag && i < PROC_CMDCOUNT && cmdtable[i].handler; i++)
-            if (!strncmp (assm->text.word[assm->text.wordid].str, cmdtable[i].name, STRSIZE) )
+            if (!imports.slot[slot])
             {
-                flag = 1;
-                if (cmdtable[i].handler (assm) )
-                    return EXIT_FAILURE;
+                memcpy (sym[header.symcount].name, elem->str, elem->size);
+                sym[header.symcount].type = elem->type;
+
+                imports.slot[slot] = ++header.symcount;
             }
+
+            id = imports.slot[slot] - 1;
+        }
+
+        rel[header.relcount].offset = elem->offset;
+        rel[header.relcount].sym    = id;
     }
-    
-    return EXIT_SUCCESS;
-}
 
-static int word_handler (assm_t *assm)
-{
-    assert (assm);
-    assert (assm->text.word);
-    assert (assm->text.wordid < assm->text.wordsize);
-    assert (assm->text.word[assm->text.wordid].str);
+    header.magic    = OBJ_MAGIC;
+    header.version  = OBJ_VERSION;
+    header.codesize = assm->code.size;
+    header.datasize = assm->data.size * sizeof (*assm->data.data);
+    header.ressize  = assm->data.addr;
+    header.memtop   = assm->memtop;
+
+    if (fwrite (&header, sizeof (header), 1, stream) != 1)
+        return EXIT_FAILURE;
+
+    if (fwrite (assm->code.data, 1, assm->code.size, stream) != assm->code.size)
+        return EXIT_FAILURE;
+
+    if (fwrite (assm->data.data, 1, header.datasize, stream) != header.datasize)
+        return EXIT_FAILURE;
+
+    if (fwrite (sym, sizeof (*sym), header.symcount, stream) != header.symcount)
+        return EXIT_FAILURE;
+
+    if (fwrite (rel, sizeof (*rel), header.relcount, stream) != header.relcount)
+        return EXIT_FAILURE;
 
-    if (assm->text.word[assm->text.wordid].size >= STRSIZE)
-        ASSM_ERR (ASSM_ERRWORD, "Too long");
-    
     return EXIT_SUCCESS;
 }
 
-static int assm_resize (assm_t *assm)
+static int assm_write_img (assm_t *assm, FILE *stream)
 {
     assert (assm);
-    assert (assm->code.data);
-    assert (assm->labeltable.data);
-    assert (assm->restable.data);
-    assert (assm->functable.data);
-    
-    void *ptr = NULL;
+    assert (stream);
 
-    if (assm->code.ip + 0x10 >= assm->code.size)
-    {
-        ptr = realloc (assm->code.data, (assm->code.ip + 0x10) * 2);
-
-        if (!ptr)
-            ASSM_ERR (ASSM_ERRSYSTEM, "Can't realloc code");
+    struct img_desc  desc  = {};
+    struct obj_sym  *sym   = NULL;
+    size_t           count = 0;
 
-        assm->code.size  = (assm->code.ip + 0x10) * 2;
-        assm->code.data  = ptr;
+    sym = arena_alloc (&assm->arena, (assm->labeltable.size + assm->functable.size + assm->restable.size) *
+                                     sizeof (*sym) + 1);
 
-        memset (assm->code.data + assm->code.ip, 0, assm->code.size - assm->code.ip);
-    }
+    if (!sym)
+        return EXIT_FAILURE;
 
-    if (assm->labeltable.size >= assm->labeltable.capacity)
+    for (size_t i = 0; i < assm->labeltable.size; i++, count++)
     {
-        ptr = realloc (assm->labeltable.data, assm->labeltable.size * 2 * sizeof (*assm->labeltable.data) );
-
-        if (!ptr)
-            ASSM_ERR (ASSM_ERRSYSTEM, "Can't realloc labels table");
-
-        assm->labeltable.capacity = assm->labeltable.size * 2;
-        assm->labeltable.data     = ptr;
-
-        memset (assm->labeltable.data + assm->labeltable.size, 0, 
-                (assm->labeltable.capacity - assm->labeltable.size) * sizeof (*assm->labeltable.data) );
+        memcpy (sym[count].name, assm->labeltable.data[i].name, OBJ_NAMESIZE);
+        sym[count].type  = OBJ_SYMLABEL;
+        sym[count].flags = OBJ_SYMDEF;
+        sym[count].value = assm->labeltable.data[i].ip;
     }
 
-    if (assm->restable.size >= assm->restable.capacity)
+    for (size_t i = 0; i < assm->functable.size; i++, count++)
     {
-        ptr = realloc (assm->restable.data, assm->restable.size * 2 * sizeof (*assm->restable.data) );
-
-        if (!ptr)
-            ASSM_ERR (ASSM_ERRSYSTEM, "Can't realloc reserves table");
-
-        assm->restable.capacity = assm->restable.size * 2;
-        assm->restable.data     = ptr;
-
-        memset (assm->restable.data + assm->restable.size, 0, 
-                (assm->restable.capacity - assm->restable.size) * sizeof (*assm->restable.data) );
+        memcpy (sym[count].name, assm->functable.data[i].name, OBJ_NAMESIZE);
+        sym[count].type  = OBJ_SYMFUNC;
+        sym[count].flags = OBJ_SYMDEF;
+        sym[count].value = assm->functable.data[i].ip;
     }
 
-    if (assm->functable.size >= assm->functable.capacity)
+    for (size_t i = 0; i < assm->restable.size; i++, count++)
     {
-        ptr = realloc (assm->functable.data, assm->functable.size * 2 * sizeof (*assm->functable.data) );
-
-        if (!ptr)
-            ASSM_ERR (ASSM_ERRSYSTEM, "Can't realloc functions table");
-
-        assm->functable.capacity = assm->functable.size * 2;
-        assm->functable.data     = ptr;  
-
-        memset (assm->functable.data + assm->functable.size, 0, 
-                (assm->functable.capacity - assm->functable.size) * sizeof (*assm->functable.data) );
+        memcpy (sym[count].name, assm->restable.data[i].name, OBJ_NAMESIZE);
+        sym[count].type  = OBJ_SYMRES;
+        sym[count].flags = OBJ_SYMDEF;
+        sym[count].value = assm->restable.data[i].addr;
+        sym[count].size  = assm->restable.data[i].size;
     }
 
-    return EXIT_SUCCESS;
-}
-
-static const char *assm_strerror (enum ASSM_ERRORS err)
-{
-    switch (err)
-    {
-        case ASSM_NOERR:
-            return "No error";
-        case ASSM_ERRWORD:
-            return "Bad word";
-        case ASSM_ERRCOMMAND:
-            return "Unknown command";
-        case ASSM_ERRLABEL:
-            return "Bad label";
-        case ASSM_ERRRES:
-            return "Bad reserve";
-        case ASSM_ERRFUNC:
-            return "Bad function";
-        case ASSM_ERRARG:
-            return "Bad argument";
-        case ASSM_ERRSYSTEM:
-            return "System error";
-    } 
-    
-    return "Undefined error";
+    desc.code     = assm->code.data;
+    desc.codesize = assm->code.ip;
+    desc.data     = assm->data.data;
+    desc.datasize = assm->data.size * sizeof (*assm->data.data);
+    desc.sym      = sym;
+    desc.symcount = count;
+    desc.entry    = 0;
+    desc.memsize  = img_memsize ( (assm->memtop > assm->data.addr) ? assm->memtop : assm->data.addr);
+    desc.stksize  = assm->stksize ? assm->stksize : PROC_STKSIZE;
+
+    return img_write (stream, &desc);
 }
 
-static int label_handler (assm_t *assm)
+void assm_error (assm_t *assm)
 {
     assert (assm);
-    assert (!assm->error.err);
-    assert (assm->labeltable.data);
-    assert (assm->labeltable.size < assm->labeltable.capacity);
-    assert (assm->text.wordid + 1 < assm->text.wordsize);
-    assert (assm->text.word[assm->text.wordid+1].str);
 
-    if (assm->passnum == ASSM_PASS2)
-    {
-        assm->text.wordid += 2;
+    fprintf (stderr, "ERROR: ");
 
-        return EXIT_SUCCESS;
-    }
+    if (assm->error.line)
+        fprintf (stderr, "%s:%zu:%zu: ", assm->text.name, assm->error.line, assm->error.col);
 
-    assm->text.wordid++;
+    if (assm->error.func)
+        fprintf (stderr, "%s: ", assm->error.func);
 
-    const char *word = assm->text.word[assm->text.wordid].str;
-    size_t       len = assm->text.word[assm->text.wordid].size;
+    fprintf (stderr, "%s", assm_strerror (assm->error.err) );
 
-    assert (len < STRSIZE);
+    if (*assm->error.word)
+        fprintf (stderr, ": \"%s\"", assm->error.word);
 
-    for (size_t i = 0; i < len; i++)
-        if (!isalnum (word[i]) )
-            ASSM_ERR (ASSM_ERRLABEL, "Bad syntax");
+    if (assm->error.str)
+        fprintf (stderr, ": %s", assm->error.str);
 
-    for (size_t i = 0; i < assm->labeltable.size; i++)
-        if (!strncmp (assm->labeltable.data[i].name, word, STRSIZE) )
-            ASSM_ERR (ASSM_ERRLABEL, "Redefinition");
+    fprintf (stderr, "\n");
+}
 
-    strncpy (assm->labeltable.data[assm->labeltable.size].name, word, STRSIZE);
-    assm->labeltable.data[assm->labeltable.size].ip = assm->code.ip;
+static void assm_seterr (assm_t *assm, enum ASSM_ERRORS err, const char *func, const char *str)
+{
+    assert (assm);
 
-    assm->labeltable.size++;
+    size_t size = assm->text.word.size;
 
-    assm->text.wordid++;
+    if (size >= STRSIZE)
+        size = STRSIZE - 1;
 
-    return EXIT_SUCCESS;
+    assm->error.err  = err;
+    assm->error.func = func;
+    assm->error.str  = str;
+    assm->error.line = assm->text.word.line;
+    assm->error.col  = assm->text.word.col;
+
+    if (assm->text.word.str)
+        memcpy (assm->error.word, assm->text.word.str, size);
+
+    assm->error.word[size] = '\0';
 }
 
-static int func_handler (assm_t *assm)
+int assm_translate (assm_t *assm)
 {
     assert (assm);
-    assert (!assm->error.err);
-    assert (assm->functable.data);
-    assert (assm->functable.size < assm->functable.capacity);
-    assert (assm->text.wordid + 1 < assm->text.wordsize);
-    assert (assm->text.word[assm->text.wordid+1].str);
+    assert (assm->text.buff);
 
-    if (assm->passnum == ASSM_PASS2)
-    {
-        assm->text.wordid += 2;
+    if (assm->error.err)
+        return EXIT_FAILURE;
 
-        return EXIT_SUCCESS;
-    }
+    struct assm_pool   pool  = {};
+    struct assm_chunk *chunk = NULL;
+    size_t             size  = 0;
+    int                ret   = EXIT_FAILURE;
 
-    assm->text.wordid++;
+    if (!assm->threads)
+    {
+        long cpus = sysconf (_SC_NPROCESSORS_ONLN);
 
-    const char *word = assm->text.word[assm->text.wordid].str;
-    size_t       len = assm->text.word[assm->text.wordid].size;
+        assm->threads = (cpus > 0) ? (size_t) cpus : 1;
+    }
 
-    assert (len < STRSIZE);
+    if (assm->threads > ASSM_MAXTHREADS)
+        assm->threads = ASSM_MAXTHREADS;
 
-    for (size_t i = 0; i < len; i++)
-        if (!isalnum (word[i]) )
-            ASSM_ERR (ASSM_ERRLABEL, "Bad syntax");
+    if (assm->cache.dir && mkdir (assm->cache.dir, 0777) == -1 && errno != EEXIST)
+        ASSM_ERR (ASSM_ERRSYSTEM, strerror (errno) );
 
-    for (size_t i = 0; i < assm->functable.size; i++)
-        if (!strncmp (assm->functable.data[i].name, word, STRSIZE) )
-            ASSM_ERR (ASSM_ERRLABEL, "Redefinition");
+    size = assm->text.buffsize / ASSM_CHUNKSIZE + 1;
 
-    strncpy (assm->functable.data[assm->functable.size].name, word, STRSIZE);
-    assm->functable.data[assm->functable.size].ip = assm->code.ip;
+    if (size > assm->threads * 4)
+        size = assm->threads * 4;
 
-    assm->functable.size++;
-    
-    assm->text.wordid++;
+    chunk = arena_alloc (&assm->arena, size * sizeof (*chunk) );
 
-    return EXIT_SUCCESS;
-}
+    if (!chunk)
+        ASSM_ERR (ASSM_ERRSYSTEM, "Can't allocate chunks");
 
-static int res_handler (assm_t *assm)
-{
-    assert (assm);
-    assert (!assm->error.err);
-    assert (assm->restable.data);
-    assert (assm->restable.size < assm->restable.capacity);
-    assert (assm->text.wordid + 1 < assm->text.wordsize);
-    assert (assm->text.word[assm->text.wordid+1].str);
+    pool.chunk = chunk;
+    pool.size  = assm_split (assm, chunk, size);
 
-    if (assm->passnum == ASSM_PASS2)
+    do
     {
-        assm->text.wordid += 2;
-
-        return EXIT_SUCCESS;
-    }
-
-    assm->text.wordid++;
-
-    const char *word = assm->text.word[assm->text.wordid].str;
-    int          len = (int) assm->text.word[assm->text.wordid].size;
-    int        count = 0;
-    int          ret = 0;
-    char      symbol = 0; 
-    uint64_t   size  = 0;
+        if (assm_relax (assm, &pool) )
+            break;
 
-    assert (len < STRSIZE);
+        assm->code.data = arena_alloc (&assm->arena, assm->code.size + 0x10);
+        assm->data.data = arena_alloc (&assm->arena, assm->data.size * sizeof (*assm->data.data) + 1);
 
-    ret = sscanf (word, "%[a-zA-Z0-9]%c%lu%n", 
-                        assm->restable.data[assm->restable.size].name,
-                        &symbol, &size, &count);
+        if (!assm->code.data || !assm->data.data)
+        {
+            assm_seterr (assm, ASSM_ERRSYSTEM, __PRETTY_FUNCTION__, "Can't allocate code");
+            break;
+        }
 
-    if (ret != 3 || symbol != ':' || count != len)
-        ASSM_ERR (ASSM_ERRRES, "Bad syntax");
+        for (size_t i = 0; i < pool.size; i++)
+        {
+            chunk[i].assm.code.data  = assm->code.data + chunk[i].ip;
+            chunk[i].assm.data.data  = chunk[i].assm.data.size ? assm->data.data + chunk[i].addr : NULL;
+            chunk[i].assm.labeltable = assm->labeltable;
+            chunk[i].assm.restable   = assm->restable;
+            chunk[i].assm.functable  = assm->functable;
+        }
 
-    if (size == 0)
-        ASSM_ERR (ASSM_ERRRES, "Can't reserve 0 size");
+        if (assm_run (assm, &pool, ASSM_PASS2) )
+            break;
 
-    for (size_t i = 0; i < assm->restable.size; i++)
-        if (!strncmp (assm->restable.data[assm->restable.size].name, assm->restable.data[i].name, STRSIZE) )
-            ASSM_ERR (ASSM_ERRRES, "Redefinition");
+        if (assm->object && assm_relocs (assm, &pool) )
+            break;
 
-    if (assm->restable.size)
-        assm->restable.data[assm->restable.size].addr = assm->restable.data[assm->restable.size-1].addr +
-                                                        assm->restable.data[assm->restable.size-1].size;
-    else
-        assm->restable.data[assm->restable.size].addr = 0;
+        for (size_t i = 0; i < pool.size; i++)
+        {
+            assm->cache.hits   += chunk[i].assm.cache.hits;
+            assm->cache.misses += chunk[i].assm.cache.misses;
 
-    assm->restable.data[assm->restable.size].size = size;
+            if (chunk[i].assm.memtop > assm->memtop)
+                assm->memtop = chunk[i].assm.memtop;
+        }
 
-    if (assm->restable.data[assm->restable.size].addr +
-        assm->restable.data[assm->restable.size].size >= PROC_MEMSIZE)
-        ASSM_ERR (ASSM_ERRRES, "Not enough memory");
+        assm->code.ip = assm->code.size;
+        assm->passnum = ASSM_PASS2;
 
-    assm->restable.size++;
+        ret = EXIT_SUCCESS;
+    }
+    while (0);
 
-    assm->text.wordid++;
+    for (size_t i = 0; i < pool.size; i++)
+        arena_free (&chunk[i].assm.arena);
 
-    return EXIT_SUCCESS;
+    return ret;
 }
 
-static int pushtype_handler (assm_t *assm, enum PROC_CMDCODES code)
+static size_t assm_split (assm_t *assm, struct assm_chunk *chunk, size_t size)
 {
     assert (assm);
-    assert (!assm->error.err);
-    assert (assm->text.word);
-    assert (assm->text.wordid + 1 < assm->text.wordsize);
-    assert (assm->text.word[assm->text.wordid+1].str);
-    assert (assm->code.ip + 0x10 < assm->code.size);
-    assert (assm->code.data);
-    assert (assm->restable.data);
-    assert (assm->restable.size < assm->restable.capacity);
-
-    assm->text.wordid++;
+    assert (chunk);
+    assert (size);
 
-    const char *word          = assm->text.word[assm->text.wordid].str;
-    int         len           = (int) assm->text.word[assm->text.wordid].size;
-    char        name[STRSIZE] = "";
-    char        symbol        = 0;
-    int         count         = 0;
-    int         ret           = 0;
-    union val   arg           = {};
+    const char *buff  = assm->text.buff;
+    size_t      begin = 0;
+    size_t      count = 0;
 
-    ret = sscanf (word, "[r%hhu%c%n", &arg.vu8, &symbol, &count);
-
-    if (ret == 2 && symbol == ']' && count == len)
+    for (size_t i = 1; i <= size; i++)
     {
-        *( (uint8_t *) (assm->code.data + assm->code.ip) )     = code | CMD_FLGREG | CMD_FLGMEM;
-        *( (uint8_t *) (assm->code.data + assm->code.ip + 1) ) = arg.vu8;
+        size_t end = (i == size) ? assm->text.buffsize : assm->text.buffsize / size * i;
 
-        assm->code.ip += 2;
-        assm->text.wordid++;
+        if (end < begin)
+            end = begin;
 
-        return EXIT_SUCCESS;
-    }
+        if (end < assm->text.buffsize)
+            end = (size_t) (text_unitend (assm, buff + end) - buff);
 
-    ret = sscanf (word, "[%lu%c%n", &arg.vu64, &symbol, &count);\
+        if (end == begin && i != size)
+            continue;
 
-    if (ret == 2 && symbol == ']' && count == len)
-    {
-        if (arg.vu64 >= PROC_MEMSIZE)
-            ASSM_ERR (ASSM_ERRARG, "Not enough memory");
+        memset (&chunk[count], 0, sizeof (chunk[count]) );
 
-        *( (uint8_t *)  (assm->code.data + assm->code.ip) )     = code | CMD_FLGMEM;
-        *( (uint64_t *) (assm->code.data + assm->code.ip + 1) ) = arg.vu64;
+        chunk[count].assm.text.buff     = buff + begin;
+        chunk[count].assm.text.buffsize = end - begin;
+        chunk[count].assm.parent        = assm;
+        chunk[count].assm.threads       = 1;
+        chunk[count].assm.cache.dir     = assm->cache.dir;
+        chunk[count].assm.object        = assm->object;
 
-        assm->code.ip += 9;
-        assm->text.wordid++;
+        strncpy (chunk[count].assm.text.name, assm->text.name, STRSIZE - 1);
 
-        return EXIT_SUCCESS;
+        count++;
+        begin = end;
     }
 
-    ret = sscanf (word, "r%hhu%n", &arg.vu8, &count);
+    return count;
+}
 
-    if (ret == 1 && count == len)
+static int assm_run (assm_t *assm, struct assm_pool *pool, enum ASSM_PASSNUM passnum)
+{
+    assert (assm);
+    assert (pool);
+
+    pthread_t thread[ASSM_MAXTHREADS] = {};
+    size_t    count                   = (assm->threads < pool->size) ? assm->threads : pool->size;
+
+    pool->next    = 0;
+    pool->passnum = passnum;
+
+    for (size_t i = 1; i < count; i++)
+        if (pthread_create (&thread[i], NULL, assm_worker, pool) )
+        {
+            count = i;
+            break;
+        }
+
+    assm_worker (pool);
+
+    for (size_t i = 1; i < count; i++)
+        pthread_join (thread[i], NULL);
+
+    for (size_t i = 0, line = 1; i < pool->size; i++)
+    {
+        assm_t *unit = &pool->chunk[i].assm;
+
+        if (unit->error.err)
+        {
+            assm->error = unit->error;
+
+            if (assm->error.line)
+                assm->error.line += line - 1;
+
+            return EXIT_FAILURE;
+        }
+
+        line += unit->text.line - 1;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void *assm_worker (void *arg)
+{
+    assert (arg);
+
+    struct assm_pool *pool = arg;
+    size_t            id   = 0;
+
+    while ( (id = __atomic_fetch_add (&pool->next, 1, __ATOMIC_RELAXED) ) < pool->size)
+    {
+        assm_t *unit = &pool->chunk[id].assm;
+
+        if (pool->passnum == ASSM_PASS1 && assm_init (unit) )
+            continue;
+
+        assm_pass (unit, pool->passnum);
+    }
+
+    return NULL;
+}
+
+static int assm_init (assm_t *assm)
+{
+    assert (assm);
+
+    assm->labeltable.size     = 0;
+    assm->labeltable.capacity = 1;
+    assm->labeltable.data     = arena_alloc (&assm->arena, assm->labeltable.capacity * sizeof (*assm->labeltable.data) );
+    assm->restable.size       = 0;
+    assm->restable.capacity   = 1;
+    assm->restable.data       = arena_alloc (&assm->arena, assm->restable.capacity * sizeof (*assm->restable.data) );
+    assm->functable.size      = 0;
+    assm->functable.capacity  = 1;
+    assm->functable.data      = arena_alloc (&assm->arena, assm->functable.capacity * sizeof (*assm->functable.data) );
+
+    if (!assm->labeltable.data || !assm->restable.data || !assm->functable.data)
+        ASSM_ERR (ASSM_ERRSYSTEM, "Can't allocate tables");
+
+    return EXIT_SUCCESS;
+}
+
+static int assm_pass (assm_t *assm, enum ASSM_PASSNUM passnum)
+{
+    assert (assm);
+    assert (assm->text.buff);
+
+    assm->code.ip   = 0;
+    assm->data.addr = 0;
+    assm->memtop    = 0;
+    assm->passnum   = passnum;
+
+    if (passnum == ASSM_PASS1)
+        assm->data.size = 0;
+
+    if (assm->cache.dir)
+    {
+        if (assm_units (assm, passnum) )
+            return EXIT_FAILURE;
+    }
+    else
+    {
+        text_rewind (assm);
+
+        if (assm_block (assm, assm->text.buff + assm->text.buffsize) )
+            return EXIT_FAILURE;
+    }
+
+    if (passnum == ASSM_PASS1)
+        assm->code.size = assm->code.ip;
+
+    assert (assm->code.ip == assm->code.size);
+
+    return EXIT_SUCCESS;
+}
+
+static int assm_block (assm_t *assm, const char *end)
+{
+    assert (assm);
+    assert (end);
+
+    uint8_t flag = 0;
+
+    while (assm->text.word.size && assm->text.word.str < end)
+    {
+        if (assm->passnum == ASSM_PASS1)
+        {
+            if (word_handler (assm) )
+                return EXIT_FAILURE;
+
+            if (assm_resize (assm) )
+                return EXIT_FAILURE;
+        }
+
+        flag = 0;
+        for (size_t i = 0; !flag && i < PROC_CMDCOUNT && cmdtable[i].handler; i++)
+            if (text_equal (&assm->text.word, cmdtable[i].name) )
+            {
+                flag = 1;
+                if (cmdtable[i].handler (assm) )
+                    return EXIT_FAILURE;
+            }
+
+        if (!flag)
+            ASSM_ERR (ASSM_ERRCOMMAND, NULL);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int assm_units (assm_t *assm, enum ASSM_PASSNUM passnum)
+{
+    assert (assm);
+    assert (assm->text.buff);
+
+    struct assm_unittable *units = &assm->cache.units;
+    const char            *pos   = assm->text.buff;
+    const char            *end   = assm->text.buff + assm->text.buffsize;
+    size_t                 line  = 1;
+
+    if (passnum == ASSM_PASS1)
+    {
+        units->size = 0;
+
+        while (pos < end)
+        {
+            struct assm_unit *unit = NULL;
+
+            if (units->size >= units->capacity)
+            {
+                size_t  capacity = units->capacity ? units->capacity * 2 : 0x10;
+                void   *ptr      = arena_alloc (&assm->arena, capacity * sizeof (*units->data) );
+
+                if (!ptr)
+                    ASSM_ERR (ASSM_ERRSYSTEM, "Can't resize units table");
+
+                if (units->size)
+                    memcpy (ptr, units->data, units->size * sizeof (*units->data) );
+
+                units->capacity = capacity;
+                units->data     = ptr;
+            }
+
+            unit = &units->data[units->size++];
+
+            memset (unit, 0, sizeof (*unit) );
+
+            unit->str   = pos;
+            unit->size  = (size_t) (text_unitend (assm, pos) - pos);
+            unit->line  = line;
+            unit->hash  = text_hash (unit->str, unit->size);
+            unit->ip    = assm->code.ip;
+            unit->label = assm->labeltable.size;
+            unit->func  = assm->functable.size;
+            unit->res   = assm->restable.size;
+
+            unit->addr  = assm->data.addr;
+
+            for (const char *ptr = pos; (ptr = memchr (ptr, '\n', (size_t) (pos + unit->size - ptr) ) ); ptr++)
+                unit->lines++;
+
+            if (!cache_load (assm, unit) )
+            {
+                assm->cache.hits++;
+
+                if (cache_apply (assm, unit) )
+                    return EXIT_FAILURE;
+            }
+            else
+            {
+                assm->cache.misses++;
+
+                text_seek (assm, pos, line);
+
+                if (assm_block (assm, pos + unit->size) )
+                    return EXIT_FAILURE;
+
+                if (assm->data.size > unit->addr)
+                    unit->datasize = assm->data.size - unit->addr;
+            }
+
+            pos  += unit->size;
+            line += unit->lines;
+        }
+
+        assm->cache.labeltable = assm->labeltable;
+        assm->cache.functable  = assm->functable;
+        assm->cache.restable   = assm->restable;
+    }
+    else
+        for (size_t i = 0; i < units->size; i++)
+        {
+            struct assm_unit *unit = &units->data[i];
+
+            assert (assm->code.ip == unit->ip);
+
+            unit->rel       = assm->reltable.size;
+            assm->data.addr = unit->addr;
+
+            if (unit->entry)
+            {
+                if (cache_patch (assm, unit) )
+                    return EXIT_FAILURE;
+            }
+            else
+            {
+                uint64_t memtop = assm->memtop;
+
+                assm->memtop = 0;
+
+                text_seek (assm, unit->str, unit->line);
+
+                if (assm_block (assm, unit->str + unit->size) )
+                    return EXIT_FAILURE;
+
+                unit->memtop = assm->memtop;
+
+                if (memtop > assm->memtop)
+                    assm->memtop = memtop;
+
+                if (cache_store (assm, unit) )
+                    return EXIT_FAILURE;
+            }
+
+            line += unit->lines;
+        }
+
+    assm->text.line = line;
+
+    return EXIT_SUCCESS;
+}
+
+static int cache_load (assm_t *assm, struct assm_unit *unit)
+{
+    assert (assm);
+    assert (unit);
+
+    char                        name[PATH_MAX] = "";
+    FILE                       *stream         = NULL;
+    struct stat                 st             = {};
+    struct assm_cachehdr       *entry          = NULL;
+    const uint8_t              *code           = NULL;
+    const uint8_t              *data           = NULL;
+    const struct obj_sym       *sym            = NULL;
+    const struct obj_rel       *rel            = NULL;
+    size_t                      size           = 0;
+    int                         ret            = EXIT_FAILURE;
+
+    if (snprintf (name, sizeof (name), "%s/%016llx", assm->cache.dir,
+                  (unsigned long long) unit->hash) >= (int) sizeof (name) )
+        return EXIT_FAILURE;
+
+    stream = fopen (name, "r");
+
+    if (!stream)
+        return EXIT_FAILURE;
+
+    do
+    {
+        if (fstat (fileno (stream), &st) == -1 || (size_t) st.st_size < sizeof (*entry) )
+            break;
+
+        size  = (size_t) st.st_size;
+        entry = arena_alloc (&assm->arena, size);
+
+        if (!entry || fread (entry, 1, size, stream) != size)
+            break;
+
+        if (entry->magic != ASSM_CACHEMAGIC || entry->version != ASSM_CACHEVERSION ||
+            entry->obj.magic != OBJ_MAGIC || entry->obj.version != OBJ_VERSION)
+            break;
+
+        if (entry->hash != unit->hash || entry->textsize != unit->size)
+            break;
+
+        if (entry->obj.codesize >= (SIZE_MAX >> 2) || entry->obj.symcount >= (SIZE_MAX >> 8) ||
+            entry->obj.relcount >= (SIZE_MAX >> 8) || entry->obj.ressize >= PROC_MEMSIZE ||
+            entry->obj.memtop > PROC_MEMSIZE ||
+            entry->obj.datasize % sizeof (union val) ||
+            entry->obj.datasize / sizeof (union val) > entry->obj.ressize)
+            break;
+
+        if (size != sizeof (*entry) + entry->textsize + entry->obj.codesize + entry->obj.datasize +
+                    entry->obj.symcount * sizeof (*sym) + entry->obj.relcount * sizeof (*rel) )
+            break;
+
+        if (memcmp (entry + 1, unit->str, unit->size) )
+            break;
+
+        code = (const uint8_t *) (entry + 1) + entry->textsize;
+        data = code + entry->obj.codesize;
+        sym  = (const struct obj_sym *) (data + entry->obj.datasize);
+        rel  = (const struct obj_rel *) (sym + entry->obj.symcount);
+
+        ret = EXIT_SUCCESS;
+
+        for (size_t i = 0; ret == EXIT_SUCCESS && i < entry->obj.symcount; i++)
+            if (sym[i].type > OBJ_SYMRES || !sym[i].name[0] || memchr (sym[i].name, '\0', OBJ_NAMESIZE) == NULL ||
+                ( (sym[i].flags & OBJ_SYMDEF) && sym[i].type != OBJ_SYMRES && sym[i].value > entry->obj.codesize) ||
+                ( (sym[i].flags & OBJ_SYMDEF) && sym[i].type == OBJ_SYMRES &&
+                  (!sym[i].size || sym[i].value + sym[i].size > entry->obj.ressize) ) )
+                ret = EXIT_FAILURE;
+
+        for (size_t i = 0; ret == EXIT_SUCCESS && i < entry->obj.relcount; i++)
+            if (rel[i].sym >= entry->obj.symcount || rel[i].offset < 1 ||
+                rel[i].offset > entry->obj.codesize || entry->obj.codesize - rel[i].offset < sizeof (uint64_t) )
+                ret = EXIT_FAILURE;
+    }
+    while (0);
+
+    fclose (stream);
+
+    if (ret == EXIT_SUCCESS)
+        unit->entry = entry;
+
+    return ret;
+}
+
+static int cache_apply (assm_t *assm, struct assm_unit *unit)
+{
+    assert (assm);
+    assert (unit);
+    assert (unit->entry);
+
+    const struct assm_cachehdr *entry = unit->entry;
+    const struct obj_sym       *sym   = (const struct obj_sym *) ( (const uint8_t *) (entry + 1) +
+                                        entry->textsize + entry->obj.codesize + entry->obj.datasize);
+
+    for (size_t i = 0; i < entry->obj.symcount; i++)
+    {
+        if (!(sym[i].flags & OBJ_SYMDEF) )
+            continue;
+
+        switch (sym[i].type)
+        {
+            case OBJ_SYMLABEL:
+                memcpy (assm->labeltable.data[assm->labeltable.size].name, sym[i].name, OBJ_NAMESIZE);
+                assm->labeltable.data[assm->labeltable.size].ip = unit->ip + sym[i].value;
+                assm->labeltable.size++;
+                break;
+            case OBJ_SYMFUNC:
+                memcpy (assm->functable.data[assm->functable.size].name, sym[i].name, OBJ_NAMESIZE);
+                assm->functable.data[assm->functable.size].ip = unit->ip + sym[i].value;
+                assm->functable.size++;
+                break;
+            case OBJ_SYMRES:
+                if (unit->addr + sym[i].value + sym[i].size >= PROC_MEMSIZE)
+                    ASSM_ERR (ASSM_ERRRES, "Not enough memory");
+
+                memcpy (assm->restable.data[assm->restable.size].name, sym[i].name, OBJ_NAMESIZE);
+                assm->restable.data[assm->restable.size].addr = unit->addr + sym[i].value;
+                assm->restable.data[assm->restable.size].size = sym[i].size;
+                assm->restable.size++;
+                break;
+        }
+
+        if (assm_resize (assm) )
+            return EXIT_FAILURE;
+    }
+
+    if (unit->addr + entry->obj.ressize >= PROC_MEMSIZE)
+        ASSM_ERR (ASSM_ERRRES, "Not enough memory");
+
+    unit->datasize = entry->obj.datasize / sizeof (union val);
+
+    if (unit->datasize)
+        assm->data.size = unit->addr + unit->datasize;
+
+    assm->code.ip   += entry->obj.codesize;
+    assm->data.addr  = unit->addr + entry->obj.ressize;
+
+    return EXIT_SUCCESS;
+}
+
+static int cache_patch (assm_t *assm, struct assm_unit *unit)
+{
+    assert (assm);
+    assert (unit);
+    assert (unit->entry);
+    assert (assm->code.data);
+
+    const struct assm_cachehdr *entry = unit->entry;
+    const uint8_t              *code  = (const uint8_t *) (entry + 1) + entry->textsize;
+    const uint8_t              *data  = code + entry->obj.codesize;
+    const struct obj_sym       *sym   = (const struct obj_sym *) (data + entry->obj.datasize);
+    const struct obj_rel       *rel   = (const struct obj_rel *) (sym + entry->obj.symcount);
+
+    memcpy (assm->code.data + unit->ip, code, entry->obj.codesize);
+
+    if (entry->obj.datasize)
+    {
+        assert (assm->data.data);
+
+        memcpy (assm->data.data + unit->addr, data, entry->obj.datasize);
+    }
+
+    for (size_t i = 0; i < entry->obj.relcount; i++)
+    {
+        const struct obj_sym *target = &sym[rel[i].sym];
+        size_t                size   = strlen (target->name);
+        uint64_t              value  = 0;
+
+        if (assm_lookup (assm, target->type, target->name, size, &value) == SIZE_MAX && !assm->object)
+        {
+            assm->text.word.str  = target->name;
+            assm->text.word.size = size;
+            assm->text.word.line = unit->line;
+            assm->text.word.col  = 1;
+
+            ASSM_ERR (ASSM_ERRARG, "Unknown name");
+        }
+
+        memcpy (assm->code.data + unit->ip + rel[i].offset, &value, sizeof (value) );
+
+        if (assm_reloc (assm, unit->ip + rel[i].offset, target->type, target->name, size) )
+            return EXIT_FAILURE;
+    }
+
+    if (entry->obj.memtop > assm->memtop)
+        assm->memtop = entry->obj.memtop;
+
+    assm->code.ip += entry->obj.codesize;
+
+    return EXIT_SUCCESS;
+}
+
+static int cache_store (assm_t *assm, struct assm_unit *unit)
+{
+    assert (assm);
+    assert (unit);
+    assert (assm->code.data);
+
+    const struct assm_unit *next           = (unit + 1 < assm->cache.units.data + assm->cache.units.size) ?
+                                             unit + 1 : NULL;
+    size_t                  labels         = (next ? next->label : assm->cache.labeltable.size) - unit->label;
+    size_t                  funcs          = (next ? next->func  : assm->cache.functable.size)  - unit->func;
+    size_t                  res            = (next ? next->res   : assm->cache.restable.size)   - unit->res;
+    struct assm_cachehdr    entry          = {};
+    char                    name[PATH_MAX] = "";
+    char                    temp[PATH_MAX] = "";
+    struct obj_sym         *sym            = NULL;
+    struct obj_rel         *rel            = NULL;
+    uint8_t                *code           = NULL;
+    FILE                   *stream         = NULL;
+    int                     fd             = -1;
+    const char             *errstr         = NULL;
+
+    entry.magic        = ASSM_CACHEMAGIC;
+    entry.version      = ASSM_CACHEVERSION;
+    entry.hash         = unit->hash;
+    entry.textsize     = unit->size;
+    entry.obj.magic    = OBJ_MAGIC;
+    entry.obj.version  = OBJ_VERSION;
+    entry.obj.codesize = assm->code.ip - unit->ip;
+    entry.obj.datasize = unit->datasize * sizeof (union val);
+    entry.obj.ressize  = assm->data.addr - unit->addr;
+    entry.obj.relcount = assm->reltable.size - unit->rel;
+    entry.obj.memtop   = unit->memtop;
+
+    code = arena_alloc (&assm->arena, entry.obj.codesize + 1);
+    sym  = arena_alloc (&assm->arena, (labels + funcs + res + entry.obj.relcount) * sizeof (*sym) + 1);
+    rel  = arena_alloc (&assm->arena, entry.obj.relcount * sizeof (*rel) + 1);
+
+    if (!code || !sym || !rel)
+        ASSM_ERR (ASSM_ERRSYSTEM, "Can't allocate cache entry");
+
+    memcpy (code, assm->code.data + unit->ip, entry.obj.codesize);
+
+    for (size_t i = 0; i < labels; i++, entry.obj.symcount++)
+    {
+        const struct assm_labeltable_elem *elem = &assm->cache.labeltable.data[unit->label + i];
+
+        memcpy (sym[entry.obj.symcount].name, elem->name, OBJ_NAMESIZE);
+        sym[entry.obj.symcount].type  = OBJ_SYMLABEL;
+        sym[entry.obj.symcount].flags = OBJ_SYMDEF;
+        sym[entry.obj.symcount].value = elem->ip - unit->ip;
+    }
+
+    for (size_t i = 0; i < funcs; i++, entry.obj.symcount++)
+    {
+        const struct assm_functable_elem *elem = &assm->cache.functable.data[unit->func + i];
+
+        memcpy (sym[entry.obj.symcount].name, elem->name, OBJ_NAMESIZE);
+        sym[entry.obj.symcount].type  = OBJ_SYMFUNC;
+        sym[entry.obj.symcount].flags = OBJ_SYMDEF;
+        sym[entry.obj.symcount].value = elem->ip - unit->ip;
+    }
+
+    for (size_t i = 0; i < res; i++, entry.obj.symcount++)
+    {
+        const struct assm_restable_elem *elem = &assm->cache.restable.data[unit->res + i];
+
+        memcpy (sym[entry.obj.symcount].name, elem->name, OBJ_NAMESIZE);
+        sym[entry.obj.symcount].type  = OBJ_SYMRES;
+        sym[entry.obj.symcount].flags = OBJ_SYMDEF;
+        sym[entry.obj.symcount].value = elem->addr - unit->addr;
+        sym[entry.obj.symcount].size  = elem->size;
+    }
+
+    for (size_t i = 0; i < entry.obj.relcount; i++, entry.obj.symcount++)
+    {
+        const struct assm_reltable_elem *elem = &assm->reltable.data[unit->rel + i];
+
+        memcpy (sym[entry.obj.symcount].name, elem->str, elem->size);
+        sym[entry.obj.symcount].type = elem->type;
+
+        rel[i].offset = elem->offset - unit->ip;
+        rel[i].sym    = entry.obj.symcount;
+
+        memset (code + rel[i].offset, 0, sizeof (uint64_t) );
+    }
+
+    if (snprintf (name, sizeof (name), "%s/%016llx", assm->cache.dir,
+                  (unsigned long long) unit->hash) >= (int) sizeof (name) ||
+        snprintf (temp, sizeof (temp), "%s/.tmpXXXXXX", assm->cache.dir) >= (int) sizeof (temp) )
+        ASSM_ERR (ASSM_ERRSYSTEM, "Too long cache path");
+
+    do
+    {
+        errno = 0;
+
+        fd = mkstemp (temp);
+
+        if (fd == -1)
+            break;
+
+        stream = fdopen (fd, "w");
+
+        if (!stream)
+            break;
+
+        fd = -1;
+
+        if (fwrite (&entry, sizeof (entry), 1, stream) != 1 ||
+            fwrite (unit->str, 1, unit->size, stream) != unit->size ||
+            fwrite (code, 1, entry.obj.codesize, stream) != entry.obj.codesize ||
+            (entry.obj.datasize &&
+             fwrite (assm->data.data + unit->addr, 1, entry.obj.datasize, stream) != entry.obj.datasize) ||
+            fwrite (sym, sizeof (*sym), entry.obj.symcount, stream) != entry.obj.symcount ||
+            fwrite (rel, sizeof (*rel), entry.obj.relcount, stream) != entry.obj.relcount)
+        {
+            errstr = "Can't write cache entry";
+            break;
+        }
+
+        if (fclose (stream) == EOF)
+        {
+            stream = NULL;
+            break;
+        }
+
+        stream = NULL;
+
+        if (rename (temp, name) == -1)
+            break;
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    if (!errstr)
+        errstr = strerror (errno);
+
+    if (stream)
+        fclose (stream);
+    if (fd != -1)
+        close (fd);
+
+    unlink (temp);
+
+    ASSM_ERR (ASSM_ERRSYSTEM, errstr);
+}
+
+static int assm_merge (assm_t *assm, struct assm_pool *pool)
+{
+    assert (assm);
+    assert (pool);
+
+    size_t   labels = 0;
+    size_t   res    = 0;
+    size_t   funcs  = 0;
+    uint64_t ip     = 0;
+    uint64_t addr   = 0;
+
+    for (size_t i = 0; i < pool->size; i++)
+    {
+        labels += pool->chunk[i].assm.labeltable.size;
+        res    += pool->chunk[i].assm.restable.size;
+        funcs  += pool->chunk[i].assm.functable.size;
+    }
+
+    assm->labeltable.size     = 0;
+    assm->restable.size       = 0;
+    assm->functable.size      = 0;
+    assm->data.size           = 0;
+    assm->labeltable.capacity = labels + 1;
+    assm->labeltable.data     = arena_alloc (&assm->arena, assm->labeltable.capacity * sizeof (*assm->labeltable.data) );
+    assm->restable.capacity   = res + 1;
+    assm->restable.data       = arena_alloc (&assm->arena, assm->restable.capacity * sizeof (*assm->restable.data) );
+    assm->functable.capacity  = funcs + 1;
+    assm->functable.data      = arena_alloc (&assm->arena, assm->functable.capacity * sizeof (*assm->functable.data) );
+
+    if (!assm->labeltable.data || !assm->restable.data || !assm->functable.data)
+        ASSM_ERR (ASSM_ERRSYSTEM, "Can't allocate tables");
+
+    for (size_t i = 0; i < pool->size; i++)
+    {
+        assm_t *unit = &pool->chunk[i].assm;
+
+        pool->chunk[i].ip   = ip;
+        pool->chunk[i].addr = addr;
+
+        for (size_t j = 0; j < unit->labeltable.size; j++)
+        {
+            assm->labeltable.data[assm->labeltable.size]     = unit->labeltable.data[j];
+            assm->labeltable.data[assm->labeltable.size].ip += ip;
+            assm->labeltable.size++;
+        }
+
+        for (size_t j = 0; j < unit->functable.size; j++)
+        {
+            assm->functable.data[assm->functable.size]     = unit->functable.data[j];
+            assm->functable.data[assm->functable.size].ip += ip;
+            assm->functable.size++;
+        }
+
+        for (size_t j = 0; j < unit->restable.size; j++)
+        {
+            assm->restable.data[assm->restable.size]       = unit->restable.data[j];
+            assm->restable.data[assm->restable.size].addr += addr;
+            assm->restable.size++;
+        }
+
+        if (unit->data.size)
+            assm->data.size = addr + unit->data.size;
+
+        addr += unit->data.addr;
+
+        if (addr >= PROC_MEMSIZE)
+        {
+            assm_seterr (assm, ASSM_ERRRES, __PRETTY_FUNCTION__, "Not enough memory");
+            return EXIT_FAILURE;
+        }
+
+        ip += unit->code.size;
+    }
+
+    assm->code.size = ip;
+    assm->data.addr = addr;
+
+    if (index_build (assm, &assm->labeltable.index, assm->labeltable.data, assm->labeltable.size,
+                     sizeof (*assm->labeltable.data), ASSM_ERRLABEL) )
+        return EXIT_FAILURE;
+
+    if (index_build (assm, &assm->functable.index, assm->functable.data, assm->functable.size,
+                     sizeof (*assm->functable.data), ASSM_ERRLABEL) )
+        return EXIT_FAILURE;
+
+    if (index_build (assm, &assm->restable.index, assm->restable.data, assm->restable.size,
+                     sizeof (*assm->restable.data), ASSM_ERRRES) )
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+static int assm_relax (assm_t *assm, struct assm_pool *pool)
+{
+    assert (assm);
+    assert (pool);
+
+    uint64_t size = 0;
+
+    do
+    {
+        size = assm->code.size;
+
+        if (assm_run (assm, pool, ASSM_PASS1) )
+            return EXIT_FAILURE;
+
+        if (assm_merge (assm, pool) )
+            return EXIT_FAILURE;
+    }
+    while (!assm->object && !assm->cache.dir && assm->code.size != size);
+
+    return EXIT_SUCCESS;
+}
+
+static int assm_relocs (assm_t *assm, struct assm_pool *pool)
+{
+    assert (assm);
+    assert (pool);
+
+    size_t size = 0;
+
+    for (size_t i = 0; i < pool->size; i++)
+        size += pool->chunk[i].assm.reltable.size;
+
+    assm->reltable.capacity = size + 1;
+    assm->reltable.data     = arena_alloc (&assm->arena, assm->reltable.capacity * sizeof (*assm->reltable.data) );
+
+    if (!assm->reltable.data)
+        ASSM_ERR (ASSM_ERRSYSTEM, "Can't allocate relocations table");
+
+    for (size_t i = 0; i < pool->size; i++)
+    {
+        struct assm_reltable *reltable = &pool->chunk[i].assm.reltable;
+
+        for (size_t j = 0; j < reltable->size; j++)
+        {
+            const char *str = reltable->data[j].str;
+
+            assm->reltable.data[assm->reltable.size]         = reltable->data[j];
+            assm->reltable.data[assm->reltable.size].offset += pool->chunk[i].ip;
+
+            if (str < assm->text.buff || str >= assm->text.buff + assm->text.buffsize)
+            {
+                char *copy = arena_alloc (&assm->arena, reltable->data[j].size + 1);
+
+                if (!copy)
+                    ASSM_ERR (ASSM_ERRSYSTEM, "Can't allocate relocations table");
+
+                memcpy (copy, str, reltable->data[j].size);
+
+                assm->reltable.data[assm->reltable.size].str = copy;
+            }
+            assm->reltable.size++;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int index_build (assm_t *assm, struct assm_symindex *index, const void *table, size_t size,
+                        size_t elemsize, enum ASSM_ERRORS err)
+{
+    assert (assm);
+    assert (index);
+    assert (table);
+
+    size_t capacity = 2;
+
+    while (capacity < size * 2)
+        capacity *= 2;
+
+    index->slot = arena_alloc (&assm->arena, capacity * sizeof (*index->slot) );
+    index->mask = capacity - 1;
+
+    if (!index->slot)
+        ASSM_ERR (ASSM_ERRSYSTEM, "Can't allocate symbol index");
+
+    for (size_t i = 0; i < size; i++)
+    {
+        const char *name = (const char *) table + i * elemsize;
+        size_t      slot = text_hash (name, strlen (name) ) & index->mask;
+
+        while (index->slot[slot])
+        {
+            if (!strncmp ( (const char *) table + (index->slot[slot] - 1) * elemsize, name, STRSIZE) )
+            {
+                assm->text.word.str  = NULL;
+                assm->text.word.size = 0;
+                assm->text.word.line = 0;
+
+                assm_seterr (assm, err, __PRETTY_FUNCTION__, "Redefinition");
+                strncpy (assm->error.word, name, STRSIZE - 1);
+
+                return EXIT_FAILURE;
+            }
+
+            slot = (slot + 1) & index->mask;
+        }
+
+        index->slot[slot] = i + 1;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static size_t index_find (const struct assm_symindex *index, const void *table, size_t elemsize,
+                          const char *str, size_t size)
+{
+    assert (index);
+    assert (index->slot);
+    assert (table);
+    assert (str);
+
+    size_t slot = text_hash (str, size) & index->mask;
+
+    if (size >= STRSIZE)
+        return SIZE_MAX;
+
+    while (index->slot[slot])
+    {
+        const char *name = (const char *) table + (index->slot[slot] - 1) * elemsize;
+
+        if (!strncmp (name, str, size) && !name[size])
+            return index->slot[slot] - 1;
+
+        slot = (slot + 1) & index->mask;
+    }
+
+    return SIZE_MAX;
+}
+
+static size_t text_hash (const char *str, size_t size)
+{
+    assert (str);
+
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (uint8_t) str[i];
+        hash *= 0x100000001b3;
+    }
+
+    return (size_t) hash;
+}
+
+static void *arena_alloc (struct assm_arena *arena, size_t size)
+{
+    assert (arena);
+
+    struct assm_arenablk *blk = arena->blk;
+    void                 *ptr = NULL;
+
+    size = (size + 0x0F) & ~ (size_t) 0x0F;
+
+    if (!blk || blk->used + size > blk->size)
+    {
+        size_t blksize = (size > ASSM_ARENABLK) ? size : ASSM_ARENABLK;
+
+        blk = calloc (1, sizeof (*blk) + blksize);
+
+        if (!blk)
+            return NULL;
+
+        blk->size  = blksize;
+        blk->next  = arena->blk;
+        arena->blk = blk;
+    }
+
+    ptr        = (char *) (blk + 1) + blk->used;
+    blk->used += size;
+
+    return ptr;
+}
+
+static void arena_free (struct assm_arena *arena)
+{
+    assert (arena);
+
+    struct assm_arenablk *blk = arena->blk;
+
+    while (blk)
+    {
+        struct assm_arenablk *next = blk->next;
+
+        free (blk);
+
+        blk = next;
+    }
+
+    arena->blk = NULL;
+}
+
+static void text_rewind (assm_t *assm)
+{
+    assert (assm);
+    assert (assm->text.buff);
+
+    text_seek (assm, assm->text.buff, 1);
+}
+
+static void text_seek (assm_t *assm, const char *pos, size_t line)
+{
+    assert (assm);
+    assert (pos);
+
+    assm->text.pos       = pos;
+    assm->text.line      = line;
+    assm->text.linestart = pos;
+
+    while (assm->text.linestart > assm->text.buff &&
+           (assm->text.linestart[-1] == ' ' || assm->text.linestart[-1] == '\t') )
+        assm->text.linestart--;
+
+    text_next (assm);
+}
+
+static const char *text_unitend (const assm_t *assm, const char *pos)
+{
+    assert (assm);
+    assert (pos);
+
+    const char *end = assm->text.buff + assm->text.buffsize;
+
+    while (pos < end)
+    {
+        pos = memchr (pos, '\n', (size_t) (end - pos) );
+
+        if (!pos)
+            return end;
+
+        pos++;
+
+        while (pos < end && (*pos == ' ' || *pos == '\t') )
+            pos++;
+
+        if (end - pos > 4 && !strncmp (pos, "func", 4) && isspace ( (unsigned char) pos[4]) )
+            return pos;
+    }
+
+    return end;
+}
+
+static void text_next (assm_t *assm)
+{
+    assert (assm);
+    assert (assm->text.pos);
+
+    const char *pos = assm->text.pos;
+    const char *end = assm->text.buff + assm->text.buffsize;
+
+    while (pos < end && isspace ( (unsigned char) *pos) )
+    {
+        if (*pos == '\n')
+        {
+            assm->text.line++;
+            assm->text.linestart = pos + 1;
+        }
+
+        pos++;
+    }
+
+    assm->text.word.str  = pos;
+    assm->text.word.line = assm->text.line;
+    assm->text.word.col  = (size_t) (pos - assm->text.linestart) + 1;
+
+    while (pos < end && !isspace ( (unsigned char) *pos) )
+        pos++;
+
+    assm->text.word.size = (size_t) (pos - assm->text.word.str);
+    assm->text.pos       = pos;
+}
+
+static int text_equal (const struct assm_word *word, const char *str)
+{
+    assert (word);
+    assert (str);
+
+    return !strncmp (str, word->str, word->size) && !str[word->size];
+}
+
+static int word_handler (assm_t *assm)
+{
+    assert (assm);
+    assert (assm->text.word.str);
+
+    if (assm->text.word.size >= STRSIZE)
+        ASSM_ERR (ASSM_ERRWORD, "Too long");
+
+    return EXIT_SUCCESS;
+}
+
+static int assm_resize (assm_t *assm)
+{
+    assert (assm);
+    assert (assm->labeltable.data);
+    assert (assm->restable.data);
+    assert (assm->functable.data);
+
+    void *ptr = NULL;
+
+    if (assm->labeltable.size >= assm->labeltable.capacity)
+    {
+        ptr = arena_alloc (&assm->arena, assm->labeltable.capacity * 2 * sizeof (*assm->labeltable.data) );
+
+        if (!ptr)
+            ASSM_ERR (ASSM_ERRSYSTEM, "Can't resize labels table");
+
+        memcpy (ptr, assm->labeltable.data, assm->labeltable.size * sizeof (*assm->labeltable.data) );
+
+        assm->labeltable.capacity *= 2;
+        assm->labeltable.data      = ptr;
+    }
+
+    if (assm->restable.size >= assm->restable.capacity)
+    {
+        ptr = arena_alloc (&assm->arena, assm->restable.capacity * 2 * sizeof (*assm->restable.data) );
+
+        if (!ptr)
+            ASSM_ERR (ASSM_ERRSYSTEM, "Can't resize reserves table");
+
+        memcpy (ptr, assm->restable.data, assm->restable.size * sizeof (*assm->restable.data) );
+
+        assm->restable.capacity *= 2;
+        assm->restable.data      = ptr;
+    }
+
+    if (assm->functable.size >= assm->functable.capacity)
     {
-        *( (uint8_t *) (assm->code.data + assm->code.ip) )     = code | CMD_FLGREG;
-        *( (uint8_t *) (assm->code.data + assm->code.ip + 1) ) = arg.vu8;
+        ptr = arena_alloc (&assm->arena, assm->functable.capacity * 2 * sizeof (*assm->functable.data) );
+
+        if (!ptr)
+            ASSM_ERR (ASSM_ERRSYSTEM, "Can't resize functions table");
+
+        memcpy (ptr, assm->functable.data, assm->functable.size * sizeof (*assm->functable.data) );
+
+        assm->functable.capacity *= 2;
+        assm->functable.data      = ptr;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static const char *assm_strerror (enum ASSM_ERRORS err)
+{
+    switch (err)
+    {
+        case ASSM_NOERR:
+            return "No error";
+        case ASSM_ERRWORD:
+            return "Bad word";
+        case ASSM_ERRCOMMAND:
+            return "Unknown command";
+        case ASSM_ERRLABEL:
+            return "Bad label";
+        case ASSM_ERRRES:
+            return "Bad reserve";
+        case ASSM_ERRFUNC:
+            return "Bad function";
+        case ASSM_ERRARG:
+            return "Bad argument";
+        case ASSM_ERRSYSTEM:
+            return "System error";
+    }
+
+    return "Undefined error";
+}
+
+static int assm_lex (assm_t *assm, struct assm_token *tok)
+{
+    assert (assm);
+    assert (tok);
+    assert (assm->text.word.str);
+
+    const char *str      = assm->text.word.str;
+    size_t      size     = assm->text.word.size;
+    size_t      i        = 0;
+    uint64_t    value    = 0;
+    uint8_t     mem      = 0;
+    uint8_t     number   = 1;
+    uint8_t     alnum    = 1;
+    uint8_t     overflow = 0;
+
+    memset (tok, 0, sizeof (*tok) );
+
+    tok->line = assm->text.word.line;
+    tok->col  = assm->text.word.col;
+
+    if (size >= 2 && str[0] == '[' && str[size-1] == ']')
+    {
+        mem   = 1;
+        str  += 1;
+        size -= 2;
+    }
+
+    tok->str  = str;
+    tok->size = size;
+
+    if (!size)
+        return EXIT_SUCCESS;
+
+    if (str[0] == 'r' || str[0] == '-' || str[0] == '+')
+    {
+        alnum = (str[0] == 'r');
+        i     = 1;
+    }
+
+    if (i == size)
+        number = 0;
+
+    for (; i < size; i++)
+    {
+        if (isdigit ( (unsigned char) str[i]) )
+        {
+            if (value > (UINT64_MAX - (uint64_t) (str[i] - '0') ) / 10)
+                overflow = 1;
+
+            value = value * 10 + (uint64_t) (str[i] - '0');
+        }
+        else
+        {
+            number = 0;
+
+            if (!isalnum ( (unsigned char) str[i]) )
+                alnum = 0;
+        }
+    }
+
+    if (number && str[0] == 'r')
+    {
+        if (overflow || value >= PROC_REGCOUNT)
+            ASSM_ERR (ASSM_ERRARG, "Bad register");
+
+        tok->type    = mem ? ASSM_TOKMEMREG : ASSM_TOKREG;
+        tok->val.vu8 = (uint8_t) value;
+    }
+    else if (number)
+    {
+        if (overflow || value > (uint64_t) INT64_MAX + (str[0] == '-') )
+            ASSM_ERR (ASSM_ERRARG, "Too big number");
+
+        tok->type     = mem ? ASSM_TOKMEMINT : ASSM_TOKINT;
+        tok->val.vu64 = (str[0] == '-') ? -value : value;
+    }
+    else if (alnum)
+        tok->type = mem ? ASSM_TOKMEMSYM : ASSM_TOKSYM;
+
+    return EXIT_SUCCESS;
+}
+
+static int assm_symbol (assm_t *assm, enum OBJ_SYMTYPE type, struct assm_token *tok)
+{
+    assert (assm);
+    assert (tok);
+    assert (tok->str);
+
+    size_t id = SIZE_MAX;
 
-        assm->code.ip += 2;
-        assm->text.wordid++;
+    tok->full = assm->object || assm->cache.dir;
+
+    if (assm->passnum == ASSM_PASS1)
+    {
+        if (!tok->full && assm->parent)
+            assm_lookup (assm->parent, type, tok->str, tok->size, &tok->val.vu64);
 
         return EXIT_SUCCESS;
     }
 
-    ret = sscanf (word, "%ld%n", &arg.v64, &count);
+    id = assm_lookup (assm, type, tok->str, tok->size, &tok->val.vu64);
+
+    if (!assm->object && id == SIZE_MAX)
+        ASSM_ERR (ASSM_ERRARG, "Unknown name");
+
+    if (!tok->size || tok->size >= STRSIZE)
+        ASSM_ERR (ASSM_ERRARG, "Bad syntax");
+
+    for (size_t i = 0; i < tok->size; i++)
+        if (!isalnum ( (unsigned char) tok->str[i]) )
+            ASSM_ERR (ASSM_ERRARG, "Bad syntax");
+
+    return assm_reloc (assm, assm->code.ip + 2, type, tok->str, tok->size);
+}
+
+static size_t assm_lookup (const assm_t *assm, enum OBJ_SYMTYPE type, const char *str, size_t size,
+                           uint64_t *value)
+{
+    assert (assm);
+    assert (str);
+    assert (value);
+
+    size_t id = SIZE_MAX;
 
-    if (ret == 1 && count == len)
+    if (!assm->labeltable.index.slot || !assm->functable.index.slot || !assm->restable.index.slot)
+        return SIZE_MAX;
+
+    switch (type)
     {
-        *( (uint8_t *)  (assm->code.data + assm->code.ip) )     = code;
-        *( (int64_t  *) (assm->code.data + assm->code.ip + 1) ) = arg.v64;
+        case OBJ_SYMLABEL:
+            id = index_find (&assm->labeltable.index, assm->labeltable.data, sizeof (*assm->labeltable.data),
+                             str, size);
+            if (id != SIZE_MAX)
+                *value = assm->labeltable.data[id].ip;
+            break;
+        case OBJ_SYMFUNC:
+            id = index_find (&assm->functable.index, assm->functable.data, sizeof (*assm->functable.data),
+                             str, size);
+            if (id != SIZE_MAX)
+                *value = assm->functable.data[id].ip;
+            break;
+        case OBJ_SYMRES:
+            id = index_find (&assm->restable.index, assm->restable.data, sizeof (*assm->restable.data),
+                             str, size);
+            if (id != SIZE_MAX)
+                *value = assm->restable.data[id].addr;
+            break;
+    }
+
+    return id;
+}
 
-        assm->code.ip += 9;
-        assm->text.wordid++;
+static int assm_reloc (assm_t *assm, uint64_t offset, enum OBJ_SYMTYPE type, const char *str, size_t size)
+{
+    assert (assm);
+    assert (str);
 
+    if (!assm->object && !assm->cache.dir)
         return EXIT_SUCCESS;
+
+    if (assm->reltable.size >= assm->reltable.capacity)
+    {
+        size_t  capacity = assm->reltable.capacity ? assm->reltable.capacity * 2 : 0x10;
+        void   *ptr      = arena_alloc (&assm->arena, capacity * sizeof (*assm->reltable.data) );
+
+        if (!ptr)
+            ASSM_ERR (ASSM_ERRSYSTEM, "Can't resize relocations table");
+
+        if (assm->reltable.size)
+            memcpy (ptr, assm->reltable.data, assm->reltable.size * sizeof (*assm->reltable.data) );
+
+        assm->reltable.capacity = capacity;
+        assm->reltable.data     = ptr;
     }
 
-    ret = sscanf (word, "[%[a-zA-Z0-9]%c%n", name, &symbol, &count);
+    assm->reltable.data[assm->reltable.size].offset = offset;
+    assm->reltable.data[assm->reltable.size].type   = type;
+    assm->reltable.data[assm->reltable.size].str    = str;
+    assm->reltable.data[assm->reltable.size].size   = size;
 
-    if (ret == 2 && symbol == ']' && count == len)
-    {
-        for (size_t i = 0; i < assm->restable.size; i++)
-        {
-            assert (assm->restable.data[i].name);
+    assm->reltable.size++;
 
-            if (!strncmp (assm->restable.data[i].name, name, STRSIZE) )
-            {
-                *( (uint8_t *)  (assm->code.data + assm->code.ip) )     = code | CMD_FLGMEM;
-                *( (uint64_t *) (assm->code.data + assm->code.ip + 1) ) = assm->restable.data[i].addr;
+    return EXIT_SUCCESS;
+}
 
-                assm->code.ip += 9;
-                assm->text.wordid++;
+static void assm_emitreg (assm_t *assm, uint8_t code, uint8_t reg)
+{
+    assert (assm);
 
-                return EXIT_SUCCESS;
-            }
-        }
+    if (assm->passnum == ASSM_PASS2)
+    {
+        assert (assm->code.data);
+        assert (assm->code.ip + 2 <= assm->code.size);
 
-        ASSM_ERR (ASSM_ERRARG, "Unknown name");\
+        *( (uint8_t *) (assm->code.data + assm->code.ip) )     = code;
+        *( (uint8_t *) (assm->code.data + assm->code.ip + 1) ) = reg;
     }
 
-    ret = sscanf (word, "%[a-zA-Z0-9]%n", name, &count);
+    /* register-indirect access can reach any cell, so the program needs all of memory */
+    if (code & CMD_FLGMEM)
+        assm->memtop = PROC_MEMSIZE;
+
+    assm->code.ip += 2;
+}
+
+static size_t assm_argsize (const struct assm_token *tok)
+{
+    assert (tok);
+
+    int64_t value = tok->val.v64;
+
+    if (tok->full)
+        return 9;
+
+    if (value >= -0x20 && value < 0x20)
+        return 1;
+
+    if (value >= -0x2000 && value < 0x2000)
+        return 2;
+
+    if (value >= -0x20000000 && value < 0x20000000)
+        return 4;
+
+    return 9;
+}
+
+static void assm_emitval (assm_t *assm, uint8_t code, const struct assm_token *tok)
+{
+    assert (assm);
+    assert (tok);
 
-    if (ret == 1 && count == len)
+    size_t size = assm_argsize (tok);
+
+    if ( (code & CMD_FLGMEM) && tok->type == ASSM_TOKMEMINT && tok->val.vu64 >= assm->memtop)
+        assm->memtop = tok->val.vu64 + 1;
+
+    if (assm->passnum == ASSM_PASS2)
     {
-        for (size_t i = 0; i < assm->restable.size; i++)
-        {
-            assert (assm->restable.data[i].name);
+        void     *ptr   = assm->code.data + assm->code.ip + 1;
+        uint64_t  value = tok->val.vu64 << ARG_SHIFT;
 
-            if (!strncmp (assm->restable.data[i].name, name, STRSIZE) )
-            {
-                *( (uint8_t *)  (assm->code.data + assm->code.ip) )     = code;
-                *( (uint64_t *) (assm->code.data + assm->code.ip + 1) ) = assm->restable.data[i].addr;
+        assert (assm->code.data);
+        assert (assm->code.ip + 1 + size <= assm->code.size);
 
-                assm->code.ip += 9;
-                assm->text.wordid++;
+        *( (uint8_t *) (assm->code.data + assm->code.ip) ) = code;
 
-                return EXIT_SUCCESS;
-            }
+        switch (size)
+        {
+            case 1:
+                *( (uint8_t *)  ptr) = (uint8_t)  (value | ARG_CLS8);
+                break;
+            case 2:
+                *( (uint16_t *) ptr) = (uint16_t) (value | ARG_CLS16);
+                break;
+            case 4:
+                *( (uint32_t *) ptr) = (uint32_t) (value | ARG_CLS32);
+                break;
+            default:
+                *( (uint8_t *)  ptr)      = ARG_CLS64;
+                *( (uint64_t *) (ptr + 1) ) = tok->val.vu64;
+                break;
         }
-
-        ASSM_ERR (ASSM_ERRARG, "Unknown name");
     }
 
-    ASSM_ERR (ASSM_ERRARG, "Bad syntax");
+    assm->code.ip += 1 + size;
 }
 
-
-static int poptype_handler (assm_t *assm, enum PROC_CMDCODES code)
+static void assm_emitstd (assm_t *assm, uint8_t code)
 {
     assert (assm);
-    assert (!assm->error.err);
-    assert (assm->text.word);
-    assert (assm->text.wordid + 1 < assm->text.wordsize);
-    assert (assm->text.word[assm->text.wordid+1].str);
-    assert (assm->code.ip + 0x10 < assm->code.size);
-    assert (assm->code.data);
-    assert (assm->restable.data);
-    assert (assm->restable.size < assm->restable.capacity);
 
-    assm->text.wordid++;
+    if (assm->passnum == ASSM_PASS2)
+    {
+        assert (assm->code.data);
+        assert (assm->code.ip + 1 <= assm->code.size);
 
-    const char *word          = assm->text.word[assm->text.wordid].str;
-    int         len           = (int) assm->text.word[assm->text.wordid].size;
-    char        name[STRSIZE] = "";
-    char        symbol        = 0;
-    int         count         = 0;
-    int         ret           = 0;
-    union val   arg           = {};
+        *( (uint8_t *) (assm->code.data + assm->code.ip) ) = code;
+    }
 
-    ret = sscanf (word, "[r%hhu%c%n", &arg.vu8, &symbol, &count);
+    assm->code.ip += 1;
+}
 
-    if (ret == 2 && symbol == ']' && count == len)
-    {
-        *( (uint8_t *) (assm->code.data + assm->code.ip) )     = code | CMD_FLGREG | CMD_FLGMEM;
-        *( (uint8_t *) (assm->code.data + assm->code.ip + 1) ) = arg.vu8;
+static int label_handler (assm_t *assm)
+{
+    assert (assm);
+    assert (!assm->error.err);
+    assert (assm->labeltable.data);
+    text_next (assm);
 
-        assm->code.ip += 2;
-        assm->text.wordid++;
+    if (assm->passnum == ASSM_PASS2)
+    {
+        text_next (assm);
 
         return EXIT_SUCCESS;
     }
 
-    ret = sscanf (word, "[%lu%c%n", &arg.vu64, &symbol, &count);
+    assert (assm->labeltable.size < assm->labeltable.capacity);
+
+    const char *word = assm->text.word.str;
+    size_t       len = assm->text.word.size;
 
-    if (ret == 2 && symbol == ']' && count == len)
-    {
-        if (arg.vu64 >= PROC_MEMSIZE)
-            ASSM_ERR (ASSM_ERRARG, "Not enough memory");
+    if (!len || len >= STRSIZE)
+        ASSM_ERR (ASSM_ERRLABEL, "Bad syntax");
+
+    for (size_t i = 0; i < len; i++)
+        if (!isalnum ( (unsigned char) word[i]) )
+            ASSM_ERR (ASSM_ERRLABEL, "Bad syntax");
+
+    memcpy (assm->labeltable.data[assm->labeltable.size].name, word, len);
+    assm->labeltable.data[assm->labeltable.size].ip = assm->code.ip;
+
+    assm->labeltable.size++;
+
+    text_next (assm);
+
+    return EXIT_SUCCESS;
+}
 
-        *( (uint8_t *)  (assm->code.data + assm->code.ip) )     = code | CMD_FLGMEM;
-        *( (uint64_t *) (assm->code.data + assm->code.ip + 1) ) = arg.vu64;
+static int func_handler (assm_t *assm)
+{
+    assert (assm);
+    assert (!assm->error.err);
+    assert (assm->functable.data);
+    text_next (assm);
 
-        assm->code.ip += 9;
-        assm->text.wordid++;
+    if (assm->passnum == ASSM_PASS2)
+    {
+        text_next (assm);
 
         return EXIT_SUCCESS;
     }
 
-    ret = sscanf (word, "r%hhu%n", &arg.vu8, &count);
+    assert (assm->functable.size < assm->functable.capacity);
+
+    const char *word = assm->text.word.str;
+    size_t       len = assm->text.word.size;
+
+    if (!len || len >= STRSIZE)
+        ASSM_ERR (ASSM_ERRLABEL, "Bad syntax");
+
+    for (size_t i = 0; i < len; i++)
+        if (!isalnum ( (unsigned char) word[i]) )
+            ASSM_ERR (ASSM_ERRLABEL, "Bad syntax");
+
+    memcpy (assm->functable.data[assm->functable.size].name, word, len);
+    assm->functable.data[assm->functable.size].ip = assm->code.ip;
+
+    assm->functable.size++;
+
+    text_next (assm);
+
+    return EXIT_SUCCESS;
+}
+
+static int res_handler (assm_t *assm)
+{
+    assert (assm);
+    assert (!assm->error.err);
+    assert (assm->restable.data);
+    text_next (assm);
+
+    char      word[STRSIZE] = "";
+    char      name[STRSIZE] = "";
+    int          len        = (int) assm->text.word.size;
+    int        count        = 0;
+    int          ret        = 0;
+    char      symbol        = 0;
+    uint64_t   size         = 0;
+    uint64_t   addr         = assm->data.addr;
+
+    if (!len || len >= STRSIZE)
+        ASSM_ERR (ASSM_ERRRES, "Bad syntax");
+
+    memcpy (word, assm->text.word.str, (size_t) len);
+
+    ret = sscanf (word, "%[a-zA-Z0-9]%c%lu%n", name, &symbol, &size, &count);
+
+    if (ret != 3 || symbol != ':' || count != len)
+        ASSM_ERR (ASSM_ERRRES, "Bad syntax");
+
+    if (size == 0)
+        ASSM_ERR (ASSM_ERRRES, "Can't reserve 0 size");
+
+    if (size >= PROC_MEMSIZE || addr + size >= PROC_MEMSIZE)
+        ASSM_ERR (ASSM_ERRRES, "Not enough memory");
 
-    if (ret == 1 && count == len)
+    if (assm->passnum == ASSM_PASS1)
     {
-        *( (uint8_t *) (assm->code.data + assm->code.ip) )     = code | CMD_FLGREG;
-        *( (uint8_t *) (assm->code.data + assm->code.ip + 1) ) = arg.vu8;
+        assert (assm->restable.size < assm->restable.capacity);
 
-        assm->code.ip += 2;
-        assm->text.wordid++;
+        memcpy (assm->restable.data[assm->restable.size].name, name, STRSIZE);
+        assm->restable.data[assm->restable.size].addr = addr;
+        assm->restable.data[assm->restable.size].size = size;
 
-       return EXIT_SUCCESS;
+        assm->restable.size++;
     }
 
-    ret = sscanf (word, "[%[a-zA-Z0-9]%c%n", name, &symbol, &count);
+    assm->data.addr = addr + size;
+
+    text_next (assm);
 
-    if (ret == 2 && symbol == ']' && count == len)
+    if (!text_equal (&assm->text.word, "=") )
+        return EXIT_SUCCESS;
+
+    text_next (assm);
+
+    for (count = 0; (uint64_t) count < size && assm->text.word.size; count++)
     {
-        for (size_t i = 0; i < assm->restable.size; i++)
-        {
-            assert (assm->restable.data[i].name);
+        struct assm_token tok = {};
 
-            if (!strncmp (assm->restable.data[i].name, name, STRSIZE) )
-            {
-                *( (uint8_t *)  (assm->code.data + assm->code.ip) )     = code | CMD_FLGMEM;
-                *( (uint64_t *) (assm->code.data + assm->code.ip + 1) ) = assm->restable.data[i].addr;
+        if (assm_lex (assm, &tok) )
+            return EXIT_FAILURE;
 
-                assm->code.ip += 9;
-                assm->text.wordid++;
+        if (tok.type != ASSM_TOKINT)
+            break;
 
-                return EXIT_SUCCESS;
-            }
+        if (assm->passnum == ASSM_PASS2)
+        {
+            assert (assm->data.data);
+
+            assm->data.data[addr + (uint64_t) count] = tok.val;
         }
 
-        ASSM_ERR (ASSM_ERRARG, "Unknown name");
+        text_next (assm);
     }
 
-    *( (uint8_t *)  (assm->code.data + assm->code.ip) ) = code;
+    if (!count)
+        ASSM_ERR (ASSM_ERRRES, "Bad initializer");
 
-    assm->code.ip += 1;
+    if (assm->passnum == ASSM_PASS1 && addr + (uint64_t) count > assm->data.size)
+        assm->data.size = addr + (uint64_t) count;
 
     return EXIT_SUCCESS;
 }
 
-static int jmptype_handler (assm_t *assm, enum PROC_CMDCODES code)
+static int pushtype_handler (assm_t *assm, enum PROC_CMDCODES code)
 {
     assert (assm);
     assert (!assm->error.err);
-    assert (assm->text.word);
-    assert (assm->text.wordid + 1< assm->text.wordsize);
-    assert (assm->text.word[assm->text.wordid+1].str);
-    assert (assm->labeltable.data);
-    assert (assm->labeltable.size < assm->labeltable.capacity);
-    assert (assm->code.data);
-    assert (assm->code.ip + 0x10 < assm->code.size);
+    assert (assm->restable.data);
+
+    text_next (assm);
+
+    struct assm_token tok = {};
 
-    assm->text.wordid++;
+    if (assm_lex (assm, &tok) )
+        return EXIT_FAILURE;
 
-    for (size_t i = 0; i < assm->labeltable.size; i++)
+    switch (tok.type)
     {
-        assert (assm->labeltable.data[i].name);
+        case ASSM_TOKMEMREG:
+            assm_emitreg (assm, code | CMD_FLGREG | CMD_FLGMEM, tok.val.vu8);
+            break;
+        case ASSM_TOKREG:
+            assm_emitreg (assm, code | CMD_FLGREG, tok.val.vu8);
+            break;
+        case ASSM_TOKMEMINT:
+            if (tok.val.vu64 >= PROC_MEMSIZE)
+                ASSM_ERR (ASSM_ERRARG, "Not enough memory");
 
-        if (!strncmp (assm->labeltable.data[i].name, assm->text.word[assm->text.wordid].str, STRSIZE) )
-        {
-            *( (uint8_t  *) (assm->code.data + assm->code.ip)     ) = code;
-            *( (uint64_t *) (assm->code.data + assm->code.ip + 1) ) = assm->labeltable.data[i].ip;
+            assm_emitval (assm, code | CMD_FLGMEM, &tok);
+            break;
+        case ASSM_TOKINT:
+            assm_emitval (assm, code, &tok);
+            break;
+        case ASSM_TOKMEMSYM:
+            if (assm_symbol (assm, OBJ_SYMRES, &tok) )
+                return EXIT_FAILURE;
 
-            assm->code.ip += 9;
-            assm->text.wordid++;
+            assm_emitval (assm, code | CMD_FLGMEM, &tok);
+            break;
+        case ASSM_TOKSYM:
+            if (assm_symbol (assm, OBJ_SYMRES, &tok) )
+                return EXIT_FAILURE;
 
-            return EXIT_SUCCESS;
-        }
+            assm_emitval (assm, code, &tok);
+            break;
+        case ASSM_TOKBAD:
+        default:
+            ASSM_ERR (ASSM_ERRARG, "Bad syntax");
     }
 
-    if (assm->passnum == ASSM_PASS2)
-        ASSM_ERR (ASSM_ERRARG, "Unknown name");
-
-    assm->code.ip += 9;
-    assm->text.wordid++;
+    text_next (assm);
 
     return EXIT_SUCCESS;
 }
 
-static int calltype_handler (assm_t *assm, enum PROC_CMDCODES code)
+static int poptype_handler (assm_t *assm, enum PROC_CMDCODES code)
 {
     assert (assm);
     assert (!assm->error.err);
-    assert (assm->text.word);
-    assert (assm->text.wordid + 1< assm->text.wordsize);
-    assert (assm->text.word[assm->text.wordid+1].str);
-    assert (assm->functable.data);
-    assert (assm->functable.size < assm->functable.capacity);
-    assert (assm->code.data);
-    assert (assm->code.ip + 0x10 < assm->code.size);
+    assert (assm->restable.data);
+
+    text_next (assm);
 
-    assm->text.wordid++;
+    struct assm_token tok = {};
 
-    for (size_t i = 0; i < assm->functable.size; i++)
+    if (assm_lex (assm, &tok) )
+        return EXIT_FAILURE;
+
+    switch (tok.type)
     {
-        assert (assm->functable.data[i].name);
+        case ASSM_TOKMEMREG:
+            assm_emitreg (assm, code | CMD_FLGREG | CMD_FLGMEM, tok.val.vu8);
+            break;
+        case ASSM_TOKREG:
+            assm_emitreg (assm, code | CMD_FLGREG, tok.val.vu8);
+            break;
+        case ASSM_TOKMEMINT:
+            if (tok.val.vu64 >= PROC_MEMSIZE)
+                ASSM_ERR (ASSM_ERRARG, "Not enough memory");
 
-        if (!strncmp (assm->functable.data[i].name, assm->text.word[assm->text.wordid].str, STRSIZE) )
-        {
-            *( (uint8_t  *) (assm->code.data + assm->code.ip)     ) = code;
-            *( (uint64_t *) (assm->code.data + assm->code.ip + 1) ) = assm->functable.data[i].ip;
+            assm_emitval (assm, code | CMD_FLGMEM, &tok);
+            break;
+        case ASSM_TOKMEMSYM:
+            if (assm_symbol (assm, OBJ_SYMRES, &tok) )
+                return EXIT_FAILURE;
 
-            assm->code.ip += 9;
-            assm->text.wordid++;
+            assm_emitval (assm, code | CMD_FLGMEM, &tok);
+            break;
+        default:
+            assm_emitstd (assm, code);
 
             return EXIT_SUCCESS;
-        }
     }
 
-    if (assm->passnum == ASSM_PASS2)
-        ASSM_ERR (ASSM_ERRARG, "Unknown name");
+    text_next (assm);
+
+    return EXIT_SUCCESS;
+}
+
+static int jmptype_handler (assm_t *assm, enum PROC_CMDCODES code)
+{
+    assert (assm);
+    assert (!assm->error.err);
+
+    text_next (assm);
+
+    struct assm_token tok = {};
+
+    tok.str  = assm->text.word.str;
+    tok.size = assm->text.word.size;
+
+    if (assm_symbol (assm, OBJ_SYMLABEL, &tok) )
+        return EXIT_FAILURE;
+
+    assm_emitval (assm, code, &tok);
+    text_next (assm);
+
+    return EXIT_SUCCESS;
+}
+
+static int calltype_handler (assm_t *assm, enum PROC_CMDCODES code)
+{
+    assert (assm);
+    assert (!assm->error.err);
+
+    text_next (assm);
+
+    struct assm_token tok = {};
+
+    tok.str  = assm->text.word.str;
+    tok.size = assm->text.word.size;
+
+    if (assm_symbol (assm, OBJ_SYMFUNC, &tok) )
+        return EXIT_FAILURE;
 
-    assm->code.ip += 9;
-    assm->text.wordid++;
+    assm_emitval (assm, code, &tok);
+    text_next (assm);
 
     return EXIT_SUCCESS;
 }
@@ -888,13 +2288,78 @@ static int stdtype_handler (assm_t *assm, enum PROC_CMDCODES code)
 {
     assert (assm);
     assert (!assm->error.err);
-    assert (assm->code.data);
-    assert (assm->code.ip + 0x10 < assm->code.size);
 
-    *( (uint8_t *) (assm->code.data + assm->code.ip) ) = code;
+    assm_emitstd (assm, code);
+
+    text_next (assm);
+
+    return EXIT_SUCCESS;
+}
+
+static int chantype_handler (assm_t *assm, enum PROC_CMDCODES code)
+{
+    assert (assm);
+    assert (!assm->error.err);
+
+    text_next (assm);
+
+    struct assm_token tok = {};
+
+    if (assm_lex (assm, &tok) )
+        return EXIT_FAILURE;
+
+    switch (tok.type)
+    {
+        case ASSM_TOKREG:
+            assm_emitreg (assm, code | CMD_FLGREG, tok.val.vu8);
+            break;
+        case ASSM_TOKINT:
+            assm_emitval (assm, code, &tok);
+            break;
+        default:
+            ASSM_ERR (ASSM_ERRARG, "Bad channel");
+    }
+
+    text_next (assm);
+
+    return EXIT_SUCCESS;
+}
+
+static int atomtype_handler (assm_t *assm, enum PROC_CMDCODES code)
+{
+    assert (assm);
+    assert (!assm->error.err);
+    assert (assm->restable.data);
+
+    text_next (assm);
+
+    struct assm_token tok = {};
+
+    if (assm_lex (assm, &tok) )
+        return EXIT_FAILURE;
+
+    switch (tok.type)
+    {
+        case ASSM_TOKMEMREG:
+            assm_emitreg (assm, code | CMD_FLGREG | CMD_FLGMEM, tok.val.vu8);
+            break;
+        case ASSM_TOKMEMINT:
+            if (tok.val.vu64 >= PROC_MEMSIZE)
+                ASSM_ERR (ASSM_ERRARG, "Not enough memory");
+
+            assm_emitval (assm, code | CMD_FLGMEM, &tok);
+            break;
+        case ASSM_TOKMEMSYM:
+            if (assm_symbol (assm, OBJ_SYMRES, &tok) )
+                return EXIT_FAILURE;
+
+            assm_emitval (assm, code | CMD_FLGMEM, &tok);
+            break;
+        default:
+            ASSM_ERR (ASSM_ERRARG, "Memory operand expected");
+    }
 
-    assm->text.wordid += 1;
-    assm->code.ip     += 1;
+    text_next (assm);
 
     return EXIT_SUCCESS;
 }
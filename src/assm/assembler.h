@@ -2,11 +2,15 @@
 #define ASSEMBLER_H_INCLUDED
 
 #include "setup.h"
+#include "object.h"
 #include <stdlib.h>
 #include <stdio.h>
 
 #define STRSIZE 0x40
 
+#define ASSM_CACHEMAGIC   0x48434143
+#define ASSM_CACHEVERSION 0x04
+
 enum ASSM_ERRORS
 {
     ASSM_NOERR,
@@ -25,22 +29,59 @@ enum ASSM_PASSNUM
     ASSM_PASS2,
 };
     
+enum ASSM_TOKTYPE
+{
+    ASSM_TOKBAD,
+    ASSM_TOKINT,
+    ASSM_TOKREG,
+    ASSM_TOKSYM,
+    ASSM_TOKMEMINT,
+    ASSM_TOKMEMREG,
+    ASSM_TOKMEMSYM,
+};
+
 struct assm_word
 {
     const char *str;
     size_t      size;
+    size_t      line;
+    size_t      col;
+};
+
+struct assm_token
+{
+    enum ASSM_TOKTYPE  type;
+    union val          val;
+    const char        *str;
+    size_t             size;
+    size_t             line;
+    size_t             col;
+    uint8_t            full;
 };
 
 struct assm_text
 {
-    char             *buff;
+    const char       *buff;
     size_t            buffsize;
-    struct assm_word *word;
-    size_t            wordsize;
-    size_t            wordid;
+    const char       *pos;
+    size_t            line;
+    const char       *linestart;
+    struct assm_word  word;
     char              name[STRSIZE];
 };
 
+struct assm_arenablk
+{
+    struct assm_arenablk *next;
+    size_t                size;
+    size_t                used;
+};
+
+struct assm_arena
+{
+    struct assm_arenablk *blk;
+};
+
 struct assm_code
 {
     void     *data;
@@ -48,6 +89,19 @@ struct assm_code
     uint64_t  ip;
 };
 
+struct assm_data
+{
+    union val *data;
+    uint64_t   size;
+    uint64_t   addr;
+};
+
+struct assm_symindex
+{
+    size_t *slot;
+    size_t  mask;
+};
+
 struct assm_labeltable_elem
 {
     char     name[STRSIZE]; 
@@ -59,6 +113,7 @@ struct assm_labeltable
     struct assm_labeltable_elem *data;
     size_t                       capacity;
     size_t                       size;
+    struct assm_symindex         index;
 };
 
 struct assm_restable_elem
@@ -73,6 +128,7 @@ struct assm_restable
     struct assm_restable_elem *data;
     size_t                     capacity;
     size_t                     size;
+    struct assm_symindex       index;
 };
 
 struct assm_functable_elem
@@ -86,25 +142,97 @@ struct assm_functable
     struct assm_functable_elem *data;
     size_t                      capacity;
     size_t                      size;
+    struct assm_symindex        index;
+};
+
+struct assm_reltable_elem
+{
+    uint64_t          offset;
+    enum OBJ_SYMTYPE  type;
+    const char       *str;
+    size_t            size;
+};
+
+struct assm_reltable
+{
+    struct assm_reltable_elem *data;
+    size_t                     capacity;
+    size_t                     size;
+};
+
+struct assm_cachehdr
+{
+    uint32_t          magic;
+    uint32_t          version;
+    uint64_t          hash;
+    uint64_t          textsize;
+    struct obj_header obj;
+};
+
+struct assm_unit
+{
+    const char                 *str;
+    size_t                      size;
+    size_t                      line;
+    size_t                      lines;
+    uint64_t                    hash;
+    uint64_t                    ip;
+    uint64_t                    addr;
+    uint64_t                    datasize;
+    uint64_t                    memtop;
+    size_t                      label;
+    size_t                      func;
+    size_t                      res;
+    size_t                      rel;
+    const struct assm_cachehdr *entry;
+};
+
+struct assm_unittable
+{
+    struct assm_unit *data;
+    size_t            capacity;
+    size_t            size;
+};
+
+struct assm_cache
+{
+    const char             *dir;
+    struct assm_unittable   units;
+    struct assm_labeltable  labeltable;
+    struct assm_restable    restable;
+    struct assm_functable   functable;
+    size_t                  hits;
+    size_t                  misses;
 };
 
 struct assm_error
 {
     enum ASSM_ERRORS  err;
     const char       *func;
-    const char       *word;
+    char              word[STRSIZE];
     const char       *str;
+    size_t            line;
+    size_t            col;
 };
 
 typedef struct assembler
 {
+    const struct assembler   *parent;
     struct assm_text          text;
     struct assm_labeltable    labeltable;
     struct assm_restable      restable;
     struct assm_functable     functable;
+    struct assm_reltable      reltable;
     struct assm_code          code;
+    struct assm_data          data;
     struct assm_error         error;
+    struct assm_arena         arena;
+    struct assm_cache         cache;
     enum   ASSM_PASSNUM       passnum;
+    size_t                    threads;
+    uint8_t                   object;
+    uint64_t                  memtop;
+    uint64_t                  stksize;
     FILE                     *log;
 } assm_t;
 
@@ -1,11 +1,38 @@
 #include "assembler.h"
 #include <stdio.h>
+#include <unistd.h>
 
 int main (int argc, char **argv)
 {
-    if (argc != 2)
+    size_t      threads = 0;
+    uint8_t     object  = 0;
+    const char *cache   = NULL;
+    uint64_t    stack   = 0;
+    int         opt     = 0;
+
+    while ( (opt = getopt (argc, argv, "cC:j:s:") ) != -1)
+        switch (opt)
+        {
+            case 'c':
+                object = 1;
+                break;
+            case 'C':
+                cache = optarg;
+                break;
+            case 'j':
+                threads = strtoul (optarg, NULL, 0);
+                break;
+            case 's':
+                stack = strtoull (optarg, NULL, 0);
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+
+    if (optind != argc - 1 || stack > PROC_STKSIZE)
     {
-        fprintf (stderr, "Usage: %s <name of file>\n", argv[0]);
+        fprintf (stderr, "Usage: %s [-c] [-C cache] [-j threads] [-s stack] <name of file>\n", argv[0]);
         return EXIT_FAILURE;
     }
 
@@ -13,15 +40,23 @@ int main (int argc, char **argv)
 
     do
     {
-        if (assm_create (&assm, argv[1]) )
+        if (assm_create (&assm, argv[optind]) )
             break;
 
+        assm.threads   = threads;
+        assm.object    = object;
+        assm.cache.dir = cache;
+        assm.stksize   = stack;
+
         if (assm_translate (&assm) )
             break;
 
         if (assm_write (&assm) ) 
             break;
 
+        if (cache)
+            printf ("Cache: %zu hits, %zu misses\n", assm.cache.hits, assm.cache.misses);
+
         assm_delete (&assm);
 
         return EXIT_SUCCESS;
@@ -0,0 +1,228 @@
+#include "image.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static uint64_t    img_place  (struct img_section *table, size_t count);
+static int         img_emit   (FILE *stream, const void *header, size_t hdrsize,
+                               const struct img_section *table, const void *const *section, size_t count);
+static const char *img_layout (const struct img_section *table, size_t count, uint64_t size);
+static uint64_t    img_align  (uint64_t size);
+static int         img_pad    (FILE *stream, uint64_t size);
+
+int img_write (FILE *stream, const struct img_desc *desc)
+{
+    assert (stream);
+    assert (desc);
+
+    struct img_header  header                = {};
+    const void        *section[IMG_SECCOUNT] = {desc->code, desc->data, desc->sym};
+
+    header.magic   = IMG_MAGIC;
+    header.version = IMG_VERSION;
+    header.entry   = desc->entry;
+    header.memsize = desc->memsize;
+    header.stksize = desc->stksize;
+
+    header.section[IMG_SECCODE].size   = desc->codesize;
+    header.section[IMG_SECDATA].size   = desc->datasize;
+    header.section[IMG_SECSYMTAB].size = desc->symcount * sizeof (*desc->sym);
+
+    img_place (header.section, IMG_SECCOUNT);
+
+    return img_emit (stream, &header, sizeof (header), header.section, section, IMG_SECCOUNT);
+}
+
+/* smallest power of two memory covering cells below top, at least one page */
+uint64_t img_memsize (uint64_t top)
+{
+    uint64_t size = IMG_PAGESIZE / sizeof (union val);
+
+    while (size < top && size < PROC_MEMSIZE)
+        size *= 2;
+
+    return size;
+}
+
+const char *img_check (const struct img_header *header, uint64_t size)
+{
+    assert (header);
+
+    const char *errstr = NULL;
+
+    if (size < sizeof (*header) || header->magic != IMG_MAGIC)
+        return "Not a program image";
+
+    if (header->version != IMG_VERSION)
+        return "Unsupported image version";
+
+    if (!header->memsize || header->memsize > PROC_MEMSIZE || (header->memsize & (header->memsize - 1) ) )
+        return "Bad memory size";
+
+    if (!header->stksize || header->stksize > PROC_STKSIZE)
+        return "Bad stack size";
+
+    if ( (errstr = img_layout (header->section, IMG_SECCOUNT, size) ) )
+        return errstr;
+
+    if (header->entry >= header->section[IMG_SECCODE].size)
+        return "Bad entry point";
+
+    if (header->section[IMG_SECDATA].size % sizeof (union val) ||
+        header->section[IMG_SECDATA].size / sizeof (union val) > header->memsize)
+        return "Bad data section";
+
+    if (header->section[IMG_SECSYMTAB].size % sizeof (struct obj_sym) )
+        return "Bad symbol table";
+
+    return NULL;
+}
+
+int snap_write (FILE *stream, struct snap_header *header, const void *const *section)
+{
+    assert (stream);
+    assert (header);
+    assert (section);
+
+    snap_layout (header);
+
+    return img_emit (stream, header, sizeof (*header), header->section, section, SNAP_SECCOUNT);
+}
+
+uint64_t snap_layout (struct snap_header *header)
+{
+    assert (header);
+
+    header->magic   = SNAP_MAGIC;
+    header->version = SNAP_VERSION;
+
+    header->section[SNAP_SECMEM].size    = header->memsize * sizeof (union val);
+    header->section[SNAP_SECSTKINT].size = header->stksize * sizeof (int64_t);
+    header->section[SNAP_SECSTKRET].size = header->stksize * sizeof (uint64_t);
+
+    return img_place (header->section, SNAP_SECCOUNT);
+}
+
+const char *snap_check (const struct snap_header *header, uint64_t size)
+{
+    assert (header);
+
+    const char *errstr = NULL;
+
+    if (size < sizeof (*header) || header->magic != SNAP_MAGIC)
+        return "Not a snapshot";
+
+    if (header->version != SNAP_VERSION)
+        return "Unsupported snapshot version";
+
+    if (!header->memsize || header->memsize > PROC_MEMSIZE || (header->memsize & (header->memsize - 1) ) )
+        return "Bad memory size";
+
+    if (!header->stksize || header->stksize > PROC_STKSIZE)
+        return "Bad stack size";
+
+    if ( (errstr = img_layout (header->section, SNAP_SECCOUNT, size) ) )
+        return errstr;
+
+    if (!header->section[SNAP_SECCODE].size || header->ip > header->section[SNAP_SECCODE].size)
+        return "Bad instruction pointer";
+
+    if (header->section[SNAP_SECSYMTAB].size % sizeof (struct obj_sym) )
+        return "Bad symbol table";
+
+    if (header->section[SNAP_SECMEM].size != header->memsize * sizeof (union val) )
+        return "Bad memory section";
+
+    if (header->section[SNAP_SECSTKINT].size != header->stksize * sizeof (int64_t) ||
+        header->section[SNAP_SECSTKRET].size != header->stksize * sizeof (uint64_t) ||
+        header->spint > header->stksize || header->spret > header->stksize)
+        return "Bad stack section";
+
+    return NULL;
+}
+
+static uint64_t img_place (struct img_section *table, size_t count)
+{
+    assert (table);
+
+    uint64_t offset = IMG_PAGESIZE;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        table[i].offset = offset;
+
+        offset += img_align (table[i].size);
+    }
+
+    return offset;
+}
+
+static int img_emit (FILE *stream, const void *header, size_t hdrsize,
+                     const struct img_section *table, const void *const *section, size_t count)
+{
+    assert (stream);
+    assert (header);
+    assert (table);
+    assert (section);
+    assert (hdrsize <= IMG_PAGESIZE);
+
+    if (fwrite (header, hdrsize, 1, stream) != 1)
+        return EXIT_FAILURE;
+
+    if (img_pad (stream, IMG_PAGESIZE - hdrsize) )
+        return EXIT_FAILURE;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!table[i].size)
+            continue;
+
+        if (fwrite (section[i], 1, table[i].size, stream) != table[i].size)
+            return EXIT_FAILURE;
+
+        if (i + 1 < count && img_pad (stream, img_align (table[i].size) - table[i].size) )
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static const char *img_layout (const struct img_section *table, size_t count, uint64_t size)
+{
+    assert (table);
+
+    uint64_t end = IMG_PAGESIZE;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (table[i].offset % IMG_PAGESIZE || table[i].offset < end)
+            return "Misplaced section";
+
+        if (table[i].offset > size || table[i].size > size - table[i].offset)
+            return "Truncated section";
+
+        end = table[i].offset + table[i].size;
+    }
+
+    return NULL;
+}
+
+static uint64_t img_align (uint64_t size)
+{
+    return (size + IMG_PAGESIZE - 1) & ~ (uint64_t) (IMG_PAGESIZE - 1);
+}
+
+static int img_pad (FILE *stream, uint64_t size)
+{
+    assert (stream);
+
+    static const char zero[IMG_PAGESIZE] = "";
+
+    assert (size <= IMG_PAGESIZE);
+
+    if (fwrite (zero, 1, size, stream) != size)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
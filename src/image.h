@@ -0,0 +1,85 @@
+#ifndef IMAGE_H_INCLUDED
+#define IMAGE_H_INCLUDED
+
+#include "setup.h"
+#include "object.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define IMG_MAGIC    0x474d4950
+#define IMG_VERSION  0x02
+#define IMG_PAGESIZE 0x1000
+
+#define SNAP_MAGIC   0x50414e53
+#define SNAP_VERSION 0x01
+
+enum IMG_SECTIONS
+{
+    IMG_SECCODE,
+    IMG_SECDATA,
+    IMG_SECSYMTAB,
+    IMG_SECCOUNT,
+};
+
+enum SNAP_SECTIONS
+{
+    SNAP_SECCODE,
+    SNAP_SECSYMTAB,
+    SNAP_SECMEM,
+    SNAP_SECSTKINT,
+    SNAP_SECSTKRET,
+    SNAP_SECCOUNT,
+};
+
+struct img_section
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct img_header
+{
+    uint32_t           magic;
+    uint32_t           version;
+    uint64_t           entry;
+    uint64_t           memsize;
+    uint64_t           stksize;
+    struct img_section section[IMG_SECCOUNT];
+};
+
+struct snap_header
+{
+    uint32_t           magic;
+    uint32_t           version;
+    uint64_t           ip;
+    uint64_t           cmp;
+    uint64_t           spint;
+    uint64_t           spret;
+    uint64_t           memsize;
+    uint64_t           stksize;
+    union val          regs[PROC_REGCOUNT];
+    struct img_section section[SNAP_SECCOUNT];
+};
+
+struct img_desc
+{
+    const void           *code;
+    uint64_t              codesize;
+    const void           *data;
+    uint64_t              datasize;
+    const struct obj_sym *sym;
+    uint64_t              symcount;
+    uint64_t              entry;
+    uint64_t              memsize;
+    uint64_t              stksize;
+};
+
+int         img_write   (FILE *stream, const struct img_desc *desc);
+const char *img_check   (const struct img_header *header, uint64_t size);
+uint64_t    img_memsize (uint64_t top);
+
+int         snap_write  (FILE *stream, struct snap_header *header, const void *const *section);
+uint64_t    snap_layout (struct snap_header *header);
+const char *snap_check  (const struct snap_header *header, uint64_t size);
+
+#endif
@@ -0,0 +1,584 @@
+#include "setup.h"
+#include "linker.h"
+#include "image.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define LINK_MAXTHREADS 0x40
+
+#define LINK_ERR(link, errcode, errobj, errsym, errstr)\
+    do\
+    {\
+        link_seterr (&(link)->error, errcode, __PRETTY_FUNCTION__, errobj, errsym, errstr);\
+        return EXIT_FAILURE;\
+    }\
+    while (0)
+
+static void        link_seterr   (struct link_error *error, enum LINK_ERRORS err, const char *func,
+                                  const char *obj, const char *sym, const char *str);
+static const char *link_strerror (enum LINK_ERRORS err);
+
+static int   link_image    (link_t *link, FILE *stream);
+static int   link_entry    (link_t *link);
+static int   link_parallel (link_t *link, void *(*worker) (void *) );
+static void *link_loader   (void *arg);
+static void *link_patcher  (void *arg);
+
+static int    obj_load   (struct link_obj *obj);
+static int    obj_patch  (link_t *link, struct link_obj *obj);
+static size_t sym_hash   (const struct obj_sym *sym);
+static int    sym_insert (link_t *link, size_t objid, size_t symid);
+static int    sym_find   (link_t *link, const struct obj_sym *sym, uint64_t *value);
+
+int link_create (link_t *link, size_t size, char **names)
+{
+    assert (link);
+    assert (names);
+
+    link->obj  = calloc (size, sizeof (*link->obj) );
+    link->size = size;
+
+    if (!link->obj)
+    {
+        link->size = 0;
+        LINK_ERR (link, LINK_ERRSYSTEM, NULL, NULL, strerror (errno) );
+    }
+
+    for (size_t i = 0; i < size; i++)
+        link->obj[i].name = names[i];
+
+    if (!link->threads)
+    {
+        long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+        link->threads = (cpus > 0) ? (size_t) cpus : 1;
+    }
+
+    if (link->threads > LINK_MAXTHREADS)
+        link->threads = LINK_MAXTHREADS;
+
+    return link_parallel (link, link_loader);
+}
+
+void link_delete (link_t *link)
+{
+    assert (link);
+
+    for (size_t i = 0; i < link->size; i++)
+    {
+        free (link->obj[i].header);
+        free (link->obj[i].code);
+        free (link->obj[i].data);
+        free (link->obj[i].sym);
+        free (link->obj[i].rel);
+    }
+
+    free (link->obj);
+    free (link->symtable.slot);
+    free (link->symtable.obj);
+    free (link->code.data);
+    free (link->data.data);
+
+    memset (link, 0, sizeof (*link) );
+}
+
+int link_resolve (link_t *link)
+{
+    assert (link);
+
+    if (link->error.err)
+        return EXIT_FAILURE;
+
+    size_t count    = 0;
+    size_t capacity = 2;
+
+    for (size_t i = 0; i < link->size; i++)
+    {
+        link->obj[i].ip   = link->code.size;
+        link->obj[i].addr = link->ressize;
+
+        link->code.size += link->obj[i].header->codesize;
+        link->ressize   += link->obj[i].header->ressize;
+
+        if (link->obj[i].header->datasize)
+            link->data.size = link->obj[i].addr + link->obj[i].header->datasize / sizeof (*link->data.data);
+
+        if (link->ressize >= PROC_MEMSIZE)
+            LINK_ERR (link, LINK_ERRMEM, link->obj[i].name, NULL, "Reserves don't fit into memory");
+
+        if (link->obj[i].header->memtop > link->memtop)
+            link->memtop = link->obj[i].header->memtop;
+
+        count += link->obj[i].header->symcount;
+    }
+
+    while (capacity < count * 2)
+        capacity *= 2;
+
+    link->symtable.slot = calloc (capacity, sizeof (*link->symtable.slot) );
+    link->symtable.obj  = calloc (capacity, sizeof (*link->symtable.obj) );
+    link->symtable.mask = capacity - 1;
+    link->code.data     = calloc (1, link->code.size + 1);
+    link->data.data     = calloc (link->data.size + 1, sizeof (*link->data.data) );
+
+    if (!link->symtable.slot || !link->symtable.obj || !link->code.data || !link->data.data)
+        LINK_ERR (link, LINK_ERRSYSTEM, NULL, NULL, strerror (errno) );
+
+    for (size_t i = 0; i < link->size; i++)
+        for (size_t j = 0; j < link->obj[i].header->symcount; j++)
+            if (link->obj[i].sym[j].flags & OBJ_SYMDEF)
+                if (sym_insert (link, i, j) )
+                    return EXIT_FAILURE;
+
+    if (link_entry (link) )
+        return EXIT_FAILURE;
+
+    return link_parallel (link, link_patcher);
+}
+
+int link_write (link_t *link, const char *name)
+{
+    assert (link);
+
+    if (link->error.err)
+        return EXIT_FAILURE;
+
+    char  buff[STRSIZE] = "";
+    char *errstr        = NULL;
+    FILE *stream        = NULL;
+    char *ptr           = NULL;
+
+    if (!name)
+    {
+        strncpy (buff, link->obj[0].name, STRSIZE - 1);
+
+        ptr = strchr (buff, '.');
+
+        if (ptr)
+            *ptr = '\0';
+
+        strncat (buff, ".proc", STRSIZE - strlen (buff) - 1);
+
+        name = buff;
+    }
+
+    do
+    {
+        errno  = 0;
+
+        stream = fopen (name, "w");
+
+        if (!stream)
+            break;
+
+        if (link_image (link, stream) )
+        {
+            errstr = "Can't write data to file";
+            break;
+        }
+
+        if (fclose (stream) == EOF)
+            break;
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    if (!errstr)
+        errstr = strerror (errno);
+
+    if (stream)
+        fclose (stream);
+
+    LINK_ERR (link, LINK_ERRSYSTEM, name, NULL, errstr);
+}
+
+static int link_image (link_t *link, FILE *stream)
+{
+    assert (link);
+    assert (stream);
+
+    struct img_desc  desc  = {};
+    struct obj_sym  *sym   = NULL;
+    size_t           count = 0;
+    int              ret   = EXIT_FAILURE;
+
+    for (size_t i = 0; i < link->size; i++)
+        count += link->obj[i].header->symcount;
+
+    sym = calloc (count + 1, sizeof (*sym) );
+
+    if (!sym)
+        return EXIT_FAILURE;
+
+    count = 0;
+
+    for (size_t i = 0; i < link->size; i++)
+        for (size_t j = 0; j < link->obj[i].header->symcount; j++)
+        {
+            if (!(link->obj[i].sym[j].flags & OBJ_SYMDEF) )
+                continue;
+
+            sym[count]        = link->obj[i].sym[j];
+            sym[count].value += (sym[count].type == OBJ_SYMRES) ? link->obj[i].addr : link->obj[i].ip;
+
+            count++;
+        }
+
+    desc.code     = link->code.data;
+    desc.codesize = link->code.size;
+    desc.data     = link->data.data;
+    desc.datasize = link->data.size * sizeof (*link->data.data);
+    desc.sym      = sym;
+    desc.symcount = count;
+    desc.entry    = link->entryip;
+    desc.memsize  = img_memsize ( (link->memtop > link->ressize) ? link->memtop : link->ressize);
+    desc.stksize  = link->stksize ? link->stksize : PROC_STKSIZE;
+
+    ret = img_write (stream, &desc);
+
+    free (sym);
+
+    return ret;
+}
+
+/* a lone object may start at its first command, several objects need an entry symbol */
+static int link_entry (link_t *link)
+{
+    assert (link);
+
+    struct obj_sym sym = {};
+
+    strncpy (sym.name, link->entry ? link->entry : LINK_ENTRY, OBJ_NAMESIZE - 1);
+
+    sym.type = OBJ_SYMFUNC;
+
+    if (!sym_find (link, &sym, &link->entryip) )
+        return EXIT_SUCCESS;
+
+    sym.type = OBJ_SYMLABEL;
+
+    if (!sym_find (link, &sym, &link->entryip) )
+        return EXIT_SUCCESS;
+
+    link->entryip = 0;
+
+    if (link->entry)
+        LINK_ERR (link, LINK_ERRUNDEF, NULL, sym.name, "entry point");
+
+    if (link->size > 1)
+        LINK_ERR (link, LINK_ERRUNDEF, NULL, sym.name, "entry point is required to link several objects");
+
+    return EXIT_SUCCESS;
+}
+
+void link_error (link_t *link)
+{
+    assert (link);
+
+    fprintf (stderr, "ERROR: ");
+
+    if (link->error.obj)
+        fprintf (stderr, "%s: ", link->error.obj);
+
+    if (link->error.func)
+        fprintf (stderr, "%s: ", link->error.func);
+
+    fprintf (stderr, "%s", link_strerror (link->error.err) );
+
+    if (*link->error.sym)
+        fprintf (stderr, ": \"%s\"", link->error.sym);
+
+    if (link->error.str)
+        fprintf (stderr, ": %s", link->error.str);
+
+    fprintf (stderr, "\n");
+}
+
+static void link_seterr (struct link_error *error, enum LINK_ERRORS err, const char *func,
+                         const char *obj, const char *sym, const char *str)
+{
+    assert (error);
+
+    error->err  = err;
+    error->func = func;
+    error->obj  = obj;
+    error->str  = str;
+
+    if (sym)
+        strncpy (error->sym, sym, STRSIZE - 1);
+}
+
+static const char *link_strerror (enum LINK_ERRORS err)
+{
+    switch (err)
+    {
+        case LINK_NOERR:
+            return "No error";
+        case LINK_ERRFORMAT:
+            return "Bad object file";
+        case LINK_ERRUNDEF:
+            return "Undefined symbol";
+        case LINK_ERRREDEF:
+            return "Redefinition";
+        case LINK_ERRMEM:
+            return "Not enough memory";
+        case LINK_ERRSYSTEM:
+            return "System error";
+    }
+
+    return "Undefined error";
+}
+
+static int link_parallel (link_t *link, void *(*worker) (void *) )
+{
+    assert (link);
+    assert (worker);
+
+    pthread_t thread[LINK_MAXTHREADS] = {};
+    size_t    count                   = (link->threads < link->size) ? link->threads : link->size;
+
+    link->next = 0;
+
+    for (size_t i = 1; i < count; i++)
+        if (pthread_create (&thread[i], NULL, worker, link) )
+        {
+            count = i;
+            break;
+        }
+
+    worker (link);
+
+    for (size_t i = 1; i < count; i++)
+        pthread_join (thread[i], NULL);
+
+    for (size_t i = 0; i < link->size; i++)
+        if (link->obj[i].error.err)
+        {
+            link->error = link->obj[i].error;
+
+            return EXIT_FAILURE;
+        }
+
+    return EXIT_SUCCESS;
+}
+
+static void *link_loader (void *arg)
+{
+    assert (arg);
+
+    link_t *link = arg;
+    size_t  id   = 0;
+
+    while ( (id = __atomic_fetch_add (&link->next, 1, __ATOMIC_RELAXED) ) < link->size)
+        obj_load (&link->obj[id]);
+
+    return NULL;
+}
+
+static void *link_patcher (void *arg)
+{
+    assert (arg);
+
+    link_t *link = arg;
+    size_t  id   = 0;
+
+    while ( (id = __atomic_fetch_add (&link->next, 1, __ATOMIC_RELAXED) ) < link->size)
+        obj_patch (link, &link->obj[id]);
+
+    return NULL;
+}
+
+static int obj_load (struct link_obj *obj)
+{
+    assert (obj);
+    assert (obj->name);
+
+    FILE              *stream = NULL;
+    char              *errstr = NULL;
+    struct obj_header *header = NULL;
+
+    do
+    {
+        errno = 0;
+
+        stream = fopen (obj->name, "r");
+
+        if (!stream)
+            break;
+
+        obj->header = header = calloc (1, sizeof (*header) );
+
+        if (!header)
+            break;
+
+        if (fread (header, sizeof (*header), 1, stream) != 1 ||
+            header->magic != OBJ_MAGIC || header->version != OBJ_VERSION)
+        {
+            errstr = "Bad header";
+            break;
+        }
+
+        if (header->codesize >= (SIZE_MAX >> 1) ||
+            header->ressize  >= PROC_MEMSIZE ||
+            header->memtop   >  PROC_MEMSIZE ||
+            header->datasize % sizeof (*obj->data) ||
+            header->datasize / sizeof (*obj->data) > header->ressize ||
+            header->symcount >= (SIZE_MAX >> 1) / sizeof (*obj->sym) ||
+            header->relcount >= (SIZE_MAX >> 1) / sizeof (*obj->rel) )
+        {
+            errstr = "Bad sizes";
+            break;
+        }
+
+        obj->code = calloc (1, header->codesize + 1);
+        obj->data = calloc (1, header->datasize + 1);
+        obj->sym  = calloc (header->symcount + 1, sizeof (*obj->sym) );
+        obj->rel  = calloc (header->relcount + 1, sizeof (*obj->rel) );
+
+        if (!obj->code || !obj->data || !obj->sym || !obj->rel)
+            break;
+
+        if (fread (obj->code, 1, header->codesize, stream) != header->codesize       ||
+            fread (obj->data, 1, header->datasize, stream) != header->datasize       ||
+            fread (obj->sym, sizeof (*obj->sym), header->symcount, stream) != header->symcount ||
+            fread (obj->rel, sizeof (*obj->rel), header->relcount, stream) != header->relcount)
+        {
+            errstr = "Truncated file";
+            break;
+        }
+
+        if (fgetc (stream) != EOF)
+        {
+            errstr = "Trailing data";
+            break;
+        }
+
+        for (size_t i = 0; !errstr && i < header->symcount; i++)
+            if (obj->sym[i].type > OBJ_SYMRES || obj->sym[i].name[OBJ_NAMESIZE-1])
+                errstr = "Bad symbol";
+
+        for (size_t i = 0; !errstr && i < header->relcount; i++)
+            if (obj->rel[i].sym >= header->symcount ||
+                obj->rel[i].offset > header->codesize ||
+                header->codesize - obj->rel[i].offset < sizeof (uint64_t) )
+                errstr = "Bad relocation";
+
+        if (errstr)
+            break;
+
+        fclose (stream);
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    if (stream)
+        fclose (stream);
+
+    link_seterr (&obj->error, errstr ? LINK_ERRFORMAT : LINK_ERRSYSTEM, __PRETTY_FUNCTION__,
+                 obj->name, NULL, errstr ? errstr : strerror (errno) );
+
+    return EXIT_FAILURE;
+}
+
+static int obj_patch (link_t *link, struct link_obj *obj)
+{
+    assert (link);
+    assert (obj);
+
+    uint8_t *code = (uint8_t *) link->code.data + obj->ip;
+
+    memcpy (code, obj->code, obj->header->codesize);
+    memcpy (link->data.data + obj->addr, obj->data, obj->header->datasize);
+
+    for (size_t i = 0; i < obj->header->relcount; i++)
+    {
+        const struct obj_sym *sym   = &obj->sym[obj->rel[i].sym];
+        uint64_t              value = sym->value;
+
+        if (sym->flags & OBJ_SYMDEF)
+            value += (sym->type == OBJ_SYMRES) ? obj->addr : obj->ip;
+        else if (sym_find (link, sym, &value) )
+        {
+            link_seterr (&obj->error, LINK_ERRUNDEF, __PRETTY_FUNCTION__, obj->name, sym->name, NULL);
+
+            return EXIT_FAILURE;
+        }
+
+        memcpy (code + obj->rel[i].offset, &value, sizeof (value) );
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static size_t sym_hash (const struct obj_sym *sym)
+{
+    assert (sym);
+
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t i = 0; i < OBJ_NAMESIZE && sym->name[i]; i++)
+    {
+        hash ^= (uint8_t) sym->name[i];
+        hash *= 0x100000001b3;
+    }
+
+    return (size_t) (hash + sym->type);
+}
+
+static int sym_insert (link_t *link, size_t objid, size_t symid)
+{
+    assert (link);
+    assert (link->symtable.slot);
+
+    const struct obj_sym *sym  = &link->obj[objid].sym[symid];
+    size_t                slot = sym_hash (sym) & link->symtable.mask;
+
+    while (link->symtable.slot[slot])
+    {
+        const struct obj_sym *other = &link->obj[link->symtable.obj[slot]].sym[link->symtable.slot[slot] - 1];
+
+        if (other->type == sym->type && !strncmp (other->name, sym->name, OBJ_NAMESIZE) )
+            LINK_ERR (link, LINK_ERRREDEF, link->obj[objid].name, sym->name, link->obj[link->symtable.obj[slot]].name);
+
+        slot = (slot + 1) & link->symtable.mask;
+    }
+
+    link->symtable.slot[slot] = symid + 1;
+    link->symtable.obj[slot]  = objid;
+
+    return EXIT_SUCCESS;
+}
+
+static int sym_find (link_t *link, const struct obj_sym *sym, uint64_t *value)
+{
+    assert (link);
+    assert (sym);
+    assert (value);
+
+    size_t slot = sym_hash (sym) & link->symtable.mask;
+
+    while (link->symtable.slot[slot])
+    {
+        const struct link_obj *obj   = &link->obj[link->symtable.obj[slot]];
+        const struct obj_sym  *other = &obj->sym[link->symtable.slot[slot] - 1];
+
+        if (other->type == sym->type && !strncmp (other->name, sym->name, OBJ_NAMESIZE) )
+        {
+            *value = other->value + ( (other->type == OBJ_SYMRES) ? obj->addr : obj->ip);
+
+            return EXIT_SUCCESS;
+        }
+
+        slot = (slot + 1) & link->symtable.mask;
+    }
+
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,87 @@
+#ifndef LINKER_H_INCLUDED
+#define LINKER_H_INCLUDED
+
+#include "setup.h"
+#include "object.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#define STRSIZE 0x40
+
+#define LINK_ENTRY "main"
+
+enum LINK_ERRORS
+{
+    LINK_NOERR,
+    LINK_ERRFORMAT,
+    LINK_ERRUNDEF,
+    LINK_ERRREDEF,
+    LINK_ERRMEM,
+    LINK_ERRSYSTEM,
+};
+
+struct link_error
+{
+    enum LINK_ERRORS  err;
+    const char       *func;
+    const char       *obj;
+    char              sym[STRSIZE];
+    const char       *str;
+};
+
+struct link_obj
+{
+    const char        *name;
+    struct obj_header *header;
+    uint8_t           *code;
+    union val         *data;
+    struct obj_sym    *sym;
+    struct obj_rel    *rel;
+    uint64_t           ip;
+    uint64_t           addr;
+    struct link_error  error;
+};
+
+struct link_symtable
+{
+    size_t *slot;
+    size_t *obj;
+    size_t  mask;
+};
+
+struct link_code
+{
+    void     *data;
+    uint64_t  size;
+};
+
+struct link_data
+{
+    union val *data;
+    uint64_t   size;
+};
+
+typedef struct linker
+{
+    struct link_obj      *obj;
+    size_t                size;
+    struct link_symtable  symtable;
+    struct link_code      code;
+    struct link_data      data;
+    uint64_t              ressize;
+    const char           *entry;
+    uint64_t              entryip;
+    uint64_t              memtop;
+    uint64_t              stksize;
+    struct link_error     error;
+    size_t                threads;
+    size_t                next;
+} link_t;
+
+int  link_create  (link_t *link, size_t size, char **names);
+int  link_resolve (link_t *link);
+int  link_write   (link_t *link, const char *name);
+void link_error   (link_t *link);
+void link_delete  (link_t *link);
+
+#endif
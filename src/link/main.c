@@ -0,0 +1,67 @@
+#include "linker.h"
+#include <stdio.h>
+#include <unistd.h>
+
+int main (int argc, char **argv)
+{
+    const char *output  = NULL;
+    const char *entry   = NULL;
+    uint64_t    stack   = 0;
+    size_t      threads = 0;
+    int         opt     = 0;
+
+    while ( (opt = getopt (argc, argv, "j:o:e:s:") ) != -1)
+        switch (opt)
+        {
+            case 'j':
+                threads = strtoul (optarg, NULL, 0);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'e':
+                entry = optarg;
+                break;
+            case 's':
+                stack = strtoull (optarg, NULL, 0);
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+
+    if (optind >= argc || stack > PROC_STKSIZE)
+    {
+        fprintf (stderr, "Usage: %s [-j threads] [-o output] [-e entry] [-s stack] <object files>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    link_t link = {};
+
+    link.threads = threads;
+    link.entry   = entry;
+    link.stksize = stack;
+
+    do
+    {
+        if (link_create (&link, (size_t) (argc - optind), argv + optind) )
+            break;
+
+        if (link_resolve (&link) )
+            break;
+
+        if (link_write (&link, output) )
+            break;
+
+        link_delete (&link);
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    link_error (&link);
+
+    link_delete (&link);
+
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,49 @@
+#ifndef OBJECT_H_INCLUDED
+#define OBJECT_H_INCLUDED
+
+#include <stdint.h>
+
+#define OBJ_MAGIC    0x4a424f50
+#define OBJ_VERSION  0x04
+#define OBJ_NAMESIZE 0x40
+
+enum OBJ_SYMTYPE
+{
+    OBJ_SYMLABEL,
+    OBJ_SYMFUNC,
+    OBJ_SYMRES,
+};
+
+enum OBJ_SYMFLAGS
+{
+    OBJ_SYMDEF = 0x01,
+};
+
+struct obj_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t codesize;
+    uint64_t datasize;
+    uint64_t ressize;
+    uint64_t memtop;
+    uint64_t symcount;
+    uint64_t relcount;
+};
+
+struct obj_sym
+{
+    char     name[OBJ_NAMESIZE];
+    uint32_t type;
+    uint32_t flags;
+    uint64_t value;
+    uint64_t size;
+};
+
+struct obj_rel
+{
+    uint64_t offset;
+    uint64_t sym;
+};
+
+#endif
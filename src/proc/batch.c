@@ -0,0 +1,1093 @@
+#include "batch.h"
+#include "scheduler.h"
+#include "lanes.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define BATCH_EMPTY SIZE_MAX
+#define BATCH_RETRY (SIZE_MAX - 1)
+
+struct batch_worker
+{
+    batch_t *batch;
+    size_t   id;
+};
+
+struct batch_io
+{
+    FILE *input;
+    FILE *output;
+};
+
+/* vm comes first: batch_done gets back to the slot from it */
+struct batch_slot
+{
+    proc_t           vm;
+    struct sched_io  io;
+    size_t           job;
+    uint64_t         start;
+    const char      *errstr;
+    uint8_t          busy;
+};
+
+/* one event loop per thread: batch_done starts the next job in the slot of a finished one */
+struct batch_loop
+{
+    batch_t *batch;
+    sched_t  sched;
+    size_t   worker;
+};
+
+struct batch_proc
+{
+    pid_t   pid;
+    int     sock;
+    size_t  job[BATCH_INFLIGHT];
+    size_t  head;
+    size_t  count;
+};
+
+struct batch_result
+{
+    size_t   id;
+    uint64_t latency;
+    uint8_t  failed;
+};
+
+struct batch_group
+{
+    lanes_t  lanes;
+    size_t   job[LANES_MAX];
+    size_t   count;
+};
+
+static const char *batch_strerror (enum BATCH_ERR err);
+static int         batch_parse    (batch_t *batch);
+static int         batch_load     (batch_t *batch, const char *name, size_t line, size_t *prog);
+static char       *batch_read     (const char *name);
+static void       *batch_worker   (void *arg);
+static size_t      batch_next     (batch_t *batch, size_t worker);
+static void        batch_job      (batch_t *batch, proc_t *vm, size_t id);
+static void        batch_events   (batch_t *batch, size_t worker);
+static int         batch_fill     (struct batch_loop *loop, struct batch_slot *slot);
+static int         batch_start    (struct batch_loop *loop, struct batch_slot *slot, size_t id);
+static void        batch_end      (batch_t *batch, struct batch_slot *slot);
+static void        batch_done     (void *ctx, proc_t *proc);
+static void        batch_lanes    (batch_t *batch, size_t worker);
+static void        batch_group    (batch_t *batch, struct batch_group *group);
+static int         batch_coord    (batch_t *batch);
+static int         batch_spawn    (batch_t *batch, struct batch_proc *proc, size_t index);
+static void        batch_serve    (batch_t *batch, int sock);
+static void        batch_crash    (batch_t *batch, struct batch_proc *proc, size_t *retry, size_t *retries);
+static void        batch_fail     (batch_t *batch, struct batch_job *job, const struct proc_error *error,
+                                   const char *errstr);
+static uint64_t    batch_now      (void);
+static int         batch_cmp      (const void *lhs, const void *rhs);
+
+static size_t deque_pop   (struct batch_deque *deque);
+static size_t deque_steal (struct batch_deque *deque);
+
+static int file_input  (void *ctx, int64_t *val);
+static int file_output (void *ctx, int64_t val);
+
+int batch_create (batch_t *batch, const char *manifest)
+{
+    assert (batch);
+    assert (manifest);
+
+    memset (batch, 0, sizeof (*batch) );
+
+    batch->name = manifest;
+
+    errno = 0;
+
+    if (!(batch->text = batch_read (manifest) ) )
+    {
+        batch->error = (struct batch_error) {BATCH_ERRCREATE, 0, strerror (errno)};
+        return EXIT_FAILURE;
+    }
+
+    if (batch_parse (batch) )
+    {
+        struct batch_error error = batch->error;
+
+        batch_delete (batch);
+
+        batch->name  = manifest;
+        batch->error = error;
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int batch_run (batch_t *batch)
+{
+    assert (batch);
+
+    pthread_t           thread[BATCH_MAXTHREADS] = {};
+    struct batch_worker worker[BATCH_MAXTHREADS] = {};
+    uint64_t            start                    = 0;
+    size_t              count                    = 0;
+
+    if (!batch->threads)
+    {
+        long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+        batch->threads = (cpus > 0) ? (size_t) cpus : 1;
+    }
+
+    if (batch->threads > BATCH_MAXTHREADS)
+        batch->threads = BATCH_MAXTHREADS;
+
+    if (batch->threads > batch->jobcount)
+        batch->threads = batch->jobcount ? batch->jobcount : 1;
+
+    if (batch->lanes && (batch->lanes < LANES_VEC || batch->lanes > LANES_MAX || (batch->lanes & (batch->lanes - 1) ) ) )
+    {
+        batch->error = (struct batch_error) {BATCH_ERRLANES, 0, NULL};
+
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < batch->jobcount; i++)
+        batch->order[i] = i;
+
+    if (batch->workers)
+        return batch_coord (batch);
+
+    for (size_t i = 0; i < batch->threads; i++)
+    {
+        size_t begin = batch->jobcount * i / batch->threads;
+        size_t end   = batch->jobcount * (i + 1) / batch->threads;
+
+        batch->deque[i] = (struct batch_deque) {batch->order + begin, 0, (int64_t) (end - begin)};
+        worker[i]       = (struct batch_worker) {batch, i};
+    }
+
+    start = batch_now ();
+
+    for (count = 1; count < batch->threads; count++)
+        if (pthread_create (&thread[count], NULL, batch_worker, &worker[count]) )
+            break;
+
+    batch_worker (&worker[0]);
+
+    for (size_t i = 1; i < count; i++)
+        pthread_join (thread[i], NULL);
+
+    batch->elapsed = batch_now () - start;
+    batch->threads = count;
+
+    return (batch->failed || batch->error.err) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void batch_report (batch_t *batch, FILE *stream)
+{
+    assert (batch);
+    assert (stream);
+
+    uint64_t *latency = calloc (batch->jobcount + 1, sizeof (*latency) );
+    double    seconds = (double) batch->elapsed / 1e9;
+
+    if (!latency)
+        return;
+
+    for (size_t i = 0; i < batch->jobcount; i++)
+        latency[i] = batch->job[i].latency;
+
+    qsort (latency, batch->jobcount, sizeof (*latency), batch_cmp);
+
+    fprintf (stream, "Jobs: %zu (%zu failed), %s: %zu, time: %.3f s, throughput: %.1f jobs/s\n",
+             batch->jobcount, batch->failed, batch->workers ? "workers" : "threads",
+             batch->workers ? batch->workers : batch->threads, seconds,
+             (seconds > 0) ? (double) batch->jobcount / seconds : 0.0);
+
+    if (batch->restarts)
+        fprintf (stream, "Restarts: %zu\n", batch->restarts);
+
+    if (batch->jobcount)
+    {
+        size_t last = batch->jobcount - 1;
+
+        fprintf (stream, "Latency: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+                 (double) latency[last * 50 / 100] / 1e3, (double) latency[last * 90 / 100] / 1e3,
+                 (double) latency[last * 99 / 100] / 1e3, (double) latency[last] / 1e3);
+    }
+
+    free (latency);
+}
+
+void batch_delete (batch_t *batch)
+{
+    assert (batch);
+
+    for (size_t i = 0; batch->prog && i < batch->progcount; i++)
+        prog_delete (&batch->prog[i].prog);
+
+    free (batch->prog);
+    free (batch->job);
+    free (batch->order);
+    free (batch->text);
+
+    memset (batch, 0, sizeof (*batch) );
+}
+
+void batch_error (batch_t *batch)
+{
+    assert (batch);
+
+    fprintf (stderr, "%s", batch->name ? batch->name : "batch");
+
+    if (batch->error.line)
+        fprintf (stderr, ":%zu", batch->error.line);
+
+    fprintf (stderr, ": %s", batch_strerror (batch->error.err) );
+
+    if (batch->error.str)
+        fprintf (stderr, ": %s", batch->error.str);
+
+    fprintf (stderr, "\n");
+}
+
+static const char *batch_strerror (enum BATCH_ERR err)
+{
+    switch (err)
+    {
+        case BATCH_NOERR:
+            return "No errors";
+        case BATCH_ERRCREATE:
+            return "Can't read manifest";
+        case BATCH_ERRMANIFEST:
+            return "Bad manifest line, expected <program> <input> <output>";
+        case BATCH_ERRPROG:
+            return "Can't read program";
+        case BATCH_ERRTHREAD:
+            return "Can't start worker";
+        case BATCH_ERRLANES:
+            return "Bad lane count, expected 4, 8 or 16";
+        case BATCH_ERRWORKER:
+            return "Can't start worker process";
+    }
+
+    return "Undefined error";
+}
+
+static int batch_parse (batch_t *batch)
+{
+    assert (batch);
+    assert (batch->text);
+
+    size_t  lines = 1;
+    char   *save  = NULL;
+    char   *str   = batch->text;
+
+    for (const char *ch = batch->text; *ch; ch++)
+        lines += (*ch == '\n');
+
+    batch->prog  = calloc (lines, sizeof (*batch->prog) );
+    batch->job   = calloc (lines, sizeof (*batch->job) );
+    batch->order = calloc (lines, sizeof (*batch->order) );
+
+    if (!batch->prog || !batch->job || !batch->order)
+    {
+        batch->error = (struct batch_error) {BATCH_ERRCREATE, 0, strerror (errno)};
+        return EXIT_FAILURE;
+    }
+
+    for (size_t line = 1; str; line++)
+    {
+        char   *end      = strchr (str, '\n');
+        char   *field[4] = {};
+        size_t  count    = 0;
+        size_t  prog     = 0;
+
+        if (end)
+            *end = '\0';
+
+        for (char *word = strtok_r (str, " \t\r", &save); word && count < 4; word = strtok_r (NULL, " \t\r", &save) )
+            field[count++] = word;
+
+        str = end ? end + 1 : NULL;
+
+        if (!count || *field[0] == '#')
+            continue;
+
+        if (count != 3)
+        {
+            batch->error = (struct batch_error) {BATCH_ERRMANIFEST, line, NULL};
+            return EXIT_FAILURE;
+        }
+
+        if (batch_load (batch, field[0], line, &prog) )
+            return EXIT_FAILURE;
+
+        batch->job[batch->jobcount++] = (struct batch_job) {prog, field[1], field[2], line, 0, 0};
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int batch_load (batch_t *batch, const char *name, size_t line, size_t *prog)
+{
+    assert (batch);
+    assert (name);
+    assert (prog);
+
+    for (*prog = 0; *prog < batch->progcount; (*prog)++)
+        if (!strcmp (batch->prog[*prog].name, name) )
+            return EXIT_SUCCESS;
+
+    batch->prog[*prog].name = name;
+
+    if (prog_create (&batch->prog[*prog].prog, name) )
+    {
+        batch->error = (struct batch_error) {BATCH_ERRPROG, line, batch->prog[*prog].prog.error.str};
+        return EXIT_FAILURE;
+    }
+
+    batch->progcount++;
+
+    return EXIT_SUCCESS;
+}
+
+static char *batch_read (const char *name)
+{
+    assert (name);
+
+    FILE *stream = fopen (name, "rb");
+    char *data   = NULL;
+    long  length = 0;
+
+    do
+    {
+        if (!stream)
+            break;
+
+        if (fseek (stream, 0, SEEK_END) || (length = ftell (stream) ) < 0 || fseek (stream, 0, SEEK_SET) )
+            break;
+
+        if (!(data = calloc ( (size_t) length + 1, 1) ) )
+            break;
+
+        if (fread (data, 1, (size_t) length, stream) != (size_t) length)
+            break;
+
+        fclose (stream);
+
+        return data;
+    }
+    while (0);
+
+    free (data);
+
+    if (stream)
+        fclose (stream);
+
+    return NULL;
+}
+
+static void *batch_worker (void *arg)
+{
+    assert (arg);
+
+    struct batch_worker *worker = arg;
+    batch_t             *batch  = worker->batch;
+    proc_t              *vm     = NULL;
+    size_t               id     = 0;
+
+    if (batch->lanes)
+    {
+        batch_lanes (batch, worker->id);
+        return NULL;
+    }
+
+    if (batch->budget)
+    {
+        batch_events (batch, worker->id);
+        return NULL;
+    }
+
+    if (!(vm = calloc (batch->progcount, sizeof (*vm) ) ) )
+    {
+        batch->error = (struct batch_error) {BATCH_ERRTHREAD, 0, strerror (errno)};
+        return NULL;
+    }
+
+    while ( (id = batch_next (batch, worker->id) ) != BATCH_EMPTY)
+        batch_job (batch, vm, id);
+
+    for (size_t i = 0; i < batch->progcount; i++)
+        if (vm[i].prog)
+            proc_delete (&vm[i]);
+
+    free (vm);
+
+    return NULL;
+}
+
+static size_t batch_next (batch_t *batch, size_t worker)
+{
+    assert (batch);
+
+    size_t id = deque_pop (&batch->deque[worker]);
+
+    for (size_t i = 1; id == BATCH_EMPTY && i < batch->threads; i++)
+        while ( (id = deque_steal (&batch->deque[(worker + i) % batch->threads]) ) == BATCH_RETRY)
+            ;
+
+    return id;
+}
+
+static void batch_job (batch_t *batch, proc_t *vm, size_t id)
+{
+    assert (batch);
+    assert (vm);
+
+    struct batch_job  *job    = &batch->job[id];
+    struct batch_prog *prog   = &batch->prog[job->prog];
+    struct batch_io    io     = {};
+    const char        *errstr = NULL;
+    uint64_t           start  = batch_now ();
+
+    vm = &vm[job->prog];
+
+    do
+    {
+        if (!vm->prog && proc_attach (vm, &prog->prog, 0) )
+            break;
+
+        if (!(io.input = fopen (job->input, "r") ) )
+        {
+            errstr = job->input;
+            break;
+        }
+
+        if (!(io.output = fopen (job->output, "w") ) )
+        {
+            errstr = job->output;
+            break;
+        }
+
+        proc_setio (vm, file_input, file_output, &io);
+
+        proc_run (vm);
+    }
+    while (0);
+
+    if (io.output && fclose (io.output) && vm->status != PROC_STERR)
+        errstr = job->output;
+    if (io.input)
+        fclose (io.input);
+
+    job->latency = batch_now () - start;
+
+    if (errstr || vm->status != PROC_STHLT)
+        batch_fail (batch, job, &vm->error, errstr);
+
+    if (vm->prog)
+        proc_reset (vm);
+}
+
+static void batch_events (batch_t *batch, size_t worker)
+{
+    assert (batch);
+
+    struct batch_slot *slot = calloc (BATCH_SLOTS, sizeof (*slot) );
+    struct batch_loop  loop = {batch, {}, worker};
+
+    if (!slot || sched_create (&loop.sched, batch->budget) )
+    {
+        batch->error = (struct batch_error) {BATCH_ERRTHREAD, 0, slot ? loop.sched.error.str : strerror (errno)};
+
+        free (slot);
+
+        return;
+    }
+
+    loop.sched.done = batch_done;
+    loop.sched.ctx  = &loop;
+
+    for (size_t i = 0; i < BATCH_SLOTS && batch_fill (&loop, &slot[i]); i++)
+        ;
+
+    if (sched_run (&loop.sched) && loop.sched.error.err)
+        batch->error = (struct batch_error) {BATCH_ERRTHREAD, 0, loop.sched.error.str};
+
+    /* after a scheduler error the jobs left in the slots fail with it */
+    for (size_t i = 0; i < BATCH_SLOTS; i++)
+    {
+        if (slot[i].busy)
+        {
+            slot[i].vm.error  = loop.sched.error;
+            slot[i].vm.status = PROC_STERR;
+
+            batch_end (batch, &slot[i]);
+        }
+
+        if (slot[i].vm.prog)
+            proc_delete (&slot[i].vm);
+    }
+
+    sched_delete (&loop.sched);
+
+    free (slot);
+}
+
+/* starts the next job that can start in slot; returns whether one runs there */
+static int batch_fill (struct batch_loop *loop, struct batch_slot *slot)
+{
+    assert (loop);
+    assert (slot);
+
+    size_t id = BATCH_EMPTY;
+
+    while (!loop->sched.error.err && (id = batch_next (loop->batch, loop->worker) ) != BATCH_EMPTY)
+    {
+        if (!batch_start (loop, slot, id) )
+            return 1;
+
+        batch_end (loop->batch, slot);
+    }
+
+    return 0;
+}
+
+static int batch_start (struct batch_loop *loop, struct batch_slot *slot, size_t id)
+{
+    assert (loop);
+    assert (slot);
+
+    struct batch_job *job  = &loop->batch->job[id];
+    const prog_t     *prog = &loop->batch->prog[job->prog].prog;
+
+    slot->io.in  = -1;
+    slot->io.out = -1;
+    slot->job    = id;
+    slot->start  = batch_now ();
+    slot->errstr = NULL;
+    slot->busy   = 1;
+
+    if (slot->vm.prog == prog)
+        proc_reset (&slot->vm);
+    else
+    {
+        if (slot->vm.prog)
+            proc_delete (&slot->vm);
+
+        if (proc_attach (&slot->vm, prog, 0) )
+            return EXIT_FAILURE;
+    }
+
+    if ( (slot->io.in = open (job->input, O_RDONLY | O_NONBLOCK | O_CLOEXEC) ) == -1)
+    {
+        slot->errstr = job->input;
+        return EXIT_FAILURE;
+    }
+
+    if ( (slot->io.out = open (job->output, O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC, 0666) ) == -1)
+    {
+        slot->errstr = job->output;
+        return EXIT_FAILURE;
+    }
+
+    sched_setio (&slot->vm, &slot->io, slot->io.in, slot->io.out);
+
+    if (sched_add (&loop->sched, &slot->vm) )
+    {
+        slot->vm.error  = loop->sched.error;
+        slot->vm.status = PROC_STERR;
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void batch_end (batch_t *batch, struct batch_slot *slot)
+{
+    assert (batch);
+    assert (slot);
+
+    struct batch_job *job = &batch->job[slot->job];
+
+    job->latency = batch_now () - slot->start;
+
+    if (slot->errstr || slot->vm.status != PROC_STHLT)
+        batch_fail (batch, job, &slot->vm.error, slot->errstr);
+
+    if (slot->io.in != -1)
+        close (slot->io.in);
+    if (slot->io.out != -1)
+        close (slot->io.out);
+
+    slot->busy = 0;
+}
+
+static void batch_done (void *ctx, proc_t *proc)
+{
+    assert (ctx);
+    assert (proc);
+
+    struct batch_loop *loop = ctx;
+    struct batch_slot *slot = (struct batch_slot *) proc;
+
+    batch_end (loop->batch, slot);
+    batch_fill (loop, slot);
+}
+
+/* jobs of one program are gathered until there is one per lane, then run together */
+static void batch_lanes (batch_t *batch, size_t worker)
+{
+    assert (batch);
+
+    struct batch_group *group = calloc (batch->progcount, sizeof (*group) );
+    size_t              id    = 0;
+
+    if (!group)
+    {
+        batch->error = (struct batch_error) {BATCH_ERRTHREAD, 0, strerror (errno)};
+        return;
+    }
+
+    while ( (id = batch_next (batch, worker) ) != BATCH_EMPTY)
+    {
+        struct batch_job   *job = &batch->job[id];
+        struct batch_group *cur = &group[job->prog];
+
+        if (!cur->lanes.prog && lanes_create (&cur->lanes, &batch->prog[job->prog].prog, batch->lanes) )
+        {
+            batch_fail (batch, job, &cur->lanes.error, NULL);
+            continue;
+        }
+
+        cur->job[cur->count++] = id;
+
+        if (cur->count == batch->lanes)
+            batch_group (batch, cur);
+    }
+
+    for (size_t i = 0; i < batch->progcount; i++)
+    {
+        if (group[i].count)
+            batch_group (batch, &group[i]);
+
+        if (group[i].lanes.prog)
+            lanes_delete (&group[i].lanes);
+    }
+
+    free (group);
+}
+
+static void batch_group (batch_t *batch, struct batch_group *group)
+{
+    assert (batch);
+    assert (group);
+
+    struct batch_io   io[LANES_MAX]  = {};
+    struct batch_job *job[LANES_MAX] = {};
+    size_t            count          = 0;
+    uint64_t          start          = batch_now ();
+    uint64_t          latency        = 0;
+
+    for (size_t i = 0; i < group->count; i++)
+    {
+        struct batch_job *cur = &batch->job[group->job[i]];
+
+        if (!(io[count].input = fopen (cur->input, "r") ) )
+        {
+            batch_fail (batch, cur, NULL, cur->input);
+            continue;
+        }
+
+        if (!(io[count].output = fopen (cur->output, "w") ) )
+        {
+            batch_fail (batch, cur, NULL, cur->output);
+
+            fclose (io[count].input);
+            continue;
+        }
+
+        lanes_setio (&group->lanes, count, file_input, file_output, &io[count]);
+
+        job[count++] = cur;
+    }
+
+    lanes_reset (&group->lanes, count);
+    lanes_run   (&group->lanes);
+
+    latency = batch_now () - start;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *errstr = NULL;
+
+        if (fclose (io[i].output) && group->lanes.lane[i].status != PROC_STERR)
+            errstr = job[i]->output;
+
+        fclose (io[i].input);
+
+        job[i]->latency = latency;
+
+        if (errstr || group->lanes.lane[i].status != PROC_STHLT)
+            batch_fail (batch, job[i], &group->lanes.lane[i].error, errstr);
+    }
+
+    group->count = 0;
+}
+
+/* jobs go to forked workers over socketpairs, at most BATCH_INFLIGHT each, and come back in order */
+static int batch_coord (batch_t *batch)
+{
+    assert (batch);
+
+    struct batch_proc  proc[BATCH_MAXWORKERS] = {};
+    struct pollfd      fds [BATCH_MAXWORKERS] = {};
+    size_t            *retry                  = calloc (batch->jobcount + 1, sizeof (*retry) );
+    size_t             retries                = 0;
+    size_t             next                   = 0;
+    size_t             done                   = 0;
+    size_t             count                  = 0;
+    uint64_t           start                  = 0;
+
+    if (!retry)
+    {
+        batch->error = (struct batch_error) {BATCH_ERRWORKER, 0, strerror (errno)};
+
+        return EXIT_FAILURE;
+    }
+
+    if (batch->workers > BATCH_MAXWORKERS)
+        batch->workers = BATCH_MAXWORKERS;
+
+    if (batch->workers > batch->jobcount)
+        batch->workers = batch->jobcount ? batch->jobcount : 1;
+
+    for (size_t i = 0; i < batch->workers; i++)
+        proc[i].sock = -1;
+
+    fflush (NULL);
+
+    start = batch_now ();
+
+    for (count = 0; count < batch->workers; count++)
+        if (batch_spawn (batch, proc, count) )
+        {
+            batch->error = (struct batch_error) {BATCH_ERRWORKER, 0, strerror (errno)};
+            break;
+        }
+
+    while (!batch->error.err && done < batch->jobcount)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            while (proc[i].count < BATCH_INFLIGHT && (retries || next < batch->jobcount) )
+            {
+                size_t id = retries ? retry[retries - 1] : next;
+
+                if (send (proc[i].sock, &id, sizeof (id), MSG_NOSIGNAL) != sizeof (id) )
+                    break;
+
+                if (retries)
+                    retries--;
+                else
+                    next++;
+
+                proc[i].job[(proc[i].head + proc[i].count++) % BATCH_INFLIGHT] = id;
+            }
+
+            fds[i] = (struct pollfd) {proc[i].sock, POLLIN, 0};
+        }
+
+        if (poll (fds, count, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            batch->error = (struct batch_error) {BATCH_ERRWORKER, 0, strerror (errno)};
+            break;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            struct batch_result result = {};
+
+            if (!fds[i].revents)
+                continue;
+
+            if (recv (proc[i].sock, &result, sizeof (result), 0) != sizeof (result) ||
+                !proc[i].count || result.id != proc[i].job[proc[i].head])
+            {
+                done += proc[i].count ? 1 : 0;
+
+                batch_crash (batch, &proc[i], retry, &retries);
+
+                if (batch_spawn (batch, proc, i) )
+                {
+                    batch->error = (struct batch_error) {BATCH_ERRWORKER, 0, strerror (errno)};
+                    break;
+                }
+
+                batch->restarts++;
+                continue;
+            }
+
+            batch->job[result.id].latency = result.latency;
+            batch->job[result.id].failed  = result.failed;
+            batch->failed                += result.failed;
+
+            proc[i].head = (proc[i].head + 1) % BATCH_INFLIGHT;
+            proc[i].count--;
+
+            done++;
+        }
+    }
+
+    batch->elapsed = batch_now () - start;
+
+    for (size_t i = 0; i < count; i++)
+        if (proc[i].sock != -1)
+            close (proc[i].sock);
+
+    for (size_t i = 0; i < count; i++)
+        if (proc[i].pid > 0)
+            waitpid (proc[i].pid, NULL, 0);
+
+    free (retry);
+
+    return (batch->failed || batch->error.err) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int batch_spawn (batch_t *batch, struct batch_proc *proc, size_t index)
+{
+    assert (batch);
+    assert (proc);
+
+    int   sock[2] = {-1, -1};
+    pid_t pid     = 0;
+
+    if (socketpair (AF_UNIX, SOCK_SEQPACKET, 0, sock) )
+        return EXIT_FAILURE;
+
+    if ( (pid = fork () ) < 0)
+    {
+        close (sock[0]);
+        close (sock[1]);
+
+        return EXIT_FAILURE;
+    }
+
+    if (pid == 0)
+    {
+        close (sock[0]);
+
+        for (size_t i = 0; i < batch->workers; i++)
+            if (i != index && proc[i].sock != -1)
+                close (proc[i].sock);
+
+        batch_serve (batch, sock[1]);
+
+        _exit (EXIT_SUCCESS);
+    }
+
+    close (sock[1]);
+
+    proc[index] = (struct batch_proc) {pid, sock[0], {}, 0, 0};
+
+    return EXIT_SUCCESS;
+}
+
+static void batch_serve (batch_t *batch, int sock)
+{
+    assert (batch);
+
+    proc_t *vm = calloc (batch->progcount, sizeof (*vm) );
+    size_t  id = 0;
+
+    while (vm && recv (sock, &id, sizeof (id), 0) == sizeof (id) && id < batch->jobcount)
+    {
+        struct batch_result result = {};
+
+        batch_job (batch, vm, id);
+
+        result = (struct batch_result) {id, batch->job[id].latency, batch->job[id].failed};
+
+        if (send (sock, &result, sizeof (result), MSG_NOSIGNAL) != sizeof (result) )
+            break;
+    }
+
+    for (size_t i = 0; vm && i < batch->progcount; i++)
+        if (vm[i].prog)
+            proc_delete (&vm[i]);
+
+    free (vm);
+
+    close (sock);
+}
+
+/* the oldest job in flight is the one that took the worker down, the rest are handed out again */
+static void batch_crash (batch_t *batch, struct batch_proc *proc, size_t *retry, size_t *retries)
+{
+    assert (batch);
+    assert (proc);
+    assert (retry);
+    assert (retries);
+
+    int status = 0;
+
+    close (proc->sock);
+
+    proc->sock = -1;
+
+    kill    (proc->pid, SIGKILL);
+    waitpid (proc->pid, &status, 0);
+
+    proc->pid = 0;
+
+    if (proc->count)
+    {
+        struct batch_job *job = &batch->job[proc->job[proc->head]];
+
+        fprintf (stderr, "%s:%zu: worker ", batch->name, job->line);
+
+        if (WIFSIGNALED (status) )
+            fprintf (stderr, "killed by signal %d\n", WTERMSIG (status) );
+        else
+            fprintf (stderr, "exited with status %d\n", WEXITSTATUS (status) );
+
+        job->failed = 1;
+
+        batch->failed++;
+    }
+
+    for (size_t i = 1; i < proc->count; i++)
+        retry[(*retries)++] = proc->job[(proc->head + i) % BATCH_INFLIGHT];
+
+    proc->head  = 0;
+    proc->count = 0;
+}
+
+static void batch_fail (batch_t *batch, struct batch_job *job, const struct proc_error *error,
+                        const char *errstr)
+{
+    assert (batch);
+    assert (job);
+    assert (error || errstr);
+
+    flockfile (stderr);
+
+    fprintf (stderr, "%s:%zu: ", batch->name, job->line);
+
+    if (errstr)
+        fprintf (stderr, "%s: %s\n", errstr, strerror (errno) );
+    else
+        proc_perror (stderr, error);
+
+    funlockfile (stderr);
+
+    job->failed = 1;
+
+    __atomic_fetch_add (&batch->failed, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t batch_now (void)
+{
+    struct timespec ts = {};
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static int batch_cmp (const void *lhs, const void *rhs)
+{
+    assert (lhs);
+    assert (rhs);
+
+    uint64_t a = *(const uint64_t *) lhs;
+    uint64_t b = *(const uint64_t *) rhs;
+
+    return (a > b) - (a < b);
+}
+
+static size_t deque_pop (struct batch_deque *deque)
+{
+    assert (deque);
+
+    int64_t bottom = __atomic_load_n (&deque->bottom, __ATOMIC_RELAXED) - 1;
+    int64_t top    = 0;
+    size_t  id     = BATCH_EMPTY;
+
+    __atomic_store_n (&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+    top = __atomic_load_n (&deque->top, __ATOMIC_RELAXED);
+
+    if (top <= bottom)
+    {
+        id = deque->job[bottom];
+
+        if (top != bottom)
+            return id;
+
+        if (!__atomic_compare_exchange_n (&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED) )
+            id = BATCH_EMPTY;
+    }
+
+    __atomic_store_n (&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+
+    return id;
+}
+
+static size_t deque_steal (struct batch_deque *deque)
+{
+    assert (deque);
+
+    int64_t top    = __atomic_load_n (&deque->top, __ATOMIC_ACQUIRE);
+    int64_t bottom = 0;
+
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+    bottom = __atomic_load_n (&deque->bottom, __ATOMIC_ACQUIRE);
+
+    if (top >= bottom)
+        return BATCH_EMPTY;
+
+    size_t id = deque->job[top];
+
+    if (!__atomic_compare_exchange_n (&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED) )
+        return BATCH_RETRY;
+
+    return id;
+}
+
+static int file_input (void *ctx, int64_t *val)
+{
+    assert (ctx);
+    assert (val);
+
+    struct batch_io *io = ctx;
+
+    return (fscanf (io->input, "%ld", val) == 1) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int file_output (void *ctx, int64_t val)
+{
+    assert (ctx);
+
+    struct batch_io *io = ctx;
+
+    return (fprintf (io->output, "%ld\n", val) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+#include "processor.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define BATCH_MAXTHREADS 0x40
+#define BATCH_SLOTS      0x100
+#define BATCH_MAXWORKERS 0x40
+#define BATCH_INFLIGHT   0x04
+
+enum BATCH_ERR
+{
+    BATCH_NOERR,
+    BATCH_ERRCREATE,
+    BATCH_ERRMANIFEST,
+    BATCH_ERRPROG,
+    BATCH_ERRTHREAD,
+    BATCH_ERRLANES,
+    BATCH_ERRWORKER,
+};
+
+struct batch_prog
+{
+    const char *name;
+    prog_t      prog;
+};
+
+struct batch_job
+{
+    size_t      prog;
+    const char *input;
+    const char *output;
+    size_t      line;
+    uint64_t    latency;
+    uint8_t     failed;
+};
+
+struct batch_deque
+{
+    size_t  *job;
+    int64_t  top;
+    int64_t  bottom;
+};
+
+struct batch_error
+{
+    enum BATCH_ERR  err;
+    size_t          line;
+    const char     *str;
+};
+
+typedef struct batch
+{
+    const char         *name;
+    char               *text;
+    struct batch_prog  *prog;
+    size_t              progcount;
+    struct batch_job   *job;
+    size_t              jobcount;
+    size_t             *order;
+    struct batch_deque  deque[BATCH_MAXTHREADS];
+    size_t              threads;
+    uint64_t            budget;
+    size_t              lanes;
+    size_t              workers;
+    size_t              restarts;
+    size_t              failed;
+    uint64_t            elapsed;
+    struct batch_error  error;
+} batch_t;
+
+int  batch_create (batch_t *batch, const char *manifest);
+int  batch_run    (batch_t *batch);
+void batch_report (batch_t *batch, FILE *stream);
+void batch_delete (batch_t *batch);
+void batch_error  (batch_t *batch);
+
+#endif
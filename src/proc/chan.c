@@ -0,0 +1,168 @@
+#include "chan.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int spsc_send (struct proc_chan *chan, int64_t val);
+static int spsc_recv (struct proc_chan *chan, int64_t *val);
+static int mpmc_send (struct proc_chan *chan, int64_t val);
+static int mpmc_recv (struct proc_chan *chan, int64_t *val);
+
+int chan_create (struct proc_chan *chan, uint64_t size, int flags, uint32_t senders, uint32_t receivers)
+{
+    assert (chan);
+    assert (size && !(size & (size - 1) ) );
+
+    memset (chan, 0, sizeof (*chan) );
+
+    chan->mask      = size - 1;
+    chan->senders   = senders;
+    chan->receivers = receivers;
+
+    if (!(chan->data = calloc (size, sizeof (*chan->data) ) ) )
+        return EXIT_FAILURE;
+
+    if (flags & CHAN_MPMC)
+    {
+        if (!(chan->seq = calloc (size, sizeof (*chan->seq) ) ) )
+        {
+            chan_delete (chan);
+            return EXIT_FAILURE;
+        }
+
+        for (uint64_t i = 0; i < size; i++)
+            chan->seq[i] = i;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+enum CHAN_RET chan_send (struct proc_chan *chan, int64_t val)
+{
+    assert (chan);
+
+    if (!(chan->seq ? mpmc_send (chan, val) : spsc_send (chan, val) ) )
+        return CHAN_OK;
+
+    return __atomic_load_n (&chan->receivers, __ATOMIC_ACQUIRE) ? CHAN_WAIT : CHAN_CLOSED;
+}
+
+enum CHAN_RET chan_recv (struct proc_chan *chan, int64_t *val)
+{
+    assert (chan);
+    assert (val);
+
+    if (!(chan->seq ? mpmc_recv (chan, val) : spsc_recv (chan, val) ) )
+        return CHAN_OK;
+
+    if (__atomic_load_n (&chan->senders, __ATOMIC_ACQUIRE) )
+        return CHAN_WAIT;
+
+    /* the last sender may have pushed a value right before leaving */
+    return (chan->seq ? mpmc_recv (chan, val) : spsc_recv (chan, val) ) ? CHAN_CLOSED : CHAN_OK;
+}
+
+void chan_close (struct proc_chan *chan, int sender)
+{
+    assert (chan);
+
+    __atomic_sub_fetch (sender ? &chan->senders : &chan->receivers, 1, __ATOMIC_RELEASE);
+}
+
+void chan_delete (struct proc_chan *chan)
+{
+    assert (chan);
+
+    free (chan->data);
+    free (chan->seq);
+
+    memset (chan, 0, sizeof (*chan) );
+}
+
+static int spsc_send (struct proc_chan *chan, int64_t val)
+{
+    assert (chan);
+
+    uint64_t tail = __atomic_load_n (&chan->tail, __ATOMIC_RELAXED);
+
+    if (tail - __atomic_load_n (&chan->head, __ATOMIC_ACQUIRE) > chan->mask)
+        return EXIT_FAILURE;
+
+    chan->data[tail & chan->mask] = val;
+
+    __atomic_store_n (&chan->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return EXIT_SUCCESS;
+}
+
+static int spsc_recv (struct proc_chan *chan, int64_t *val)
+{
+    assert (chan);
+    assert (val);
+
+    uint64_t head = __atomic_load_n (&chan->head, __ATOMIC_RELAXED);
+
+    if (head == __atomic_load_n (&chan->tail, __ATOMIC_ACQUIRE) )
+        return EXIT_FAILURE;
+
+    *val = chan->data[head & chan->mask];
+
+    __atomic_store_n (&chan->head, head + 1, __ATOMIC_RELEASE);
+
+    return EXIT_SUCCESS;
+}
+
+static int mpmc_send (struct proc_chan *chan, int64_t val)
+{
+    assert (chan);
+
+    uint64_t pos = __atomic_load_n (&chan->tail, __ATOMIC_RELAXED);
+
+    while (1)
+    {
+        int64_t diff = (int64_t) (__atomic_load_n (&chan->seq[pos & chan->mask], __ATOMIC_ACQUIRE) - pos);
+
+        if (diff < 0)
+            return EXIT_FAILURE;
+
+        if (!diff && __atomic_compare_exchange_n (&chan->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+            break;
+
+        if (diff)
+            pos = __atomic_load_n (&chan->tail, __ATOMIC_RELAXED);
+    }
+
+    chan->data[pos & chan->mask] = val;
+
+    __atomic_store_n (&chan->seq[pos & chan->mask], pos + 1, __ATOMIC_RELEASE);
+
+    return EXIT_SUCCESS;
+}
+
+static int mpmc_recv (struct proc_chan *chan, int64_t *val)
+{
+    assert (chan);
+    assert (val);
+
+    uint64_t pos = __atomic_load_n (&chan->head, __ATOMIC_RELAXED);
+
+    while (1)
+    {
+        int64_t diff = (int64_t) (__atomic_load_n (&chan->seq[pos & chan->mask], __ATOMIC_ACQUIRE) - (pos + 1) );
+
+        if (diff < 0)
+            return EXIT_FAILURE;
+
+        if (!diff && __atomic_compare_exchange_n (&chan->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+            break;
+
+        if (diff)
+            pos = __atomic_load_n (&chan->head, __ATOMIC_RELAXED);
+    }
+
+    *val = chan->data[pos & chan->mask];
+
+    __atomic_store_n (&chan->seq[pos & chan->mask], pos + chan->mask + 1, __ATOMIC_RELEASE);
+
+    return EXIT_SUCCESS;
+}
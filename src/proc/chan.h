@@ -0,0 +1,35 @@
+#ifndef CHAN_H_INCLUDED
+#define CHAN_H_INCLUDED
+
+#include <stdint.h>
+
+enum CHAN_FLAGS
+{
+    CHAN_MPMC = 0x01,
+};
+
+enum CHAN_RET
+{
+    CHAN_OK,
+    CHAN_WAIT,
+    CHAN_CLOSED,
+};
+
+struct proc_chan
+{
+    int64_t  *data;
+    uint64_t *seq;
+    uint64_t  mask;
+    uint32_t  senders;
+    uint32_t  receivers;
+    uint64_t  head __attribute__ ( (aligned (64) ) );
+    uint64_t  tail __attribute__ ( (aligned (64) ) );
+};
+
+int           chan_create  (struct proc_chan *chan, uint64_t size, int flags, uint32_t senders, uint32_t receivers);
+enum CHAN_RET chan_send    (struct proc_chan *chan, int64_t val);
+enum CHAN_RET chan_recv    (struct proc_chan *chan, int64_t *val);
+void          chan_close   (struct proc_chan *chan, int sender);
+void          chan_delete  (struct proc_chan *chan);
+
+#endif
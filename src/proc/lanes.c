@@ -0,0 +1,900 @@
+#include "lanes.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#define LANES_ROW(lanes, base, row)        ( (base) + (row) * (lanes)->vecs)
+#define LANES_CELL(lanes, base, row, lane) ( ( (int64_t *) LANES_ROW (lanes, base, row) )[lane])
+
+#define LANES_FOREACH(lane, mask)\
+    for (uint64_t bits_ = (mask), lane = 0; bits_ && ( (lane = (uint64_t) __builtin_ctzll (bits_) ), 1); bits_ &= bits_ - 1)
+
+static void        *lanes_alloc   (uint64_t size);
+static uint64_t     lanes_pick    (lanes_t *lanes, uint64_t *ip, uint64_t *limit);
+static uint64_t     lanes_sync    (lanes_t *lanes, uint64_t mask, uint64_t limit);
+static void         lanes_step    (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask);
+static uint64_t     lanes_check   (lanes_t *lanes, uint64_t mask, uint64_t need, uint64_t room,
+                                   enum PROC_ERR err, uint64_t *sp);
+static void         lanes_fail    (lanes_t *lanes, uint64_t mask, enum PROC_ERR err, const char *str);
+static void         lanes_advance (lanes_t *lanes, uint64_t mask, uint64_t size);
+static void         lanes_mask    (lanes_t *lanes, uint64_t mask, lanes_vec_t *vm);
+static void         lanes_blend   (lanes_t *lanes, lanes_vec_t *dst, const lanes_vec_t *src, const lanes_vec_t *vm);
+static void         lanes_arg     (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask, lanes_vec_t *arg);
+static void         lanes_calc    (lanes_t *lanes, enum PROC_CMDCODES code, lanes_vec_t *top, const lanes_vec_t *arg,
+                                   const lanes_vec_t *vm);
+static lanes_vec_t *lanes_top     (lanes_t *lanes, uint64_t mask, uint64_t sp, uint64_t depth, lanes_vec_t *tmp);
+static void         lanes_put     (lanes_t *lanes, uint64_t mask, uint64_t sp, uint64_t depth, const lanes_vec_t *row);
+static void         lanes_store   (lanes_t *lanes, uint64_t addr, uint64_t lane, int64_t val);
+static void         lanes_mark    (lanes_t *lanes, uint64_t addr);
+static void         lanes_revert  (lanes_t *lanes, uint64_t page);
+
+static void lanes_push  (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask);
+static void lanes_pop   (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask);
+static void lanes_arith (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask);
+static void lanes_div   (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask);
+static void lanes_cmp   (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask);
+static void lanes_jump  (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask);
+static void lanes_call  (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask);
+static void lanes_ret   (lanes_t *lanes, uint64_t mask);
+static void lanes_io    (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask);
+
+int lanes_create (lanes_t *lanes, const prog_t *prog, uint64_t width)
+{
+    assert (lanes);
+    assert (prog);
+    assert (prog->code.decoded);
+
+    memset (lanes, 0, sizeof (*lanes) );
+
+    if (width < LANES_VEC || width > LANES_MAX || (width & (width - 1) ) )
+    {
+        lanes->error = (struct proc_error) {PROC_ERRCREATE, "lane count must be 4, 8 or 16"};
+
+        return EXIT_FAILURE;
+    }
+
+    lanes->prog    = prog;
+    lanes->width   = width;
+    lanes->vecs    = width / LANES_VEC;
+    lanes->memmask = prog->memsize - 1;
+    lanes->stksize = prog->stksize;
+
+    errno = 0;
+
+    if (!(lanes->memory = lanes_alloc (prog->memsize * width * sizeof (int64_t) ) ) ||
+        !(lanes->regs   = lanes_alloc (PROC_REGCOUNT * width * sizeof (int64_t) ) ) ||
+        !(lanes->stkint = lanes_alloc (prog->stksize * width * sizeof (int64_t) ) ) ||
+        !(lanes->stkret = lanes_alloc (prog->stksize * width * sizeof (uint64_t) ) ) )
+    {
+        struct proc_error error = {PROC_ERRCREATE, strerror (errno)};
+
+        lanes_delete (lanes);
+
+        lanes->error = error;
+
+        return EXIT_FAILURE;
+    }
+
+    for (uint64_t page = 0; page * PROC_PAGECELLS < prog->data.size; page++)
+        lanes->memdirty[page / 64] |= (uint64_t) 1 << (page % 64);
+
+    lanes_reset (lanes, width);
+
+    return EXIT_SUCCESS;
+}
+
+void lanes_setio (lanes_t *lanes, uint64_t lane, proc_input_t input, proc_output_t output, void *ctx)
+{
+    assert (lanes);
+    assert (lane < lanes->width);
+    assert (input);
+    assert (output);
+
+    lanes->lane[lane].io = (struct proc_io) {input, output, ctx};
+}
+
+void lanes_reset (lanes_t *lanes, uint64_t count)
+{
+    assert (lanes);
+    assert (lanes->prog);
+    assert (count <= lanes->width);
+
+    for (uint64_t i = 0; i < PROC_PAGEWORDS; i++)
+        for (uint64_t bits = lanes->memdirty[i]; bits; bits &= bits - 1)
+            lanes_revert (lanes, i * 64 + (uint64_t) __builtin_ctzll (bits) );
+
+    memset (lanes->memdirty, 0, sizeof (lanes->memdirty) );
+    memset (lanes->regs, 0, PROC_REGCOUNT * lanes->width * sizeof (int64_t) );
+
+    for (uint64_t i = 0; i < lanes->width; i++)
+    {
+        struct proc_io io = lanes->lane[i].io;
+
+        lanes->lane[i]        = (struct lanes_lane) {};
+        lanes->lane[i].io     = io;
+        lanes->lane[i].ip     = lanes->prog->code.ip;
+        lanes->lane[i].status = (i < count) ? PROC_STRUN : PROC_STHLT;
+    }
+}
+
+int lanes_run (lanes_t *lanes)
+{
+    assert (lanes);
+    assert (lanes->prog);
+
+    const struct proc_code *code  = &lanes->prog->code;
+    const struct proc_cmd  *cmd   = NULL;
+    uint64_t                mask  = 0;
+    uint64_t                ip    = 0;
+    uint64_t                limit = 0;
+
+    while ( (mask = lanes_pick (lanes, &ip, &limit) ) )
+    {
+        if (lanes_sync (lanes, mask, limit) )
+            continue;
+
+        if (!(cmd = proc_decoded (code, ip) ) )
+            lanes_fail (lanes, mask, PROC_ERRIP, NULL);
+        else
+            lanes_step (lanes, cmd, mask);
+    }
+
+    for (uint64_t i = 0; i < lanes->width; i++)
+        if (lanes->lane[i].status == PROC_STERR)
+            return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+void lanes_delete (lanes_t *lanes)
+{
+    assert (lanes);
+
+    if (lanes->memory)
+        munmap (lanes->memory, lanes->prog->memsize * lanes->width * sizeof (int64_t) );
+    if (lanes->regs)
+        munmap (lanes->regs, PROC_REGCOUNT * lanes->width * sizeof (int64_t) );
+    if (lanes->stkint)
+        munmap (lanes->stkint, lanes->stksize * lanes->width * sizeof (int64_t) );
+    if (lanes->stkret)
+        munmap (lanes->stkret, lanes->stksize * lanes->width * sizeof (uint64_t) );
+
+    memset (lanes, 0, sizeof (*lanes) );
+}
+
+void lanes_error (lanes_t *lanes)
+{
+    assert (lanes);
+
+    proc_perror (stderr, &lanes->error);
+}
+
+static void *lanes_alloc (uint64_t size)
+{
+    void *data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    return (data == MAP_FAILED) ? NULL : data;
+}
+
+/* lanes sitting at the lowest ip run next: lanes that branched apart meet again there; limit is the next lowest ip */
+static uint64_t lanes_pick (lanes_t *lanes, uint64_t *ip, uint64_t *limit)
+{
+    assert (lanes);
+    assert (ip);
+    assert (limit);
+
+    uint64_t mask = 0;
+
+    *ip    = UINT64_MAX;
+    *limit = UINT64_MAX;
+
+    for (uint64_t i = 0; i < lanes->width; i++)
+    {
+        uint64_t cur = lanes->lane[i].ip;
+
+        if (lanes->lane[i].status != PROC_STRUN)
+            continue;
+
+        if (cur < *ip)
+        {
+            *limit = *ip;
+            *ip    = cur;
+            mask   = 0;
+        }
+        else if (cur > *ip && cur < *limit)
+            *limit = cur;
+
+        if (cur == *ip)
+            mask |= (uint64_t) 1 << i;
+    }
+
+    return mask;
+}
+
+/* runs lanes that share ip and stack depths under one ip until they branch apart or reach limit */
+static uint64_t lanes_sync (lanes_t *lanes, uint64_t mask, uint64_t limit)
+{
+    assert (lanes);
+    assert (mask);
+
+    const struct proc_code *code  = &lanes->prog->code;
+    const struct proc_cmd  *cmd   = NULL;
+    struct lanes_lane      *first = &lanes->lane[__builtin_ctzll (mask)];
+    lanes_vec_t             arg[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t             vm [LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t             eq [LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t             lt [LANES_MAX / LANES_VEC] = {};
+    uint64_t                ip    = first->ip;
+    uint64_t                sp    = first->spint;
+    uint64_t                spret = first->spret;
+    uint64_t                count = 0;
+    int                     stop  = 0;
+
+    LANES_FOREACH (lane, mask)
+    {
+        if (lanes->lane[lane].spint != sp || lanes->lane[lane].spret != spret)
+            return 0;
+
+        ( (int64_t *) eq)[lane] = (lanes->lane[lane].cmp == PROC_CMPEQ)   ? -1 : 0;
+        ( (int64_t *) lt)[lane] = (lanes->lane[lane].cmp == PROC_CMPLESS) ? -1 : 0;
+    }
+
+    lanes_mask (lanes, mask, vm);
+
+    while (!stop && ip < limit && (cmd = proc_decoded (code, ip) ) )
+    {
+        lanes_vec_t           *top  = sp ? LANES_ROW (lanes, lanes->stkint, sp - 1) : NULL;
+        int64_t                any  = 0;
+        int64_t                all  = -1;
+
+        switch (cmd->code)
+        {
+            case CMD_PUSH:
+                if ( (stop = (sp >= lanes->stksize) ) )
+                    break;
+
+                lanes_arg   (lanes, cmd, mask, arg);
+                lanes_blend (lanes, LANES_ROW (lanes, lanes->stkint, sp), arg, vm);
+
+                sp++;
+                ip += cmd->size;
+                break;
+            case CMD_POP:
+                if ( (stop = (sp == 0 || (cmd->flgreg && cmd->flgmem) ) ) )
+                    break;
+
+                if (cmd->flgreg)
+                    lanes_blend (lanes, LANES_ROW (lanes, lanes->regs, cmd->arg.vu8), top, vm);
+                else if (cmd->flgmem)
+                {
+                    lanes_blend (lanes, LANES_ROW (lanes, lanes->memory, cmd->arg.vu64 & lanes->memmask), top, vm);
+                    lanes_mark  (lanes, cmd->arg.vu64 & lanes->memmask);
+                }
+
+                sp--;
+                ip += (cmd->flgreg || cmd->flgmem) ? cmd->size : 1;
+                break;
+            case CMD_ADD:
+            case CMD_SUB:
+            case CMD_MUL:
+                if ( (stop = (sp == 0) ) )
+                    break;
+
+                lanes_arg  (lanes, cmd, mask, arg);
+                lanes_calc (lanes, cmd->code, top, arg, vm);
+
+                ip += cmd->size;
+                break;
+            case CMD_DIV:
+            case CMD_MOD:
+                if ( (stop = (sp == 0) ) )
+                    break;
+
+                lanes_arg (lanes, cmd, mask, arg);
+
+                /* zero and INT64_MIN / -1 fail their lanes in lanes_div */
+                LANES_FOREACH (lane, mask)
+                    stop |= ( (int64_t *) arg)[lane] == 0 ||
+                            ( ( (int64_t *) arg)[lane] == -1 && ( (int64_t *) top)[lane] == INT64_MIN);
+
+                if (stop)
+                    break;
+
+                LANES_FOREACH (lane, mask)
+                {
+                    if (cmd->code == CMD_DIV)
+                        ( (int64_t *) top)[lane] /= ( (int64_t *) arg)[lane];
+                    else
+                        ( (int64_t *) top)[lane] %= ( (int64_t *) arg)[lane];
+                }
+
+                ip += cmd->size;
+                break;
+            case CMD_CMP:
+                if ( (stop = (sp == 0) ) )
+                    break;
+
+                lanes_arg (lanes, cmd, mask, arg);
+
+                for (uint64_t v = 0; v < lanes->vecs; v++)
+                {
+                    eq[v] = top[v] == arg[v];
+                    lt[v] = top[v] <  arg[v];
+                }
+
+                ip += cmd->size;
+                break;
+            case CMD_JMP:
+                ip = cmd->arg.vu64;
+                break;
+            case CMD_JE:
+            case CMD_JL:
+            case CMD_JLE:
+                for (uint64_t v = 0; v < lanes->vecs; v++)
+                {
+                    lanes_vec_t taken = (cmd->code == CMD_JE) ? eq[v] : (cmd->code == CMD_JL) ? lt[v] : eq[v] | lt[v];
+
+                    for (uint64_t i = 0; i < LANES_VEC; i++)
+                    {
+                        any |= taken[i] &  vm[v][i];
+                        all &= taken[i] | ~vm[v][i];
+                    }
+                }
+
+                if (all)
+                    ip = cmd->arg.vu64;
+                else if (!any)
+                    ip += cmd->size;
+                else
+                    stop = 1;
+                break;
+            case CMD_CALL:
+                if ( (stop = (spret >= lanes->stksize) ) )
+                    break;
+
+                LANES_FOREACH (lane, mask)
+                    lanes->stkret[spret * lanes->width + lane] = ip + cmd->size;
+
+                spret++;
+                ip = cmd->arg.vu64;
+                break;
+            case CMD_RET:
+                if ( (stop = (spret == 0) ) )
+                    break;
+
+                LANES_FOREACH (lane, mask)
+                    stop |= lanes->stkret[(spret - 1) * lanes->width + lane] !=
+                            lanes->stkret[(spret - 1) * lanes->width + (uint64_t) (first - lanes->lane)];
+
+                if (stop)
+                    break;
+
+                ip = lanes->stkret[--spret * lanes->width + (uint64_t) (first - lanes->lane)];
+                break;
+            case CMD_FENCE:
+                ip += 1;
+                break;
+            default:
+                stop = 1;
+                break;
+        }
+
+        count += !stop;
+    }
+
+    LANES_FOREACH (lane, mask)
+    {
+        struct lanes_lane *cur = &lanes->lane[lane];
+
+        cur->ip    = ip;
+        cur->spint = sp;
+        cur->spret = spret;
+        cur->cmp   = ( (int64_t *) eq)[lane] ? PROC_CMPEQ : ( (int64_t *) lt)[lane] ? PROC_CMPLESS : PROC_CMPGREAT;
+    }
+
+    return count;
+}
+
+static void lanes_step (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask)
+{
+    assert (lanes);
+    assert (cmd);
+
+    switch (cmd->code)
+    {
+        case CMD_PUSH:
+            lanes_push (lanes, cmd, mask);
+            break;
+        case CMD_POP:
+            lanes_pop (lanes, cmd, mask);
+            break;
+        case CMD_ADD:
+        case CMD_SUB:
+        case CMD_MUL:
+            lanes_arith (lanes, cmd, mask);
+            break;
+        case CMD_DIV:
+        case CMD_MOD:
+            lanes_div (lanes, cmd, mask);
+            break;
+        case CMD_CMP:
+            lanes_cmp (lanes, cmd, mask);
+            break;
+        case CMD_JMP:
+        case CMD_JE:
+        case CMD_JL:
+        case CMD_JLE:
+            lanes_jump (lanes, cmd, mask);
+            break;
+        case CMD_CALL:
+            lanes_call (lanes, cmd, mask);
+            break;
+        case CMD_RET:
+            lanes_ret (lanes, mask);
+            break;
+        case CMD_HLT:
+            lanes_advance (lanes, mask, 1);
+
+            LANES_FOREACH (lane, mask)
+                lanes->lane[lane].status = PROC_STHLT;
+            break;
+        case CMD_IN:
+        case CMD_OUT:
+            lanes_io (lanes, cmd, mask);
+            break;
+        case CMD_FENCE:
+            lanes_advance (lanes, mask, 1);
+            break;
+        case CMD_UNKN:
+            lanes_fail (lanes, mask, PROC_ERRUNKN, NULL);
+            break;
+        default:
+            lanes_fail (lanes, mask, PROC_ERRUNKN, "not supported in lanes mode");
+            break;
+    }
+}
+
+/* drops lanes without enough stack; sp is their common stack pointer or UINT64_MAX if they differ */
+static uint64_t lanes_check (lanes_t *lanes, uint64_t mask, uint64_t need, uint64_t room,
+                             enum PROC_ERR err, uint64_t *sp)
+{
+    assert (lanes);
+    assert (sp);
+
+    uint64_t common  = UINT64_MAX;
+    int      uniform = 1;
+
+    LANES_FOREACH (lane, mask)
+    {
+        uint64_t spint = lanes->lane[lane].spint;
+
+        if (spint < need || spint + room > lanes->stksize)
+        {
+            lanes_fail (lanes, (uint64_t) 1 << lane, err, NULL);
+
+            mask &= ~( (uint64_t) 1 << lane);
+        }
+        else if (common == UINT64_MAX)
+            common = spint;
+        else if (common != spint)
+            uniform = 0;
+    }
+
+    *sp = uniform ? common : UINT64_MAX;
+
+    return mask;
+}
+
+static void lanes_fail (lanes_t *lanes, uint64_t mask, enum PROC_ERR err, const char *str)
+{
+    assert (lanes);
+
+    LANES_FOREACH (lane, mask)
+    {
+        lanes->lane[lane].error  = (struct proc_error) {err, str};
+        lanes->lane[lane].status = PROC_STERR;
+    }
+}
+
+static void lanes_advance (lanes_t *lanes, uint64_t mask, uint64_t size)
+{
+    assert (lanes);
+
+    LANES_FOREACH (lane, mask)
+        lanes->lane[lane].ip += size;
+}
+
+static void lanes_mask (lanes_t *lanes, uint64_t mask, lanes_vec_t *vm)
+{
+    assert (lanes);
+    assert (vm);
+
+    for (uint64_t i = 0; i < lanes->width; i++)
+        ( (int64_t *) vm)[i] = (mask >> i & 1) ? -1 : 0;
+}
+
+static void lanes_blend (lanes_t *lanes, lanes_vec_t *dst, const lanes_vec_t *src, const lanes_vec_t *vm)
+{
+    assert (lanes);
+    assert (dst);
+    assert (src);
+    assert (vm);
+
+    for (uint64_t v = 0; v < lanes->vecs; v++)
+        dst[v] = (src[v] & vm[v]) | (dst[v] & ~vm[v]);
+}
+
+static void lanes_arg (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask, lanes_vec_t *arg)
+{
+    assert (lanes);
+    assert (cmd);
+    assert (arg);
+
+    if (cmd->flgreg && cmd->flgmem)
+    {
+        LANES_FOREACH (lane, mask)
+        {
+            uint64_t addr = (uint64_t) LANES_CELL (lanes, lanes->regs, cmd->arg.vu8, lane) & lanes->memmask;
+
+            ( (int64_t *) arg)[lane] = LANES_CELL (lanes, lanes->memory, addr, lane);
+        }
+    }
+    else if (cmd->flgreg)
+        memcpy (arg, LANES_ROW (lanes, lanes->regs, cmd->arg.vu8), lanes->vecs * sizeof (*arg) );
+    else if (cmd->flgmem)
+        memcpy (arg, LANES_ROW (lanes, lanes->memory, cmd->arg.vu64 & lanes->memmask), lanes->vecs * sizeof (*arg) );
+    else
+        for (uint64_t v = 0; v < lanes->vecs; v++)
+            arg[v] = (lanes_vec_t) {} + cmd->arg.v64;
+}
+
+static void lanes_calc (lanes_t *lanes, enum PROC_CMDCODES code, lanes_vec_t *top, const lanes_vec_t *arg,
+                        const lanes_vec_t *vm)
+{
+    assert (lanes);
+    assert (top);
+    assert (arg);
+    assert (vm);
+
+    switch (code)
+    {
+        case CMD_ADD:
+            for (uint64_t v = 0; v < lanes->vecs; v++)
+                top[v] += arg[v] & vm[v];
+            break;
+        case CMD_SUB:
+            for (uint64_t v = 0; v < lanes->vecs; v++)
+                top[v] -= arg[v] & vm[v];
+            break;
+        default:
+            for (uint64_t v = 0; v < lanes->vecs; v++)
+                top[v] = ( (top[v] * arg[v]) & vm[v]) | (top[v] & ~vm[v]);
+            break;
+    }
+}
+
+/* the stack row depth cells below sp, gathered into tmp when the lanes' stacks are out of step */
+static lanes_vec_t *lanes_top (lanes_t *lanes, uint64_t mask, uint64_t sp, uint64_t depth, lanes_vec_t *tmp)
+{
+    assert (lanes);
+    assert (tmp);
+
+    if (sp != UINT64_MAX)
+        return LANES_ROW (lanes, lanes->stkint, sp - depth);
+
+    LANES_FOREACH (lane, mask)
+        ( (int64_t *) tmp)[lane] = LANES_CELL (lanes, lanes->stkint, lanes->lane[lane].spint - depth, lane);
+
+    return tmp;
+}
+
+static void lanes_put (lanes_t *lanes, uint64_t mask, uint64_t sp, uint64_t depth, const lanes_vec_t *row)
+{
+    assert (lanes);
+    assert (row);
+
+    if (sp != UINT64_MAX)
+        return;
+
+    LANES_FOREACH (lane, mask)
+        LANES_CELL (lanes, lanes->stkint, lanes->lane[lane].spint - depth, lane) = ( (const int64_t *) row)[lane];
+}
+
+static void lanes_store (lanes_t *lanes, uint64_t addr, uint64_t lane, int64_t val)
+{
+    assert (lanes);
+
+    addr &= lanes->memmask;
+
+    LANES_CELL (lanes, lanes->memory, addr, lane) = val;
+
+    lanes_mark (lanes, addr);
+}
+
+static void lanes_mark (lanes_t *lanes, uint64_t addr)
+{
+    assert (lanes);
+
+    lanes->memdirty[addr / PROC_PAGECELLS / 64] |= (uint64_t) 1 << (addr / PROC_PAGECELLS % 64);
+}
+
+static void lanes_revert (lanes_t *lanes, uint64_t page)
+{
+    assert (lanes);
+
+    const struct proc_data *data = &lanes->prog->data;
+
+    for (uint64_t addr = page * PROC_PAGECELLS; addr < (page + 1) * PROC_PAGECELLS && addr <= lanes->memmask; addr++)
+    {
+        int64_t      val = (addr < data->size) ? data->data[addr].v64 : 0;
+        lanes_vec_t *row = LANES_ROW (lanes, lanes->memory, addr);
+
+        for (uint64_t v = 0; v < lanes->vecs; v++)
+            row[v] = (lanes_vec_t) {} + val;
+    }
+}
+
+static void lanes_push (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask)
+{
+    assert (lanes);
+    assert (cmd);
+
+    lanes_vec_t  arg[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t  vm [LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t  tmp[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t *row                        = NULL;
+    uint64_t     sp                         = 0;
+
+    mask = lanes_check (lanes, mask, 0, 1, PROC_ERRPUSH, &sp);
+
+    lanes_arg  (lanes, cmd, mask, arg);
+    lanes_mask (lanes, mask, vm);
+
+    row = lanes_top (lanes, mask, sp, 0, tmp);
+
+    lanes_blend (lanes, row, arg, vm);
+    lanes_put   (lanes, mask, sp, 0, row);
+
+    LANES_FOREACH (lane, mask)
+    {
+        lanes->lane[lane].spint++;
+        lanes->lane[lane].ip += cmd->size;
+    }
+}
+
+static void lanes_pop (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask)
+{
+    assert (lanes);
+    assert (cmd);
+
+    lanes_vec_t  vm [LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t  tmp[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t *val                        = NULL;
+    uint64_t     sp                         = 0;
+
+    mask = lanes_check (lanes, mask, 1, 0, PROC_ERRPOP, &sp);
+    val  = lanes_top   (lanes, mask, sp, 1, tmp);
+
+    lanes_mask (lanes, mask, vm);
+
+    if (cmd->flgreg && cmd->flgmem)
+    {
+        LANES_FOREACH (lane, mask)
+            lanes_store (lanes, (uint64_t) LANES_CELL (lanes, lanes->regs, cmd->arg.vu8, lane), lane,
+                         ( (int64_t *) val)[lane]);
+    }
+    else if (cmd->flgreg)
+        lanes_blend (lanes, LANES_ROW (lanes, lanes->regs, cmd->arg.vu8), val, vm);
+    else if (cmd->flgmem && mask)
+    {
+        lanes_blend (lanes, LANES_ROW (lanes, lanes->memory, cmd->arg.vu64 & lanes->memmask), val, vm);
+        lanes_mark  (lanes, cmd->arg.vu64 & lanes->memmask);
+    }
+
+    LANES_FOREACH (lane, mask)
+    {
+        lanes->lane[lane].spint--;
+        lanes->lane[lane].ip += (cmd->flgreg || cmd->flgmem) ? cmd->size : 1;
+    }
+}
+
+static void lanes_arith (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask)
+{
+    assert (lanes);
+    assert (cmd);
+
+    lanes_vec_t  arg[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t  vm [LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t  tmp[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t *top                        = NULL;
+    uint64_t     sp                         = 0;
+
+    mask = lanes_check (lanes, mask, 1, 0, (cmd->code == CMD_ADD) ? PROC_ERRADD :
+                                           (cmd->code == CMD_SUB) ? PROC_ERRSUB : PROC_ERRMUL, &sp);
+
+    lanes_arg  (lanes, cmd, mask, arg);
+    lanes_mask (lanes, mask, vm);
+
+    top = lanes_top (lanes, mask, sp, 1, tmp);
+
+    lanes_calc (lanes, cmd->code, top, arg, vm);
+
+    lanes_put     (lanes, mask, sp, 1, top);
+    lanes_advance (lanes, mask, cmd->size);
+}
+
+static void lanes_div (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask)
+{
+    assert (lanes);
+    assert (cmd);
+
+    lanes_vec_t  arg[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t  tmp[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t *top                        = NULL;
+    uint64_t     sp                         = 0;
+    enum PROC_ERR err                       = (cmd->code == CMD_DIV) ? PROC_ERRDIV : PROC_ERRMOD;
+
+    mask = lanes_check (lanes, mask, 1, 0, err, &sp);
+
+    lanes_arg (lanes, cmd, mask, arg);
+
+    top = lanes_top (lanes, mask, sp, 1, tmp);
+
+    LANES_FOREACH (lane, mask)
+    {
+        int64_t  div = ( (int64_t *) arg)[lane];
+        int64_t *val = &( (int64_t *) top)[lane];
+
+        if (div == 0 || (div == -1 && *val == INT64_MIN) )
+        {
+            lanes_fail (lanes, (uint64_t) 1 << lane, div ? PROC_ERROVERFLOW : PROC_ERRZERO, NULL);
+
+            mask &= ~( (uint64_t) 1 << lane);
+        }
+        else if (cmd->code == CMD_DIV)
+            *val /= div;
+        else
+            *val %= div;
+    }
+
+    lanes_put     (lanes, mask, sp, 1, top);
+    lanes_advance (lanes, mask, cmd->size);
+}
+
+static void lanes_cmp (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask)
+{
+    assert (lanes);
+    assert (cmd);
+
+    lanes_vec_t  arg[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t  tmp[LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t  eq [LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t  lt [LANES_MAX / LANES_VEC] = {};
+    lanes_vec_t *top                        = NULL;
+    uint64_t     sp                         = 0;
+
+    mask = lanes_check (lanes, mask, 1, 0, PROC_ERRCMP, &sp);
+
+    lanes_arg (lanes, cmd, mask, arg);
+
+    top = lanes_top (lanes, mask, sp, 1, tmp);
+
+    for (uint64_t v = 0; v < lanes->vecs; v++)
+    {
+        eq[v] = top[v] == arg[v];
+        lt[v] = top[v] <  arg[v];
+    }
+
+    LANES_FOREACH (lane, mask)
+    {
+        if ( ( (int64_t *) eq)[lane])
+            lanes->lane[lane].cmp = PROC_CMPEQ;
+        else if ( ( (int64_t *) lt)[lane])
+            lanes->lane[lane].cmp = PROC_CMPLESS;
+        else
+            lanes->lane[lane].cmp = PROC_CMPGREAT;
+    }
+
+    lanes_advance (lanes, mask, cmd->size);
+}
+
+static void lanes_jump (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask)
+{
+    assert (lanes);
+    assert (cmd);
+
+    LANES_FOREACH (lane, mask)
+    {
+        struct lanes_lane *cur   = &lanes->lane[lane];
+        int                taken = 0;
+
+        switch (cmd->code)
+        {
+            case CMD_JE:
+                taken = cur->cmp == PROC_CMPEQ;
+                break;
+            case CMD_JL:
+                taken = cur->cmp == PROC_CMPLESS;
+                break;
+            case CMD_JLE:
+                taken = cur->cmp == PROC_CMPLESS || cur->cmp == PROC_CMPEQ;
+                break;
+            default:
+                taken = 1;
+                break;
+        }
+
+        cur->ip = taken ? cmd->arg.vu64 : cur->ip + cmd->size;
+    }
+}
+
+static void lanes_call (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask)
+{
+    assert (lanes);
+    assert (cmd);
+
+    LANES_FOREACH (lane, mask)
+    {
+        struct lanes_lane *cur = &lanes->lane[lane];
+
+        if (cur->spret >= lanes->stksize)
+        {
+            lanes_fail (lanes, (uint64_t) 1 << lane, PROC_ERRCALL, NULL);
+            continue;
+        }
+
+        lanes->stkret[cur->spret++ * lanes->width + lane] = cur->ip + cmd->size;
+
+        cur->ip = cmd->arg.vu64;
+    }
+}
+
+static void lanes_ret (lanes_t *lanes, uint64_t mask)
+{
+    assert (lanes);
+
+    LANES_FOREACH (lane, mask)
+    {
+        struct lanes_lane *cur = &lanes->lane[lane];
+
+        if (cur->spret == 0)
+        {
+            lanes_fail (lanes, (uint64_t) 1 << lane, PROC_ERRRET, NULL);
+            continue;
+        }
+
+        cur->ip = lanes->stkret[--cur->spret * lanes->width + lane];
+    }
+}
+
+static void lanes_io (lanes_t *lanes, const struct proc_cmd *cmd, uint64_t mask)
+{
+    assert (lanes);
+    assert (cmd);
+
+    LANES_FOREACH (lane, mask)
+    {
+        struct lanes_lane *cur = &lanes->lane[lane];
+        int64_t           *r0  = &LANES_CELL (lanes, lanes->regs, 0, lane);
+        int                ret = 0;
+
+        if (!cur->io.input)
+        {
+            lanes_fail (lanes, (uint64_t) 1 << lane, PROC_ERRIO, "lane has no input and output");
+            continue;
+        }
+
+        ret = (cmd->code == CMD_IN) ? cur->io.input (cur->io.ctx, r0) : cur->io.output (cur->io.ctx, *r0);
+
+        if (ret == PROC_IOWAIT)
+            lanes_fail (lanes, (uint64_t) 1 << lane, PROC_ERRIO, "would block");
+        else if (ret)
+            lanes_fail (lanes, (uint64_t) 1 << lane, PROC_ERRIO,
+                        (cmd->code == CMD_IN) ? "input failed" : "output failed");
+        else
+            cur->ip += 1;
+    }
+}
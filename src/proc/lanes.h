@@ -0,0 +1,46 @@
+#ifndef LANES_H_INCLUDED
+#define LANES_H_INCLUDED
+
+#include "processor.h"
+#include <stdint.h>
+
+#define LANES_MAX 0x10
+#define LANES_VEC 0x04
+
+typedef int64_t lanes_vec_t __attribute__ ( (vector_size (LANES_VEC * sizeof (int64_t) ) ) );
+
+struct lanes_lane
+{
+    uint64_t           ip;
+    uint64_t           spint;
+    uint64_t           spret;
+    enum PROC_CMPVAL   cmp;
+    enum PROC_STAT     status;
+    struct proc_error  error;
+    struct proc_io     io;
+};
+
+typedef struct lanes
+{
+    const prog_t       *prog;
+    uint64_t            width;
+    uint64_t            vecs;
+    lanes_vec_t        *memory;
+    uint64_t            memmask;
+    uint64_t            memdirty[PROC_PAGEWORDS];
+    lanes_vec_t        *regs;
+    lanes_vec_t        *stkint;
+    uint64_t           *stkret;
+    uint64_t            stksize;
+    struct lanes_lane   lane[LANES_MAX];
+    struct proc_error   error;
+} lanes_t;
+
+int  lanes_create (lanes_t *lanes, const prog_t *prog, uint64_t width);
+void lanes_setio  (lanes_t *lanes, uint64_t lane, proc_input_t input, proc_output_t output, void *ctx);
+void lanes_reset  (lanes_t *lanes, uint64_t count);
+int  lanes_run    (lanes_t *lanes);
+void lanes_delete (lanes_t *lanes);
+void lanes_error  (lanes_t *lanes);
+
+#endif
@@ -1,28 +1,157 @@
 #include "processor.h"
+#include "batch.h"
+#include "scheduler.h"
+#include "pipeline.h"
+#include "serve.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+enum MAIN_CONSTS
+{
+    MAIN_CLONEBATCH = 0x40,
+    MAIN_MAPCOUNT   = 0x10,
+};
+
+static int    run_clones (proc_t *proc, size_t count, uint64_t budget);
+static size_t run_sched  (proc_t *proc, size_t count, uint64_t budget);
+static int    map_file   (proc_t *proc, char *spec);
+static int    run_batch  (const char *manifest, size_t threads, uint64_t budget, size_t lanes, size_t workers);
+static int    run_pipe   (char **stage, size_t count);
+static int    run_serve  (const char *path, uint64_t budget);
+static int    run_client (const char *path, const char *program);
 
 int main (int argc, char **argv)
 {
-    if (argc != 2)
+    const char *snapshot = NULL;
+    const char *restore  = NULL;
+    char       *map[MAIN_MAPCOUNT] = {};
+    size_t      maps     = 0;
+    size_t      mapped   = 0;
+    const char *manifest = NULL;
+    size_t      clones   = 0;
+    size_t      threads  = 0;
+    uint64_t    budget   = 0;
+    size_t      lanes    = 0;
+    size_t      workers  = 0;
+    int         pipeline = 0;
+    const char *serve    = NULL;
+    const char *client   = NULL;
+    const char *cache    = NULL;
+    int         options  = PROC_OPTLOG;
+    int         opt      = 0;
+
+    while ( (opt = getopt (argc, argv, "qs:r:n:t:m:b:j:l:w:pS:c:C:") ) != -1)
     {
-        fprintf (stderr, "Usage: %s <name of file>\n", argv[0]);
+        switch (opt)
+        {
+            case 'q':
+                options &= ~PROC_OPTLOG;
+                break;
+            case 's':
+                snapshot = optarg;
+                break;
+            case 'r':
+                restore = optarg;
+                break;
+            case 'n':
+                clones = strtoull (optarg, NULL, 0);
+                break;
+            case 't':
+                budget = strtoull (optarg, NULL, 0);
+                break;
+            case 'b':
+                manifest = optarg;
+                break;
+            case 'j':
+                threads = strtoull (optarg, NULL, 0);
+                break;
+            case 'l':
+                lanes = strtoull (optarg, NULL, 0);
+                break;
+            case 'w':
+                workers = strtoull (optarg, NULL, 0);
+                break;
+            case 'p':
+                pipeline = 1;
+                break;
+            case 'S':
+                serve = optarg;
+                break;
+            case 'c':
+                client = optarg;
+                break;
+            case 'C':
+                cache = optarg;
+                break;
+            case 'm':
+                if (maps < MAIN_MAPCOUNT && strrchr (optarg, '@') )
+                    map[maps++] = optarg;
+                else
+                    argc = 0;
+                break;
+            default:
+                argc = 0;
+                break;
+        }
+    }
+
+    if (argc == 0 || (pipeline ? optind >= argc : optind + ( (restore || manifest || serve) ? 0 : 1) != argc) )
+    {
+        fprintf (stderr, "Usage: %s [-q] [-C cache] [-m file@target[:rw]]... [-s snapshot] [-n clones [-t budget]] <name of file>\n"
+                         "       %s [-q] [-m file@target[:rw]]... [-s snapshot] [-n clones [-t budget]] -r <snapshot>\n"
+                         "       %s [-C cache] -b <manifest> [-j threads] [-t budget | -l lanes]\n"
+                         "       %s [-C cache] -b <manifest> -w workers\n"
+                         "       %s [-C cache] -p <name of file>[:replicas]...\n"
+                         "       %s [-C cache] -S <socket> [-t budget]\n"
+                         "       %s -c <socket> <name of file>\n",
+                 argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
 
         return EXIT_FAILURE;
     }
 
+    prog_setcache (cache);
+
+    if (manifest)
+        return run_batch (manifest, threads, budget, lanes, workers);
+
+    if (pipeline)
+        return run_pipe (argv + optind, (size_t) (argc - optind) );
+
+    if (serve)
+        return run_serve (serve, budget);
+
+    if (client)
+        return run_client (client, argv[optind]);
+
     proc_t proc = {};
 
-    do  
+    do
     {
-        if (proc_create (&proc, argv[1]) )
+        if (restore ? proc_restore (&proc, restore, options) :
+                      proc_create (&proc, argv[optind], options) )
+            break;
+
+        while (mapped < maps && !map_file (&proc, map[mapped]) )
+            mapped++;
+
+        if (mapped < maps)
             break;
 
-        if (proc_run (&proc) )
+        /* a restored snapshot is already warm: clone it as it is */
+        if (!(restore && clones) && proc_run (&proc) )
+            break;
+
+        if (snapshot && proc_snapshot (&proc, snapshot) )
+            break;
+
+        if (clones && run_clones (&proc, clones, budget) )
             break;
 
         proc_delete (&proc);
-    
+
         return EXIT_SUCCESS;
     }
     while (0);
@@ -30,7 +159,207 @@ int main (int argc, char **argv)
     proc_error (&proc);
 
     proc_delete (&proc);
-    
+
     return EXIT_FAILURE;
 }
 
+static int run_clones (proc_t *proc, size_t count, uint64_t budget)
+{
+    assert (proc);
+
+    proc_t child[MAIN_CLONEBATCH] = {};
+
+    while (count)
+    {
+        size_t batch = (count < MAIN_CLONEBATCH) ? count : MAIN_CLONEBATCH;
+        size_t done  = 0;
+
+        if (proc_clone (proc, child, batch) )
+            return EXIT_FAILURE;
+
+        if (budget)
+            done = run_sched (child, batch, budget);
+        else
+            for (done = 0; done < batch; done++)
+                if (proc_run (&child[done]) )
+                    break;
+
+        if (done < batch)
+            proc->error = child[done].error;
+
+        for (size_t i = 0; i < batch; i++)
+            proc_delete (&child[i]);
+
+        if (done < batch)
+            return EXIT_FAILURE;
+
+        count -= batch;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static size_t run_sched (proc_t *proc, size_t count, uint64_t budget)
+{
+    assert (proc);
+
+    sched_t sched = {};
+    size_t  done  = 0;
+
+    if (sched_create (&sched, budget) )
+    {
+        proc->error = sched.error;
+
+        return 0;
+    }
+
+    for (done = 0; done < count; done++)
+        if (sched_add (&sched, &proc[done]) )
+            break;
+
+    if (done < count)
+    {
+        proc->error = sched.error;
+
+        sched_delete (&sched);
+
+        return 0;
+    }
+
+    sched_run (&sched);
+    sched_delete (&sched);
+
+    for (done = 0; done < count; done++)
+        if (proc[done].status != PROC_STHLT)
+            break;
+
+    return done;
+}
+
+static int map_file (proc_t *proc, char *spec)
+{
+    assert (proc);
+    assert (spec);
+
+    char   *target = strrchr (spec, '@');
+    size_t  len    = 0;
+    int     flags  = 0;
+
+    assert (target);
+
+    *target++ = '\0';
+    len       = strlen (target);
+
+    if (len > 3 && !strcmp (target + len - 3, ":rw") )
+    {
+        target[len - 3] = '\0';
+        flags          |= PROC_MAPRW;
+    }
+    else if (len > 3 && !strcmp (target + len - 3, ":ro") )
+        target[len - 3] = '\0';
+
+    return proc_mapfile (proc, spec, target, flags);
+}
+
+static int run_batch (const char *manifest, size_t threads, uint64_t budget, size_t lanes, size_t workers)
+{
+    assert (manifest);
+
+    batch_t batch = {};
+    int     ret   = EXIT_FAILURE;
+
+    if (batch_create (&batch, manifest) )
+    {
+        batch_error (&batch);
+
+        return EXIT_FAILURE;
+    }
+
+    batch.threads = threads;
+    batch.budget  = budget;
+    batch.lanes   = lanes;
+    batch.workers = workers;
+
+    ret = batch_run (&batch);
+
+    if (batch.error.err)
+        batch_error (&batch);
+
+    batch_report (&batch, stdout);
+
+    batch_delete (&batch);
+
+    return ret;
+}
+
+static int run_pipe (char **stage, size_t count)
+{
+    assert (stage);
+
+    pipeline_t pipeline = {};
+    int        ret      = EXIT_FAILURE;
+
+    if (pipeline_create (&pipeline, stage, count) )
+    {
+        pipeline_error (&pipeline);
+
+        return EXIT_FAILURE;
+    }
+
+    ret = pipeline_run (&pipeline);
+
+    if (pipeline.error.err)
+        pipeline_error (&pipeline);
+
+    pipeline_delete (&pipeline);
+
+    return ret;
+}
+
+static int run_serve (const char *path, uint64_t budget)
+{
+    assert (path);
+
+    serve_t serve = {};
+    int     ret   = EXIT_FAILURE;
+
+    if (serve_create (&serve, path) )
+    {
+        serve_error (&serve);
+
+        serve_delete (&serve);
+
+        return EXIT_FAILURE;
+    }
+
+    if (budget)
+        serve.budget = budget;
+
+    ret = serve_run (&serve);
+
+    if (serve.error.err)
+        serve_error (&serve);
+
+    serve_delete (&serve);
+
+    return ret;
+}
+
+static int run_client (const char *path, const char *program)
+{
+    assert (path);
+    assert (program);
+
+    serve_t serve = {};
+    int     ret   = EXIT_FAILURE;
+
+    if (!serve_connect (&serve, path) )
+        ret = serve_request (&serve, program, STDIN_FILENO, stdout);
+
+    if (serve.error.err)
+        serve_error (&serve);
+
+    serve_delete (&serve);
+
+    return ret;
+}
@@ -0,0 +1,253 @@
+#include "pipeline.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+static const char *pipeline_strerror (enum PIPELINE_ERR err);
+static int         pipeline_stage    (pipeline_t *pipeline, size_t id, char *spec);
+static void       *pipeline_worker   (void *arg);
+static void        pipeline_leave    (struct pipeline_vm *vm);
+
+int pipeline_create (pipeline_t *pipeline, char **stage, size_t count)
+{
+    assert (pipeline);
+    assert (stage);
+
+    size_t vm = 0;
+
+    memset (pipeline, 0, sizeof (*pipeline) );
+
+    if (!count || count > PIPELINE_MAXSTAGES)
+    {
+        pipeline->error = (struct pipeline_error) {PIPELINE_ERRSTAGE, NULL, "Bad number of stages"};
+        return EXIT_FAILURE;
+    }
+
+    do
+    {
+        for (pipeline->stagecount = 0; pipeline->stagecount < count; pipeline->stagecount++)
+            if (pipeline_stage (pipeline, pipeline->stagecount, stage[pipeline->stagecount]) )
+                break;
+
+        if (pipeline->stagecount < count)
+            break;
+
+        if (pipeline->vmcount > PIPELINE_MAXVMS)
+        {
+            pipeline->error = (struct pipeline_error) {PIPELINE_ERRSTAGE, NULL, "Too many VMs"};
+            break;
+        }
+
+        errno = 0;
+
+        for (size_t i = 0; i + 1 < count; i++)
+            if (chan_create (&pipeline->chan[i], PIPELINE_CHANSIZE,
+                             (pipeline->stage[i].count > 1 || pipeline->stage[i + 1].count > 1) ? CHAN_MPMC : 0,
+                             (uint32_t) pipeline->stage[i].count, (uint32_t) pipeline->stage[i + 1].count) )
+            {
+                pipeline->error = (struct pipeline_error) {PIPELINE_ERRCREATE, NULL, strerror (errno)};
+                break;
+            }
+
+        if (pipeline->error.err)
+            break;
+
+        if (!(pipeline->vm = calloc (pipeline->vmcount, sizeof (*pipeline->vm) ) ) )
+        {
+            pipeline->error = (struct pipeline_error) {PIPELINE_ERRCREATE, NULL, strerror (errno)};
+            break;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            for (size_t j = 0; j < pipeline->stage[i].count; j++, vm++)
+            {
+                struct pipeline_vm *cur = &pipeline->vm[vm];
+
+                if (proc_attach (&cur->proc, &pipeline->stage[i].prog, 0) )
+                {
+                    pipeline->error = (struct pipeline_error) {PIPELINE_ERRCREATE, pipeline->stage[i].name,
+                                                               cur->proc.error.str};
+                    break;
+                }
+
+                cur->chan[PIPELINE_CHANIN]  = i             ? &pipeline->chan[i - 1] : NULL;
+                cur->chan[PIPELINE_CHANOUT] = i + 1 < count ? &pipeline->chan[i]     : NULL;
+                cur->stage                  = i;
+
+                proc_setchan (&cur->proc, cur->chan, PIPELINE_CHANCOUNT);
+            }
+
+        if (pipeline->error.err)
+            break;
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    struct pipeline_error error = pipeline->error;
+
+    pipeline_delete (pipeline);
+
+    pipeline->error = error;
+
+    return EXIT_FAILURE;
+}
+
+int pipeline_run (pipeline_t *pipeline)
+{
+    assert (pipeline);
+    assert (pipeline->vm);
+
+    pthread_t thread[PIPELINE_MAXVMS] = {};
+    size_t    count                   = 0;
+
+    for (count = 1; count < pipeline->vmcount; count++)
+        if (pthread_create (&thread[count], NULL, pipeline_worker, &pipeline->vm[count]) )
+            break;
+
+    if (count < pipeline->vmcount)
+    {
+        pipeline->error = (struct pipeline_error) {PIPELINE_ERRTHREAD, NULL, strerror (errno)};
+
+        for (size_t i = count; i < pipeline->vmcount; i++)
+            pipeline_leave (&pipeline->vm[i]);
+    }
+
+    pipeline_worker (&pipeline->vm[0]);
+
+    for (size_t i = 1; i < count; i++)
+        pthread_join (thread[i], NULL);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        proc_t *proc = &pipeline->vm[i].proc;
+
+        if (proc->status == PROC_STHLT)
+            continue;
+
+        fprintf (stderr, "%s: ", pipeline->stage[pipeline->vm[i].stage].name);
+
+        proc_error (proc);
+
+        pipeline->failed++;
+    }
+
+    return (pipeline->failed || pipeline->error.err) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void pipeline_delete (pipeline_t *pipeline)
+{
+    assert (pipeline);
+
+    for (size_t i = 0; pipeline->vm && i < pipeline->vmcount; i++)
+        if (pipeline->vm[i].proc.prog)
+            proc_delete (&pipeline->vm[i].proc);
+
+    for (size_t i = 0; i + 1 < pipeline->stagecount; i++)
+        chan_delete (&pipeline->chan[i]);
+
+    for (size_t i = 0; i < pipeline->stagecount; i++)
+        prog_delete (&pipeline->stage[i].prog);
+
+    free (pipeline->vm);
+
+    memset (pipeline, 0, sizeof (*pipeline) );
+}
+
+void pipeline_error (pipeline_t *pipeline)
+{
+    assert (pipeline);
+
+    if (pipeline->error.name)
+        fprintf (stderr, "%s: ", pipeline->error.name);
+
+    fprintf (stderr, "%s", pipeline_strerror (pipeline->error.err) );
+
+    if (pipeline->error.str)
+        fprintf (stderr, ": %s", pipeline->error.str);
+
+    fprintf (stderr, "\n");
+}
+
+static const char *pipeline_strerror (enum PIPELINE_ERR err)
+{
+    switch (err)
+    {
+        case PIPELINE_NOERR:
+            return "No errors";
+        case PIPELINE_ERRSTAGE:
+            return "Bad stage";
+        case PIPELINE_ERRPROG:
+            return "Can't read program";
+        case PIPELINE_ERRCREATE:
+            return "Can't create pipeline";
+        case PIPELINE_ERRTHREAD:
+            return "Can't start thread";
+    }
+
+    return "Undefined error";
+}
+
+static int pipeline_stage (pipeline_t *pipeline, size_t id, char *spec)
+{
+    assert (pipeline);
+    assert (spec);
+
+    struct pipeline_stage *stage = &pipeline->stage[id];
+    char                  *colon = strrchr (spec, ':');
+    char                  *end   = NULL;
+
+    stage->name  = spec;
+    stage->count = 1;
+
+    if (colon)
+    {
+        stage->count = strtoull (colon + 1, &end, 0);
+
+        if (end == colon + 1 || *end || !stage->count || stage->count > PIPELINE_MAXVMS)
+        {
+            pipeline->error = (struct pipeline_error) {PIPELINE_ERRSTAGE, spec, "Bad replica count"};
+            return EXIT_FAILURE;
+        }
+
+        *colon = '\0';
+    }
+
+    if (prog_create (&stage->prog, spec) )
+    {
+        pipeline->error = (struct pipeline_error) {PIPELINE_ERRPROG, spec, stage->prog.error.str};
+        return EXIT_FAILURE;
+    }
+
+    pipeline->vmcount += stage->count;
+
+    return EXIT_SUCCESS;
+}
+
+static void *pipeline_worker (void *arg)
+{
+    assert (arg);
+
+    struct pipeline_vm *vm = arg;
+
+    while (!proc_run_budget (&vm->proc, PIPELINE_BUDGET) && vm->proc.status == PROC_STYIELD)
+        sched_yield ();
+
+    pipeline_leave (vm);
+
+    return NULL;
+}
+
+static void pipeline_leave (struct pipeline_vm *vm)
+{
+    assert (vm);
+
+    if (vm->chan[PIPELINE_CHANIN])
+        chan_close (vm->chan[PIPELINE_CHANIN], 0);
+    if (vm->chan[PIPELINE_CHANOUT])
+        chan_close (vm->chan[PIPELINE_CHANOUT], 1);
+}
@@ -0,0 +1,67 @@
+#ifndef PIPELINE_H_INCLUDED
+#define PIPELINE_H_INCLUDED
+
+#include "processor.h"
+#include "chan.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define PIPELINE_MAXSTAGES 0x10
+#define PIPELINE_MAXVMS    0x40
+#define PIPELINE_CHANSIZE  0x1000
+#define PIPELINE_BUDGET    0x10000
+
+enum PIPELINE_CHANS
+{
+    PIPELINE_CHANIN,
+    PIPELINE_CHANOUT,
+    PIPELINE_CHANCOUNT,
+};
+
+enum PIPELINE_ERR
+{
+    PIPELINE_NOERR,
+    PIPELINE_ERRSTAGE,
+    PIPELINE_ERRPROG,
+    PIPELINE_ERRCREATE,
+    PIPELINE_ERRTHREAD,
+};
+
+struct pipeline_stage
+{
+    const char *name;
+    size_t      count;
+    prog_t      prog;
+};
+
+struct pipeline_vm
+{
+    proc_t            proc;
+    struct proc_chan *chan[PIPELINE_CHANCOUNT];
+    size_t            stage;
+};
+
+struct pipeline_error
+{
+    enum PIPELINE_ERR  err;
+    const char        *name;
+    const char        *str;
+};
+
+typedef struct pipeline
+{
+    struct pipeline_stage  stage[PIPELINE_MAXSTAGES];
+    size_t                 stagecount;
+    struct proc_chan       chan[PIPELINE_MAXSTAGES - 1];
+    struct pipeline_vm    *vm;
+    size_t                 vmcount;
+    size_t                 failed;
+    struct pipeline_error  error;
+} pipeline_t;
+
+int  pipeline_create (pipeline_t *pipeline, char **stage, size_t count);
+int  pipeline_run    (pipeline_t *pipeline);
+void pipeline_delete (pipeline_t *pipeline);
+void pipeline_error  (pipeline_t *pipeline);
+
+#endif
@@ -0,0 +1,103 @@
+#include "pool.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+int pool_create (pool_t *pool, const void *data, uint64_t size, size_t count, int options)
+{
+    assert (pool);
+    assert (data || !size);
+
+    memset (pool, 0, sizeof (*pool) );
+
+    if (prog_create_from_buffer (&pool->prog, data, size) )
+    {
+        pool->error = pool->prog.error;
+        return EXIT_FAILURE;
+    }
+
+    pool->procs = calloc (count, sizeof (*pool->procs) );
+    pool->free  = calloc (count, sizeof (*pool->free) );
+
+    if (count && (!pool->procs || !pool->free) )
+    {
+        pool->error = (struct proc_error) {PROC_ERRCREATE, strerror (errno)};
+
+        free (pool->procs);
+        free (pool->free);
+
+        pool->procs = NULL;
+        pool->free  = NULL;
+
+        prog_delete (&pool->prog);
+
+        return EXIT_FAILURE;
+    }
+
+    for (pool->size = 0; pool->size < count; pool->size++)
+    {
+        if (proc_attach (&pool->procs[pool->size], &pool->prog, options) )
+        {
+            struct proc_error error = pool->procs[pool->size].error;
+
+            pool_delete (pool);
+
+            pool->error = error;
+
+            return EXIT_FAILURE;
+        }
+
+        pool->free[pool->count++] = &pool->procs[pool->size];
+    }
+
+    return EXIT_SUCCESS;
+}
+
+proc_t *pool_acquire (pool_t *pool)
+{
+    assert (pool);
+
+    if (!pool->count)
+        return NULL;
+
+    return pool->free[--pool->count];
+}
+
+void pool_release (pool_t *pool, proc_t *proc)
+{
+    assert (pool);
+    assert (proc);
+    assert (proc >= pool->procs && proc < pool->procs + pool->size);
+    assert (pool->count < pool->size);
+
+    proc_reset (proc);
+
+    pool->free[pool->count++] = proc;
+}
+
+void pool_delete (pool_t *pool)
+{
+    assert (pool);
+
+    for (size_t i = 0; i < pool->size; i++)
+        proc_delete (&pool->procs[i]);
+
+    free (pool->procs);
+    free (pool->free);
+
+    prog_delete (&pool->prog);
+
+    memset (pool, 0, sizeof (*pool) );
+}
+
+void pool_error (pool_t *pool)
+{
+    assert (pool);
+
+    proc_t proc = {};
+
+    proc.error = pool->error;
+
+    proc_error (&proc);
+}
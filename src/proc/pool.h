@@ -0,0 +1,24 @@
+#ifndef POOL_H_INCLUDED
+#define POOL_H_INCLUDED
+
+#include "processor.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct proc_pool
+{
+    prog_t             prog;
+    proc_t            *procs;
+    proc_t           **free;
+    size_t             size;
+    size_t             count;
+    struct proc_error  error;
+} pool_t;
+
+int     pool_create  (pool_t *pool, const void *data, uint64_t size, size_t count, int options);
+proc_t *pool_acquire (pool_t *pool);
+void    pool_release (pool_t *pool, proc_t *proc);
+void    pool_delete  (pool_t *pool);
+void    pool_error   (pool_t *pool);
+
+#endif
@@ -1,20 +1,90 @@
+#define _GNU_SOURCE
+
 #include "setup.h"
 #include "processor.h"
+#include "image.h"
+#include "chan.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 static void        proc_seterr   (proc_t *proc, enum PROC_ERR err, const char *str);
 static const char *proc_strerror (enum PROC_ERR err);
+static int         proc_own      (proc_t *proc, prog_t *prog, int options);
+static int         proc_load     (proc_t *proc, int fd, const prog_t *prog);
+static int         proc_put      (int fd, uint64_t offset, const void *data, uint64_t size);
+static void       *proc_alloc    (uint64_t size);
+static void        proc_release  (proc_t *proc);
+static proc_t     *proc_fork     (proc_t *proc, uint64_t ip);
+
+static int         prog_setup    (prog_t *prog, const struct proc_cachekey *key);
+static int         prog_verify   (prog_t *prog);
+static const char *prog_check    (const prog_t *prog, struct proc_code *decoded);
+static int         cache_key     (struct proc_cachekey *key, const char *filename, int fd);
+static int         cache_name    (char *name, size_t size, const struct proc_cachekey *key);
+static int         cache_load    (prog_t *prog, const struct proc_cachekey *key);
+static void        cache_store   (const prog_t *prog, const struct proc_cachekey *key);
+
+static const char *prog_cachedir = NULL;
+
+static int         image_map     (struct proc_image *image, int fd, int flat);
+
+static void mem_store  (proc_t *proc, uint64_t addr, int64_t val);
+static void mem_mark   (proc_t *proc, uint64_t addr);
+static void mem_revert (proc_t *proc, uint64_t page);
+
+static void             *thread_main (void *arg);
+static struct proc_error thread_join (proc_t *proc, uint64_t id);
+static void              thread_reap (proc_t *proc, int stop);
+
+struct pfor_job;
+
+struct pfor_worker
+{
+    uint64_t         range __attribute__ ( (aligned (64) ) );
+    proc_t          *vm;
+    struct pfor_job *job;
+    pthread_t        handle;
+    int64_t          acc;
+    uint8_t          any;
+    uint8_t          started;
+};
+
+struct pfor_job
+{
+    struct pfor_worker *worker;
+    uint64_t            count;
+    uint64_t            base;
+    uint64_t            func;
+    uint8_t             code;
+    uint8_t             failed;
+};
+
+static void    *pfor_main  (void *arg);
+static int      pfor_take  (struct pfor_worker *worker, uint64_t *lo, uint64_t *hi);
+static int      pfor_steal (struct pfor_worker *worker);
+static int      pfor_call  (struct pfor_worker *worker, uint64_t index);
+static uint64_t pfor_cpus  (void);
+
+static int std_input  (void *ctx, int64_t *val);
+static int std_output (void *ctx, int64_t val);
 
 static int  cmd_read  (proc_t *proc);
 static int  cmd_exec  (proc_t *proc);
 static void cmd_log   (proc_t *proc);
 
-static int  unkn_exec (proc_t *proc);
-static void unkn_log  (proc_t *proc);
+static int      unkn_exec  (proc_t *proc);
+static void     unkn_log   (proc_t *proc);
+static uint64_t unkn_check (proc_t *proc, uint8_t *mark);
 
 #define PROC_GEN_CMD(name, CODE, TYPE)\
     static int name##_exec (proc_t *proc);
@@ -30,677 +100,2679 @@ PROC_GEN_CODE
 
 #undef PROC_GEN_CMD
 
+#define PROC_GEN_CMD(name, CODE, TYPE)\
+    static uint64_t name##_check (proc_t *proc, uint8_t *mark);
+
+PROC_GEN_CODE
+
+#undef PROC_GEN_CMD
+
+#define PROC_GEN_CMD(name, CODE, TYPE)\
+    PROC_OP_##name,
+
+enum PROC_OPS
+{
+    PROC_GEN_CODE
+    PROC_OPCOUNT,
+};
+
+#undef PROC_GEN_CMD
+
 static const struct proc_cmdtable_elem
 {
     enum PROC_CMDCODES code;
-    int   (*exec) (proc_t *proc);
-    void  (*log)  (proc_t *proc);
+    int      (*exec)  (proc_t *proc);
+    void     (*log)   (proc_t *proc);
+    uint64_t (*check) (proc_t *proc, uint8_t *mark);
 } cmdtable[PROC_CMDCOUNT] =
 {
     #define PROC_GEN_CMD(name, CODE, TYPE)\
-        {CODE, name##_exec, name##_log},
+        {CODE, name##_exec, name##_log, name##_check},
 
     PROC_GEN_CODE
 
     #undef PROC_GEN_CMD
 
-    {CMD_UNKN, unkn_exec, unkn_log},
+    {CMD_UNKN, unkn_exec, unkn_log, unkn_check},
 };
 
-int proc_create (proc_t *proc, const char *filename)
+int prog_create (prog_t *prog, const char *filename)
 {
-    assert (proc);
+    assert (prog);
     assert (filename);
 
-    FILE *stream = NULL;
-    char *errstr = NULL;
+    struct proc_cachekey  key    = {};
+    const char           *errstr = NULL;
+    int                   cached = 0;
+    int                   fd     = -1;
 
-    memset (proc, 0, sizeof (*proc) );
+    memset (prog, 0, sizeof (*prog) );
 
-    do
+    errno = 0;
+
+    if ( (fd = open (filename, O_RDONLY) ) == -1 || image_map (&prog->image, fd, 0) )
     {
-        errno = 0;
+        errstr = strerror (errno);
 
-        stream = fopen (filename, "r");
+        if (fd != -1)
+            close (fd);
 
-        if (!stream)
-            break;
-        if (fseek (stream, 0, SEEK_END) == -1)
-            break;
-        if ( (proc->code.size = ftell (stream) ) == (uint64_t) -1)
-            break;
-        if (fseek (stream, 0, SEEK_SET) == -1)
-            break;
+        prog_delete (prog);
 
-        proc->code.data = calloc (1, proc->code.size + 0x10);
-        if (!proc->code.data)
-            break;
+        prog->error = (struct proc_error) {PROC_ERRCREATE, errstr};
 
-        if (fread (proc->code.data, 1, proc->code.size, stream) != proc->code.size) 
-        {
-            errstr = "Can't read data from file";
-            break;
-        }
-        if (fclose (stream) == EOF)
-            break;
+        return EXIT_FAILURE;
+    }
 
-        proc->memory = calloc (PROC_MEMSIZE + 1, sizeof (*proc->memory) );
-        if (!proc->memory)
-            break;
+    cached = prog_cachedir && !cache_key (&key, filename, fd);
 
-        proc->stack.stkint = calloc (PROC_STKSIZE + 1, sizeof (*proc->stack.stkint) );
-        if (!proc->stack.stkint)
-            break;
+    close (fd);
 
-        proc->stack.stkret = calloc (PROC_STKSIZE + 1, sizeof (*proc->stack.stkret) );
-        if (!proc->stack.stkret)
-            break;
+    return prog_setup (prog, cached ? &key : NULL);
+}
 
-        proc->log = fopen ("proc.log", "w");
+int prog_create_from_buffer (prog_t *prog, const void *data, uint64_t size)
+{
+    assert (prog);
+    assert (data || !size);
 
-        if (!proc->log)
-            break;
+    void *base = MAP_FAILED;
 
-        return EXIT_SUCCESS;
+    memset (prog, 0, sizeof (*prog) );
+
+    prog->image.size    = size;
+    prog->image.mapsize = ( (size + IMG_PAGESIZE - 1) & ~ (uint64_t) (IMG_PAGESIZE - 1) ) + IMG_PAGESIZE;
+
+    errno = 0;
+
+    base = mmap (NULL, prog->image.mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (base == MAP_FAILED)
+    {
+        prog->error = (struct proc_error) {PROC_ERRCREATE, strerror (errno)};
+        return EXIT_FAILURE;
     }
-    while (0);
-    
-    if (!errstr)
-        errstr = strerror (errno);
 
-    if (stream)
-        fclose (stream);
-    free (proc->code.data);
-    free (proc->memory);
-    free (proc->stack.stkint);
-    free (proc->stack.stkret);
+    prog->image.data = base;
 
-    memset (proc, 0, sizeof (*proc) );
+    if (size)
+        memcpy (base, data, size);
 
-    proc_seterr (proc, PROC_ERRCREATE, errstr);
+    if (mprotect (base, prog->image.mapsize, PROT_READ) == -1)
+    {
+        const char *errstr = strerror (errno);
 
-    return EXIT_FAILURE;
-}
+        prog_delete (prog);
 
-void proc_delete (proc_t *proc)
-{
-    assert (proc);
+        prog->error = (struct proc_error) {PROC_ERRCREATE, errstr};
 
-    if (proc->log)
-        fclose (proc->log);
-    free (proc->code.data);
-    free (proc->memory);
-    free (proc->stack.stkint);
-    free (proc->stack.stkret);
+        return EXIT_FAILURE;
+    }
 
-    memset (proc, 0, sizeof (*proc) );
+    return prog_setup (prog, NULL);
 }
 
-static const char *proc_strerror (enum PROC_ERR err)
+void prog_delete (prog_t *prog)
 {
-    switch (err)
+    assert (prog);
+
+    if (prog->image.data)
+        munmap (prog->image.data, prog->image.mapsize);
+
+    if (prog->cache.data)
+        munmap (prog->cache.data, prog->cache.mapsize);
+    else
     {
-        case PROC_NOERR:
-            return "No error";
-        case PROC_ERRCREATE:
-            return "Creation error";
-        case PROC_ERRIP:
-            return "Bad ip";
-        case PROC_ERRUNKN:
-            return "Unknown command";
-        case PROC_ERRPUSH:
-            return "Can't execute push: stack is full";
-        case PROC_ERRPOP:
-            return "Can't execute pop: stack is empty";
-        case PROC_ERRADD:
-            return "Can't execute add: not enough values in stack";
-        case PROC_ERRSUB:
-            return "Can't execute sub: not enough values in stack";
-        case PROC_ERRMUL:
-            return "Can't execute mul: not enough values in stack";
-        case PROC_ERRDIV:
-            return "Can't execute div: not enough values in stack";
-        case PROC_ERRMOD:
-            return "Can't execute mod: not enough values in stack";
-        case PROC_ERRCMP:
-            return "Can't execute cmp: not enough values in stack";
-        case PROC_ERRCALL:
-            return "Can't execute call: stack is full";
-        case PROC_ERRRET:
-            return "Can't execute ret: stack is empty";
+        free ( (void *) prog->code.decoded);
+        free ( (void *) prog->code.cmdidx);
     }
 
-    return "Undefined error"; 
+    memset (prog, 0, sizeof (*prog) );
 }
 
-void proc_error (proc_t *proc)
+void prog_error (prog_t *prog)
 {
-    assert (proc);
-
-    fprintf (stderr, "%s", proc_strerror (proc->error.err) );
+    assert (prog);
 
-    if (proc->error.str)
-        fprintf (stderr, ": %s", proc->error.str);
-
-    fprintf (stderr, "\n");
+    proc_perror (stderr, &prog->error);
 }
 
-static void proc_seterr (proc_t *proc, enum PROC_ERR err, const char *str)
+void prog_setcache (const char *dir)
 {
-    assert (proc);
-    
-    proc->error.err = err;
-    proc->error.str = str;
-    proc->status    = PROC_STERR;
+    prog_cachedir = dir;
 }
 
-int proc_run (proc_t *proc)
+/* key identifies the image file for the cache; images from a buffer have none */
+static int prog_setup (prog_t *prog, const struct proc_cachekey *key)
 {
-    assert (proc); 
-    
-    proc->status = PROC_STRUN;
+    assert (prog);
+    assert (prog->image.data);
 
-    while (proc->status == PROC_STRUN)
+    const struct img_header *header = prog->image.data;
+    const char              *errstr = NULL;
+
+    if ( (errstr = img_check (header, prog->image.size) ) )
     {
-        if (cmd_read (proc) )
-            break;
+        prog_delete (prog);
 
-        cmd_log (proc);
+        prog->error = (struct proc_error) {PROC_ERRIMAGE, errstr};
 
-        if (cmd_exec (proc) )
-            break;
+        return EXIT_FAILURE;
     }
 
-    return (proc->status == PROC_STHLT) ? EXIT_SUCCESS : EXIT_FAILURE;
-}
-
-static int cmd_read (proc_t *proc)
-{
-    assert (proc);
-    assert (proc->code.data);
+    prog->code.data   = prog->image.data + header->section[IMG_SECCODE].offset;
+    prog->code.size   = header->section[IMG_SECCODE].size;
+    prog->code.ip     = header->entry;
+    prog->data.data   = prog->image.data + header->section[IMG_SECDATA].offset;
+    prog->data.size   = header->section[IMG_SECDATA].size / sizeof (*prog->data.data);
+    prog->symtab.data = prog->image.data + header->section[IMG_SECSYMTAB].offset;
+    prog->symtab.size = header->section[IMG_SECSYMTAB].size / sizeof (*prog->symtab.data);
+    prog->memsize     = header->memsize;
+    prog->stksize     = header->stksize;
+
+    if (key && !cache_load (prog, key) )
+        return EXIT_SUCCESS;
 
-    if (proc->code.ip >= proc->code.size)
+    if (prog_verify (prog) )
     {
-        proc_seterr (proc, PROC_ERRIP, NULL);
-        return EXIT_FAILURE;
-    }
+        struct proc_error error = prog->error;
 
-    proc->cmd.code   = *( (uint8_t *) (proc->code.data + proc->code.ip) );
-    proc->cmd.flgreg = (proc->cmd.code & CMD_FLGREG) ? 1 : 0;
-    proc->cmd.flgmem = (proc->cmd.code & CMD_FLGMEM) ? 1 : 0;
-    proc->cmd.code  &= ~(CMD_FLGREG | CMD_FLGMEM);
-    proc->cmd.arg    = *( (union val *) (proc->code.data + proc->code.ip + 1) );
+        prog_delete (prog);
 
-    for (size_t i = 0; i < PROC_CMDCOUNT && cmdtable[i].exec; i++)
-        if (proc->cmd.code == cmdtable[i].code)
-        {
-            proc->cmd.id = i;
+        prog->error = error;
 
-            return EXIT_SUCCESS;
-        }
-    
-    proc->cmd.code   = CMD_UNKN;
-    proc->cmd.flgreg = 0;
-    proc->cmd.flgmem = 0;
+        return EXIT_FAILURE;
+    }
+
+    if (key)
+        cache_store (prog, key);
 
     return EXIT_SUCCESS;
 }
 
-static int cmd_exec (proc_t *proc)
+int proc_attach (proc_t *proc, const prog_t *prog, int options)
 {
     assert (proc);
-    assert (cmdtable[proc->cmd.id].exec);
-
-    return (proc->cmd.code == CMD_UNKN) ? unkn_exec (proc) : cmdtable[proc->cmd.id].exec (proc);
-}
+    assert (prog);
+    assert (prog->code.data);
 
-static void cmd_log (proc_t *proc)
-{
-    assert (proc);
-    assert (cmdtable[proc->cmd.id].log);
+    const char *errstr = NULL;
 
-    if (proc->cmd.code == CMD_UNKN)
-        unkn_log (proc);
-    else
-        cmdtable[proc->cmd.id].log (proc);
-}
+    memset (proc, 0, sizeof (*proc) );
 
-static int pop_exec (proc_t *proc)
-{
-    assert (proc);
-    assert (proc->memory);
-    assert (proc->stack.spint < PROC_STKSIZE);
+    proc->prog       = prog;
+    proc->code       = prog->code;
+    proc->stack.size = prog->stksize;
+    proc->memmask    = prog->memsize - 1;
+    proc->options    = (uint8_t) options;
+    proc->io         = (struct proc_io) {std_input, std_output, NULL};
 
-    if (proc->stack.spint == 0)
+    do
     {
-        proc_seterr (proc, PROC_ERRPOP, NULL);
+        errno = 0;
 
-        return EXIT_FAILURE;
-    }
+        proc->memory = proc_alloc (prog->memsize * sizeof (*proc->memory) );
+        if (!proc->memory)
+            break;
 
-    proc->stack.spint--;
+        memcpy (proc->memory, prog->data.data, prog->data.size * sizeof (*proc->memory) );
 
-    if (proc->cmd.flgreg)
-    {
-        if (proc->cmd.flgmem)
-            proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE].v64 = proc->stack.stkint[proc->stack.spint];
-        else
-            proc->regs[proc->cmd.arg.vu8].v64 = proc->stack.stkint[proc->stack.spint];
+        proc->stack.stkint = proc_alloc (proc->stack.size * sizeof (*proc->stack.stkint) );
+        if (!proc->stack.stkint)
+            break;
 
-        proc->code.ip += 2;
-    }
-    else
-    {
-        if (proc->cmd.flgmem)
-        {
-            proc->memory[proc->cmd.arg.vu64 % PROC_MEMSIZE].v64 = proc->stack.stkint[proc->stack.spint];
-            proc->code.ip += 9;
-        }
-        else
-            proc->code.ip += 1;
+        proc->stack.stkret = proc_alloc (proc->stack.size * sizeof (*proc->stack.stkret) );
+        if (!proc->stack.stkret)
+            break;
+
+        if ( (options & PROC_OPTLOG) && !(proc->log = fopen ("proc.log", "w") ) )
+            break;
+
+        return EXIT_SUCCESS;
     }
+    while (0);
 
-    return EXIT_SUCCESS;
+    errstr = strerror (errno);
+
+    proc_release (proc);
+
+    proc_seterr (proc, PROC_ERRCREATE, errstr);
+
+    return EXIT_FAILURE;
 }
 
-static int push_exec (proc_t *proc)
+int proc_create (proc_t *proc, const char *filename, int options)
 {
     assert (proc);
-    assert (proc->memory);
+    assert (filename);
 
-    if (proc->stack.spint >= PROC_STKSIZE)
-    {
-        proc_seterr (proc, PROC_ERRPUSH, NULL);
+    prog_t *prog = calloc (1, sizeof (*prog) );
 
-        return EXIT_FAILURE;
-    }
+    memset (proc, 0, sizeof (*proc) );
 
-    if (proc->cmd.flgreg)
+    if (!prog)
     {
-        if (proc->cmd.flgmem)
-            proc->stack.stkint[proc->stack.spint] = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE].v64;
-        else
-            proc->stack.stkint[proc->stack.spint] = proc->regs[proc->cmd.arg.vu8].v64;
-
-        proc->code.ip += 2;
+        proc_seterr (proc, PROC_ERRCREATE, strerror (errno) );
+        return EXIT_FAILURE;
     }
-    else
-    {
-        if (proc->cmd.flgmem)
-            proc->stack.stkint[proc->stack.spint] = proc->memory[proc->cmd.arg.vu64 % PROC_MEMSIZE].v64;
-        else
-            proc->stack.stkint[proc->stack.spint] = proc->cmd.arg.v64;
 
-        proc->code.ip += 9;
+    if (prog_create (prog, filename) )
+    {
+        proc_seterr (proc, prog->error.err, prog->error.str);
+        free (prog);
+        return EXIT_FAILURE;
     }
 
-    proc->stack.spint++;
-
-    return EXIT_SUCCESS;
+    return proc_own (proc, prog, options);
 }
 
-static int add_exec (proc_t *proc)
+int proc_create_from_buffer (proc_t *proc, const void *data, uint64_t size, int options)
 {
     assert (proc);
-    assert (proc->stack.spint < PROC_STKSIZE);
+    assert (data || !size);
 
-    if (proc->stack.spint == 0)
+    prog_t *prog = calloc (1, sizeof (*prog) );
+
+    memset (proc, 0, sizeof (*proc) );
+
+    if (!prog)
     {
-        proc_seterr (proc, PROC_ERRADD, NULL);
+        proc_seterr (proc, PROC_ERRCREATE, strerror (errno) );
+        return EXIT_FAILURE;
+    }
 
+    if (prog_create_from_buffer (prog, data, size) )
+    {
+        proc_seterr (proc, prog->error.err, prog->error.str);
+        free (prog);
         return EXIT_FAILURE;
     }
 
-    int64_t arg = 0;
+    return proc_own (proc, prog, options);
+}
+
+static int proc_own (proc_t *proc, prog_t *prog, int options)
+{
+    assert (proc);
+    assert (prog);
+
+    if (proc_attach (proc, prog, options) )
+    {
+        prog_delete (prog);
+        free (prog);
+        return EXIT_FAILURE;
+    }
+
+    proc->own = prog;
+
+    return EXIT_SUCCESS;
+}
+
+int proc_restore (proc_t *proc, const char *filename, int options)
+{
+    assert (proc);
+    assert (filename);
+
+    int fd = -1;
+
+    memset (proc, 0, sizeof (*proc) );
+
+    errno = 0;
+
+    if ( (fd = open (filename, O_RDONLY) ) == -1)
+    {
+        proc_seterr (proc, PROC_ERRCREATE, strerror (errno) );
+        return EXIT_FAILURE;
+    }
+
+    if (proc_load (proc, fd, NULL) )
+    {
+        close (fd);
+        return EXIT_FAILURE;
+    }
+
+    close (fd);
+
+    proc->options = (uint8_t) options;
+
+    if ( (options & PROC_OPTLOG) && !(proc->log = fopen ("proc.log", "w") ) )
+    {
+        const char *errstr = strerror (errno);
+
+        proc_release (proc);
+        proc_seterr (proc, PROC_ERRCREATE, errstr);
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int proc_clone (proc_t *proc, proc_t *clone, size_t count)
+{
+    assert (proc);
+    assert (proc->prog);
+    assert (clone || !count);
+
+    struct snap_header  header = {};
+    const char         *errstr = NULL;
+    uint64_t            size   = 0;
+    size_t              done   = 0;
+    int                 fd     = -1;
+
+    header.ip      = proc->code.ip;
+    header.cmp     = proc->cmp;
+    header.spint   = proc->stack.spint;
+    header.spret   = proc->stack.spret;
+    header.memsize = proc->memmask + 1;
+    header.stksize = proc->stack.size;
+
+    memcpy (header.regs, proc->regs, sizeof (header.regs) );
+
+    header.section[SNAP_SECCODE].size   = proc->code.size;
+    header.section[SNAP_SECSYMTAB].size = proc->prog->symtab.size * sizeof (*proc->prog->symtab.data);
+
+    size = snap_layout (&header);
+
+    errno = 0;
+
+    do
+    {
+        if ( (fd = memfd_create ("proc", MFD_CLOEXEC) ) == -1)
+            break;
+
+        if (ftruncate (fd, (off_t) size) == -1)
+            break;
+
+        if (proc_put (fd, 0, &header, sizeof (header) ) ||
+            proc_put (fd, header.section[SNAP_SECCODE].offset, proc->code.data, proc->code.size) ||
+            proc_put (fd, header.section[SNAP_SECSYMTAB].offset, proc->prog->symtab.data,
+                      header.section[SNAP_SECSYMTAB].size) ||
+            proc_put (fd, header.section[SNAP_SECMEM].offset, proc->memory,
+                      header.section[SNAP_SECMEM].size) ||
+            proc_put (fd, header.section[SNAP_SECSTKINT].offset, proc->stack.stkint,
+                      proc->stack.spint * sizeof (*proc->stack.stkint) ) ||
+            proc_put (fd, header.section[SNAP_SECSTKRET].offset, proc->stack.stkret,
+                      proc->stack.spret * sizeof (*proc->stack.stkret) ) )
+            break;
+
+        for (done = 0; done < count; done++)
+            if (proc_load (&clone[done], fd, proc->prog) )
+                break;
+            else
+                clone[done].io = proc->io;
+
+        if (done < count)
+        {
+            errstr = clone[done].error.str;
+            break;
+        }
+
+        close (fd);
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    if (!errstr)
+        errstr = strerror (errno);
+
+    proc_seterr (proc, PROC_ERRCLONE, errstr);
+
+    while (done)
+        proc_delete (&clone[--done]);
+
+    if (fd != -1)
+        close (fd);
+
+    return EXIT_FAILURE;
+}
+
+int proc_mapfile (proc_t *proc, const char *filename, const char *target, int flags)
+{
+    assert (proc);
+    assert (proc->memory);
+    assert (filename);
+    assert (target);
+
+    const char  *errstr = NULL;
+    char        *end    = NULL;
+    struct stat  st     = {};
+    uint64_t     addr   = 0;
+    uint64_t     limit  = 0;
+    uint64_t     size   = 0;
+    int          fd     = -1;
+
+    errno = 0;
+
+    do
+    {
+        addr  = strtoull (target, &end, 0);
+        limit = ( ( (proc->memmask + 1) * sizeof (*proc->memory) + IMG_PAGESIZE - 1) &
+                  ~ (uint64_t) (IMG_PAGESIZE - 1) );
+
+        if (end == target || *end)
+        {
+            const struct obj_sym *sym = NULL;
+
+            const struct proc_symtab *symtab = &proc->prog->symtab;
+
+            for (uint64_t i = 0; !sym && i < symtab->size; i++)
+                if (symtab->data[i].type == OBJ_SYMRES &&
+                    !strncmp (symtab->data[i].name, target, OBJ_NAMESIZE) )
+                    sym = &symtab->data[i];
+
+            if (!sym)
+            {
+                errstr = "Unknown target";
+                break;
+            }
+
+            addr = sym->value;
+
+            if (sym->value + sym->size <= proc->memmask)
+                limit = (sym->value + sym->size) * sizeof (*proc->memory);
+        }
+        else if (addr > proc->memmask)
+        {
+            errstr = "Target out of memory";
+            break;
+        }
+
+        if ( (addr * sizeof (*proc->memory) ) % IMG_PAGESIZE)
+        {
+            errstr = "Target is not page-aligned";
+            break;
+        }
+
+        if ( (fd = open (filename, (flags & PROC_MAPRW) ? O_RDWR : O_RDONLY) ) == -1)
+            break;
+
+        if (fstat (fd, &st) == -1)
+            break;
+
+        size  = ( (uint64_t) st.st_size + IMG_PAGESIZE - 1) & ~ (uint64_t) (IMG_PAGESIZE - 1);
+        limit = limit - addr * sizeof (*proc->memory);
+
+        if (!size || size > limit)
+        {
+            errstr = size ? "File does not fit the target" : "Empty file";
+            break;
+        }
+
+        if (mmap ( (void *) proc->memory + addr * sizeof (*proc->memory), size, PROT_READ | PROT_WRITE,
+                  MAP_FIXED | ( (flags & PROC_MAPRW) ? MAP_SHARED : MAP_PRIVATE), fd, 0) == MAP_FAILED)
+            break;
+
+        for (uint64_t page = addr / PROC_PAGECELLS; page < (addr * sizeof (*proc->memory) + size) / IMG_PAGESIZE; page++)
+        {
+            uint64_t bit = (uint64_t) 1 << (page % 64);
+
+            proc->memfile[page / 64] |= bit;
+
+            if (flags & PROC_MAPRW)
+                proc->memshared[page / 64] |= bit;
+            else
+                proc->memshared[page / 64] &= ~bit;
+        }
+
+        close (fd);
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    if (!errstr)
+        errstr = strerror (errno);
+
+    if (fd != -1)
+        close (fd);
+
+    proc_seterr (proc, PROC_ERRMAP, errstr);
+
+    return EXIT_FAILURE;
+}
+
+static int proc_load (proc_t *proc, int fd, const prog_t *prog)
+{
+    assert (proc);
+    assert (fd != -1);
+
+    char                     *errstr = NULL;
+    const struct snap_header *header = NULL;
+    enum PROC_ERR             err    = PROC_ERRCREATE;
+
+    memset (proc, 0, sizeof (*proc) );
+
+    do
+    {
+        errno = 0;
+
+        if (image_map (&proc->image, fd, 1) )
+            break;
+
+        header = proc->image.data;
+
+        if ( (errstr = (char *) snap_check (header, proc->image.size) ) )
+        {
+            err = PROC_ERRIMAGE;
+            break;
+        }
+
+        if (header->cmp > PROC_CMPLESS)
+        {
+            errstr = "Bad comparison flag";
+            err    = PROC_ERRIMAGE;
+            break;
+        }
+
+        assert (proc->image.flat);
+
+        if (!prog)
+        {
+            if (!(proc->own = calloc (1, sizeof (*proc->own) ) ) )
+                break;
+
+            proc->own->code.data   = proc->image.data + header->section[SNAP_SECCODE].offset;
+            proc->own->code.size   = header->section[SNAP_SECCODE].size;
+            proc->own->symtab.data = proc->image.data + header->section[SNAP_SECSYMTAB].offset;
+            proc->own->symtab.size = header->section[SNAP_SECSYMTAB].size / sizeof (*proc->own->symtab.data);
+            proc->own->memsize     = header->memsize;
+            proc->own->stksize     = header->stksize;
+
+            if (prog_verify (proc->own) )
+            {
+                errstr = (char *) proc->own->error.str;
+                err    = proc->own->error.err;
+                break;
+            }
+
+            prog = proc->own;
+        }
+
+        if (mprotect (proc->image.data, header->section[SNAP_SECMEM].offset, PROT_READ) == -1)
+            break;
+
+        proc->prog         = prog;
+        proc->code         = prog->code;
+        proc->memory       = proc->image.data + header->section[SNAP_SECMEM].offset;
+        proc->memmask      = header->memsize - 1;
+        proc->stack.stkint = proc->image.data + header->section[SNAP_SECSTKINT].offset;
+        proc->stack.stkret = proc->image.data + header->section[SNAP_SECSTKRET].offset;
+        proc->stack.size   = header->stksize;
+
+        memcpy (proc->regs, header->regs, sizeof (proc->regs) );
+
+        proc->code.ip      = header->ip;
+        proc->cmp          = (enum PROC_CMPVAL) header->cmp;
+        proc->stack.spint  = header->spint;
+        proc->stack.spret  = header->spret;
+        proc->stack.inthwm = header->spint;
+        proc->stack.rethwm = header->spret;
+        proc->io           = (struct proc_io) {std_input, std_output, NULL};
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    if (!errstr)
+        errstr = strerror (errno);
+
+    proc_release (proc);
+
+    proc_seterr (proc, err, errstr);
+
+    return EXIT_FAILURE;
+}
+
+static int proc_put (int fd, uint64_t offset, const void *data, uint64_t size)
+{
+    assert (data || !size);
+
+    while (size)
+    {
+        ssize_t count = pwrite (fd, data, size, (off_t) offset);
+
+        if (count <= 0)
+            return EXIT_FAILURE;
+
+        data   += count;
+        offset += (uint64_t) count;
+        size   -= (uint64_t) count;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int proc_snapshot (proc_t *proc, const char *filename)
+{
+    assert (proc);
+    assert (filename);
+    assert (proc->prog);
+
+    struct snap_header  header                 = {};
+    const void         *section[SNAP_SECCOUNT] = {proc->code.data, proc->prog->symtab.data, proc->memory,
+                                                  proc->stack.stkint, proc->stack.stkret};
+    FILE               *stream                 = NULL;
+
+    header.ip      = proc->code.ip;
+    header.cmp     = proc->cmp;
+    header.spint   = proc->stack.spint;
+    header.spret   = proc->stack.spret;
+    header.memsize = proc->memmask + 1;
+    header.stksize = proc->stack.size;
+
+    memcpy (header.regs, proc->regs, sizeof (header.regs) );
+
+    header.section[SNAP_SECCODE].size   = proc->code.size;
+    header.section[SNAP_SECSYMTAB].size = proc->prog->symtab.size * sizeof (*proc->prog->symtab.data);
+
+    errno = 0;
+
+    do
+    {
+        if (!(stream = fopen (filename, "wb") ) )
+            break;
+
+        if (snap_write (stream, &header, section) )
+            break;
+
+        if (fclose (stream) )
+        {
+            stream = NULL;
+            break;
+        }
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    if (stream)
+        fclose (stream);
+
+    proc_seterr (proc, PROC_ERRSNAP, errno ? strerror (errno) : NULL);
+
+    return EXIT_FAILURE;
+}
+
+static int image_map (struct proc_image *image, int fd, int flat)
+{
+    assert (image);
+    assert (fd != -1);
+
+    struct stat  st   = {};
+    void        *base = MAP_FAILED;
+
+    do
+    {
+        if (fstat (fd, &st) == -1)
+            break;
+
+        image->size    = (uint64_t) st.st_size;
+        image->mapsize = (image->size + IMG_PAGESIZE - 1) & ~ (uint64_t) (IMG_PAGESIZE - 1);
+
+        if (flat && image->size > IMG_PAGESIZE)
+        {
+            base = mmap (NULL, image->mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+            if (base == MAP_FAILED)
+                break;
+
+            image->data = base;
+            image->flat = 1;
+
+            return EXIT_SUCCESS;
+        }
+
+        image->mapsize += IMG_PAGESIZE;
+
+        base = mmap (NULL, image->mapsize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (base == MAP_FAILED)
+            break;
+
+        if (image->size &&
+            mmap (base, image->size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+            break;
+
+        image->data = base;
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    if (base != MAP_FAILED)
+        munmap (base, image->mapsize);
+
+    return EXIT_FAILURE;
+}
+
+static void *proc_alloc (uint64_t size)
+{
+    void *data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    return (data == MAP_FAILED) ? NULL : data;
+}
+
+static void proc_release (proc_t *proc)
+{
+    assert (proc);
+
+    thread_reap (proc, 1);
+
+    if (proc->log)
+        fclose (proc->log);
+    if (proc->image.data)
+        munmap (proc->image.data, proc->image.mapsize);
+    if (proc->memory && !proc->image.flat && !proc->parent)
+        munmap (proc->memory, (proc->memmask + 1) * sizeof (*proc->memory) );
+    if (proc->stack.stkint && !proc->image.flat)
+        munmap (proc->stack.stkint, proc->stack.size * sizeof (*proc->stack.stkint) );
+    if (proc->stack.stkret && !proc->image.flat)
+        munmap (proc->stack.stkret, proc->stack.size * sizeof (*proc->stack.stkret) );
+
+    if (proc->own)
+    {
+        prog_delete (proc->own);
+        free (proc->own);
+    }
+
+    memset (proc, 0, sizeof (*proc) );
+}
+
+static proc_t *proc_fork (proc_t *proc, uint64_t ip)
+{
+    assert (proc);
+
+    proc_t *child = calloc (1, sizeof (*child) );
+    int     err   = 0;
+
+    if (!child)
+        return NULL;
+
+    child->prog       = proc->prog;
+    child->code       = proc->code;
+    child->code.ip    = ip;
+    child->stack.size = proc->stack.size;
+    child->memory     = proc->memory;
+    child->memmask    = proc->memmask;
+    child->cmp        = proc->cmp;
+    child->io         = proc->io;
+    child->chan       = proc->chan;
+    child->chancount  = proc->chancount;
+    child->parent     = proc;
+
+    memcpy (child->regs, proc->regs, sizeof (child->regs) );
+
+    if (!(child->stack.stkint = proc_alloc (child->stack.size * sizeof (*child->stack.stkint) ) ) ||
+        !(child->stack.stkret = proc_alloc (child->stack.size * sizeof (*child->stack.stkret) ) ) )
+    {
+        err = errno;
+
+        proc_release (child);
+        free (child);
+
+        errno = err;
+
+        return NULL;
+    }
+
+    return child;
+}
+
+/* the decoded table takes 16 bytes per command and 2 bits per code byte of private memory, once per program;
+   with prog_setcache it is a file mapping shared between processes instead */
+static int prog_verify (prog_t *prog)
+{
+    assert (prog);
+    assert (prog->code.data);
+
+    const char *errstr = NULL;
+
+    if ( (errstr = prog_check (prog, &prog->code) ) )
+    {
+        prog->error = (struct proc_error) {PROC_ERRIMAGE, errstr};
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* walks the commands from ip 0 and checks their operands, the jump targets, the entry point and the symbols;
+   the commands are decoded from the code into decoded, one entry per command and a bit per code byte for the
+   ips they start at */
+static const char *prog_check (const prog_t *prog, struct proc_code *decoded)
+{
+    assert (prog);
+    assert (decoded);
+
+    proc_t              proc    = {};
+    struct proc_code    code    = prog->code;
+    uint64_t            words   = prog->code.size / PROC_IDXBITS + 1;
+    uint8_t            *mark    = calloc (prog->code.size + 1, sizeof (*mark) );
+    struct proc_cmdidx *cmdidx  = calloc (words, sizeof (*cmdidx) );
+    struct proc_cmd    *cmds    = NULL;
+    struct proc_cmd    *grown   = NULL;
+    const char         *errstr  = (mark && cmdidx) ? NULL : strerror (errno);
+    uint64_t            count   = 0;
+    uint64_t            room    = 0;
+    uint64_t            size    = 0;
+
+    proc.code         = prog->code;
+    proc.code.decoded = NULL;
+    proc.code.cmdidx  = NULL;
+    proc.memmask      = prog->memsize - 1;
+
+    for (uint64_t ip = 0; !errstr && ip < proc.code.size; ip += size)
+    {
+        proc.code.ip = ip;
+
+        cmd_read (&proc);
+
+        size = (proc.cmd.code == CMD_UNKN) ? unkn_check (&proc, &mark[ip]) :
+                                             cmdtable[proc.cmd.id].check (&proc, &mark[ip]);
+
+        if (!size)
+            errstr = "Bad command";
+        else if (size > proc.code.size - ip)
+            errstr = "Truncated command";
+
+        mark[ip] |= PROC_MARKCMD;
+
+        cmdidx[ip / PROC_IDXBITS].starts |= (uint64_t) 1 << ip % PROC_IDXBITS;
+
+        if (count == room)
+        {
+            room = room ? room * 2 : PROC_IDXBITS;
+
+            if ( (grown = realloc (cmds, room * sizeof (*cmds) ) ) )
+                cmds = grown;
+            else
+                errstr = strerror (errno);
+        }
+
+        if (!errstr)
+            cmds[count] = proc.cmd;
+
+        count++;
+    }
+
+    for (uint64_t i = 0, base = 0; !errstr && i < words; i++)
+    {
+        cmdidx[i].base  = base;
+        base           += (uint64_t) __builtin_popcountll (cmdidx[i].starts);
+    }
+
+    code.decoded  = cmds;
+    code.cmdidx   = cmdidx;
+    code.cmdcount = count;
+
+    for (uint64_t ip = 0; !errstr && ip < proc.code.size; ip++)
+    {
+        uint64_t target = 0;
+
+        if (!(mark[ip] & PROC_MARKJMP) )
+            continue;
+
+        target = proc_decoded (&code, ip)->arg.vu64;
+
+        if (target >= proc.code.size || !(mark[target] & PROC_MARKCMD) )
+            errstr = "Bad jump target";
+    }
+
+    if (!errstr && !(mark[prog->code.ip] & PROC_MARKCMD) )
+        errstr = "Bad entry point";
+
+    for (uint64_t i = 0; !errstr && i < prog->symtab.size; i++)
+    {
+        const struct obj_sym *sym = &prog->symtab.data[i];
+
+        if (!memchr (sym->name, '\0', OBJ_NAMESIZE) || sym->type > OBJ_SYMRES)
+            errstr = "Bad symbol";
+        else if (sym->type == OBJ_SYMRES && (sym->value > proc.memmask || sym->size > proc.memmask + 1 - sym->value) )
+            errstr = "Bad symbol";
+        else if (sym->type != OBJ_SYMRES && sym->value > proc.code.size)
+            errstr = "Bad symbol";
+    }
+
+    free (mark);
+
+    if (errstr)
+    {
+        free (cmds);
+        free (cmdidx);
+
+        return errstr;
+    }
+
+    /* the table only grows by doubling, so give back the tail */
+    if ( (grown = realloc (cmds, count * sizeof (*cmds) ) ) )
+        cmds = grown;
+
+    decoded->decoded  = cmds;
+    decoded->cmdidx   = cmdidx;
+    decoded->cmdcount = count;
+
+    return NULL;
+}
+
+/* an image file is known by its canonical path, its inode, size and change times, so a hit reads neither
+   the image nor the table; the path names the entry, so a rebuilt image replaces the entry of the old one */
+static int cache_key (struct proc_cachekey *key, const char *filename, int fd)
+{
+    assert (key);
+    assert (filename);
+
+    char        path[PATH_MAX] = "";
+    struct stat st             = {};
+
+    if (!realpath (filename, path) || fstat (fd, &st) == -1)
+        return EXIT_FAILURE;
+
+    key->path = 0xcbf29ce484222325;
+
+    for (const char *c = path; *c; c++)
+    {
+        key->path ^= (uint8_t) *c;
+        key->path *= 0x100000001b3;
+    }
+
+    key->dev      = (uint64_t) st.st_dev;
+    key->ino      = (uint64_t) st.st_ino;
+    key->size     = (uint64_t) st.st_size;
+    key->mtime[0] = st.st_mtim.tv_sec;
+    key->mtime[1] = st.st_mtim.tv_nsec;
+    key->ctime[0] = st.st_ctim.tv_sec;
+    key->ctime[1] = st.st_ctim.tv_nsec;
+
+    return EXIT_SUCCESS;
+}
+
+static int cache_name (char *name, size_t size, const struct proc_cachekey *key)
+{
+    assert (name);
+    assert (key);
+    assert (prog_cachedir);
+
+    return snprintf (name, size, "%s/%016llx", prog_cachedir, (unsigned long long) key->path) >= (int) size ?
+           EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* cache entry: header, the command start bits, then the decoded commands, one per command; the table was
+   checked by prog_verify before it was stored, so a hit only maps the entry and compares the header,
+   and an entry left by an older image or build is removed */
+static int cache_load (prog_t *prog, const struct proc_cachekey *key)
+{
+    assert (prog);
+    assert (key);
+
+    char                         name[PATH_MAX] = "";
+    struct stat                  st             = {};
+    const struct proc_cachehdr  *entry          = MAP_FAILED;
+    struct proc_code             cached         = prog->code;
+    uint64_t                     words          = prog->code.size / PROC_IDXBITS + 1;
+    uint64_t                     size           = 0;
+    int                          fd             = -1;
+
+    if (cache_name (name, sizeof (name), key) || (fd = open (name, O_RDONLY | O_CLOEXEC) ) == -1)
+        return EXIT_FAILURE;
+
+    if (!fstat (fd, &st) && (uint64_t) st.st_size >= sizeof (*entry) )
+    {
+        size  = (uint64_t) st.st_size;
+        entry = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    close (fd);
+
+    if (entry == MAP_FAILED)
+    {
+        unlink (name);
+
+        return EXIT_FAILURE;
+    }
+
+    cached.cmdidx   = (const struct proc_cmdidx *) (entry + 1);
+    cached.decoded  = (const struct proc_cmd *) (cached.cmdidx + words);
+    cached.cmdcount = entry->cmdcount;
+
+    if (entry->magic != PROC_CACHEMAGIC || entry->version != PROC_CACHEVERSION ||
+        memcmp (&entry->key, key, sizeof (*key) ) || entry->codesize != prog->code.size ||
+        entry->cmdcount > prog->code.size || entry->cmdsize != sizeof (*cached.decoded) ||
+        entry->opcount != PROC_OPCOUNT ||
+        size != sizeof (*entry) + words * sizeof (*cached.cmdidx) + entry->cmdcount * sizeof (*cached.decoded) )
+    {
+        munmap ( (void *) entry, size);
+        unlink (name);
+
+        return EXIT_FAILURE;
+    }
+
+    prog->cache = (struct proc_image) {(void *) entry, size, size, 0};
+    prog->code  = cached;
+
+    return EXIT_SUCCESS;
+}
+
+static void cache_store (const prog_t *prog, const struct proc_cachekey *key)
+{
+    assert (prog);
+    assert (key);
+    assert (prog->code.decoded);
+    assert (prog_cachedir);
+
+    char                  name[PATH_MAX] = "";
+    char                  temp[PATH_MAX] = "";
+    struct proc_cachehdr  entry          = {};
+    uint64_t              words          = prog->code.size / PROC_IDXBITS + 1;
+    uint64_t              count          = prog->code.cmdcount;
+    FILE                 *stream         = NULL;
+    int                   fd             = -1;
+    int                   ok             = 0;
+
+    entry.magic     = PROC_CACHEMAGIC;
+    entry.version   = PROC_CACHEVERSION;
+    entry.key       = *key;
+    entry.codesize  = prog->code.size;
+    entry.cmdcount  = count;
+    entry.cmdsize   = sizeof (*prog->code.decoded);
+    entry.opcount   = PROC_OPCOUNT;
+
+    if (cache_name (name, sizeof (name), key) ||
+        snprintf (temp, sizeof (temp), "%s/.tmpXXXXXX", prog_cachedir) >= (int) sizeof (temp) )
+        return;
+
+    if (mkdir (prog_cachedir, 0777) == -1 && errno != EEXIST)
+        return;
+
+    if ( (fd = mkstemp (temp) ) == -1)
+        return;
+
+    if (!(stream = fdopen (fd, "w") ) )
+    {
+        close (fd);
+        unlink (temp);
+
+        return;
+    }
+
+    ok = fwrite (&entry, sizeof (entry), 1, stream) == 1 &&
+         fwrite (prog->code.cmdidx, sizeof (*prog->code.cmdidx), words, stream) == words &&
+         fwrite (prog->code.decoded, sizeof (*prog->code.decoded), count, stream) == count;
+
+    /* a failed store only costs the next load a verification pass */
+    if (fclose (stream) == EOF || !ok || rename (temp, name) == -1)
+        unlink (temp);
+}
+
+void proc_delete (proc_t *proc)
+{
+    assert (proc);
+
+    proc_release (proc);
+}
+
+static const char *proc_strerror (enum PROC_ERR err)
+{
+    switch (err)
+    {
+        case PROC_NOERR:
+            return "No error";
+        case PROC_ERRCREATE:
+            return "Creation error";
+        case PROC_ERRIMAGE:
+            return "Bad image";
+        case PROC_ERRIP:
+            return "Bad ip";
+        case PROC_ERRUNKN:
+            return "Unknown command";
+        case PROC_ERRPUSH:
+            return "Can't execute push: stack is full";
+        case PROC_ERRPOP:
+            return "Can't execute pop: stack is empty";
+        case PROC_ERRADD:
+            return "Can't execute add: not enough values in stack";
+        case PROC_ERRSUB:
+            return "Can't execute sub: not enough values in stack";
+        case PROC_ERRMUL:
+            return "Can't execute mul: not enough values in stack";
+        case PROC_ERRDIV:
+            return "Can't execute div: not enough values in stack";
+        case PROC_ERRMOD:
+            return "Can't execute mod: not enough values in stack";
+        case PROC_ERRCMP:
+            return "Can't execute cmp: not enough values in stack";
+        case PROC_ERRCALL:
+            return "Can't execute call: stack is full";
+        case PROC_ERRRET:
+            return "Can't execute ret: stack is empty";
+        case PROC_ERRSNAP:
+            return "Can't write snapshot";
+        case PROC_ERRCLONE:
+            return "Can't clone processor";
+        case PROC_ERRMAP:
+            return "Can't map file";
+        case PROC_ERRIO:
+            return "I/O error";
+        case PROC_ERRSEND:
+            return "Can't execute send: stack is empty";
+        case PROC_ERRRECV:
+            return "Can't execute recv: stack is full";
+        case PROC_ERRCHAN:
+            return "Channel error";
+        case PROC_ERRSPAWN:
+            return "Can't execute spawn";
+        case PROC_ERRJOIN:
+            return "Can't execute join";
+        case PROC_ERRXADD:
+            return "Can't execute xadd: stack is empty";
+        case PROC_ERRCAS:
+            return "Can't execute cas: not enough values in stack";
+        case PROC_ERRPFOR:
+            return "Can't execute pfor";
+        case PROC_ERRZERO:
+            return "Division by zero";
+        case PROC_ERROVERFLOW:
+            return "Division overflow";
+    }
+
+    return "Undefined error"; 
+}
+
+void proc_error (proc_t *proc)
+{
+    assert (proc);
+
+    proc_perror (stderr, &proc->error);
+}
+
+void proc_perror (FILE *stream, const struct proc_error *error)
+{
+    assert (stream);
+    assert (error);
+
+    fprintf (stream, "%s", proc_strerror (error->err) );
+
+    if (error->str)
+        fprintf (stream, ": %s", error->str);
+
+    fprintf (stream, "\n");
+}
+
+/* the decoded command that starts at ip, or NULL if none does */
+const struct proc_cmd *proc_decoded (const struct proc_code *code, uint64_t ip)
+{
+    assert (code);
+    assert (code->decoded);
+    assert (code->cmdidx);
+
+    const struct proc_cmdidx *idx = NULL;
+    uint64_t                  bit = (uint64_t) 1 << ip % PROC_IDXBITS;
+
+    if (ip >= code->size)
+        return NULL;
+
+    idx = &code->cmdidx[ip / PROC_IDXBITS];
+
+    if (!(idx->starts & bit) )
+        return NULL;
+
+    return &code->decoded[idx->base + (uint64_t) __builtin_popcountll (idx->starts & (bit - 1) )];
+}
+
+static void proc_seterr (proc_t *proc, enum PROC_ERR err, const char *str)
+{
+    assert (proc);
+    
+    proc->error.err = err;
+    proc->error.str = str;
+    proc->status    = PROC_STERR;
+}
+
+int proc_run (proc_t *proc)
+{
+    assert (proc);
+
+    proc_run_budget (proc, UINT64_MAX);
+
+    return (proc->status == PROC_STHLT) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int proc_run_budget (proc_t *proc, uint64_t budget)
+{
+    assert (proc);
+
+    proc->status = PROC_STRUN;
+
+    for (; budget && proc->status == PROC_STRUN; budget--)
+    {
+        if (cmd_read (proc) )
+            break;
+
+        if (proc->log)
+            cmd_log (proc);
+
+        if (cmd_exec (proc) )
+            break;
+    }
+
+    if (proc->status == PROC_STRUN)
+        proc->status = PROC_STYIELD;
+
+    return (proc->status == PROC_STERR) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int proc_reset (proc_t *proc)
+{
+    assert (proc);
+    assert (proc->prog);
+
+    const struct snap_header *snap = proc->image.data;
+
+    thread_reap (proc, 1);
+
+    for (uint64_t i = 0; i < PROC_PAGEWORDS; i++)
+        for (uint64_t bits = proc->memdirty[i] & ~proc->memshared[i]; bits; bits &= bits - 1)
+            mem_revert (proc, i * 64 + (uint64_t) __builtin_ctzll (bits) );
+
+    memset (proc->memdirty, 0, sizeof (proc->memdirty) );
+
+    if (proc->image.flat)
+    {
+        if (proc->stack.inthwm)
+            madvise (proc->stack.stkint, proc->stack.inthwm * sizeof (*proc->stack.stkint), MADV_DONTNEED);
+        if (proc->stack.rethwm)
+            madvise (proc->stack.stkret, proc->stack.rethwm * sizeof (*proc->stack.stkret), MADV_DONTNEED);
+
+        memcpy (proc->regs, snap->regs, sizeof (proc->regs) );
+
+        proc->code.ip     = snap->ip;
+        proc->cmp         = (enum PROC_CMPVAL) snap->cmp;
+        proc->stack.spint = snap->spint;
+        proc->stack.spret = snap->spret;
+    }
+    else
+    {
+        memset (proc->stack.stkint, 0, proc->stack.inthwm * sizeof (*proc->stack.stkint) );
+        memset (proc->stack.stkret, 0, proc->stack.rethwm * sizeof (*proc->stack.stkret) );
+        memset (proc->regs, 0, sizeof (proc->regs) );
+
+        proc->code.ip     = proc->prog->code.ip;
+        proc->cmp         = PROC_CMPEQ;
+        proc->stack.spint = 0;
+        proc->stack.spret = 0;
+    }
+
+    proc->stack.inthwm = proc->stack.spint;
+    proc->stack.rethwm = proc->stack.spret;
+    proc->cmd          = (struct proc_cmd) {};
+    proc->error        = (struct proc_error) {};
+    proc->status       = PROC_STHLT;
+
+    return EXIT_SUCCESS;
+}
+
+void proc_setio (proc_t *proc, proc_input_t input, proc_output_t output, void *ctx)
+{
+    assert (proc);
+
+    proc->io.input  = input  ? input  : std_input;
+    proc->io.output = output ? output : std_output;
+    proc->io.ctx    = ctx;
+}
+
+void proc_setchan (proc_t *proc, struct proc_chan **chan, uint64_t count)
+{
+    assert (proc);
+    assert (chan || !count);
+
+    proc->chan      = chan;
+    proc->chancount = count;
+}
+
+static void mem_store (proc_t *proc, uint64_t addr, int64_t val)
+{
+    assert (proc);
+
+    addr &= proc->memmask;
+
+    proc->memory[addr].v64 = val;
+
+    mem_mark (proc, addr);
+}
+
+static void mem_mark (proc_t *proc, uint64_t addr)
+{
+    assert (proc);
+
+    proc->memdirty[addr / PROC_PAGECELLS / 64] |= (uint64_t) 1 << (addr / PROC_PAGECELLS % 64);
+}
+
+static void mem_revert (proc_t *proc, uint64_t page)
+{
+    assert (proc);
+
+    const struct proc_data *data  = &proc->prog->data;
+    uint64_t                first = page * PROC_PAGECELLS;
+    uint64_t                count = PROC_PAGECELLS;
+    uint64_t                init  = 0;
+
+    if (count > proc->memmask + 1 - first)
+        count = proc->memmask + 1 - first;
+
+    /* private mappings drop their copies and fault the file or snapshot page back in */
+    if (proc->image.flat || (proc->memfile[page / 64] >> (page % 64) & 1) )
+    {
+        madvise (proc->memory + first, IMG_PAGESIZE, MADV_DONTNEED);
+        return;
+    }
+
+    init = (data->size > first) ? data->size - first : 0;
+    init = (init < count) ? init : count;
+
+    memcpy (proc->memory + first, data->data + first, init * sizeof (*proc->memory) );
+    memset (proc->memory + first + init, 0, (count - init) * sizeof (*proc->memory) );
+}
+
+static int std_input (void *ctx, int64_t *val)
+{
+    assert (val);
+
+    (void) ctx;
+
+    scanf ("%ld", val);
+
+    return EXIT_SUCCESS;
+}
+
+static int std_output (void *ctx, int64_t val)
+{
+    (void) ctx;
+
+    printf ("%ld\n", val);
+
+    return EXIT_SUCCESS;
+}
+
+static int cmd_read (proc_t *proc)
+{
+    assert (proc);
+    assert (proc->code.data);
+
+    const struct proc_cmd *cmd = NULL;
+
+    if (proc->code.ip >= proc->code.size)
+    {
+        proc_seterr (proc, PROC_ERRIP, NULL);
+        return EXIT_FAILURE;
+    }
+
+    if (proc->code.decoded && (cmd = proc_decoded (&proc->code, proc->code.ip) ) )
+    {
+        proc->cmd = *cmd;
+        return EXIT_SUCCESS;
+    }
+
+    proc->cmd.code   = *( (uint8_t *) (proc->code.data + proc->code.ip) );
+    proc->cmd.flgreg = (proc->cmd.code & CMD_FLGREG) ? 1 : 0;
+    proc->cmd.flgmem = (proc->cmd.code & CMD_FLGMEM) ? 1 : 0;
+    proc->cmd.code  &= ~(CMD_FLGREG | CMD_FLGMEM);
+
+    const void *arg = proc->code.data + proc->code.ip + 1;
+
+    if (proc->cmd.flgreg)
+    {
+        proc->cmd.arg.vu64 = *( (uint8_t *) arg);
+        proc->cmd.size     = 2;
+    }
+    else
+        switch (*( (uint8_t *) arg) & ARG_CLSMASK)
+        {
+            case ARG_CLS8:
+                proc->cmd.arg.v64 = *( (int8_t *) arg) >> ARG_SHIFT;
+                proc->cmd.size    = 2;
+                break;
+            case ARG_CLS16:
+                proc->cmd.arg.v64 = *( (int16_t *) arg) >> ARG_SHIFT;
+                proc->cmd.size    = 3;
+                break;
+            case ARG_CLS32:
+                proc->cmd.arg.v64 = *( (int32_t *) arg) >> ARG_SHIFT;
+                proc->cmd.size    = 5;
+                break;
+            default:
+                proc->cmd.arg     = *( (union val *) (arg + 1) );
+                proc->cmd.size    = 10;
+                break;
+        }
+
+    for (size_t i = 0; i < PROC_CMDCOUNT && cmdtable[i].exec; i++)
+        if (proc->cmd.code == cmdtable[i].code)
+        {
+            proc->cmd.id = i;
+
+            return EXIT_SUCCESS;
+        }
+    
+    proc->cmd.code   = CMD_UNKN;
+    proc->cmd.flgreg = 0;
+    proc->cmd.flgmem = 0;
+
+    return EXIT_SUCCESS;
+}
+
+static int cmd_exec (proc_t *proc)
+{
+    assert (proc);
+    assert (cmdtable[proc->cmd.id].exec);
+
+    return (proc->cmd.code == CMD_UNKN) ? unkn_exec (proc) : cmdtable[proc->cmd.id].exec (proc);
+}
+
+static void cmd_log (proc_t *proc)
+{
+    assert (proc);
+    assert (cmdtable[proc->cmd.id].log);
+
+    if (proc->cmd.code == CMD_UNKN)
+        unkn_log (proc);
+    else
+        cmdtable[proc->cmd.id].log (proc);
+}
+
+static int pop_exec (proc_t *proc)
+{
+    assert (proc);
+    assert (proc->memory);
+    assert (proc->stack.spint < proc->stack.size);
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRPOP, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    proc->stack.spint--;
+
+    if (proc->cmd.flgreg)
+    {
+        if (proc->cmd.flgmem)
+            mem_store (proc, proc->regs[proc->cmd.arg.vu8].vu64, proc->stack.stkint[proc->stack.spint]);
+        else
+            proc->regs[proc->cmd.arg.vu8].v64 = proc->stack.stkint[proc->stack.spint];
+
+        proc->code.ip += 2;
+    }
+    else
+    {
+        if (proc->cmd.flgmem)
+        {
+            mem_store (proc, proc->cmd.arg.vu64, proc->stack.stkint[proc->stack.spint]);
+            proc->code.ip += proc->cmd.size;
+        }
+        else
+            proc->code.ip += 1;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int push_exec (proc_t *proc)
+{
+    assert (proc);
+    assert (proc->memory);
+
+    if (proc->stack.spint >= proc->stack.size)
+    {
+        proc_seterr (proc, PROC_ERRPUSH, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    if (proc->cmd.flgreg)
+    {
+        if (proc->cmd.flgmem)
+            proc->stack.stkint[proc->stack.spint] = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask].v64;
+        else
+            proc->stack.stkint[proc->stack.spint] = proc->regs[proc->cmd.arg.vu8].v64;
+
+        proc->code.ip += 2;
+    }
+    else
+    {
+        if (proc->cmd.flgmem)
+            proc->stack.stkint[proc->stack.spint] = proc->memory[proc->cmd.arg.vu64 & proc->memmask].v64;
+        else
+            proc->stack.stkint[proc->stack.spint] = proc->cmd.arg.v64;
+
+        proc->code.ip += proc->cmd.size;
+    }
+
+    proc->stack.spint++;
+
+    if (proc->stack.spint > proc->stack.inthwm)
+        proc->stack.inthwm = proc->stack.spint;
+
+    return EXIT_SUCCESS;
+}
+
+static int add_exec (proc_t *proc)
+{
+    assert (proc);
+    assert (proc->stack.spint < proc->stack.size);
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRADD, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    int64_t arg = 0;
+
+    if (proc->cmd.flgreg)
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask].v64;
+        else
+            arg = proc->regs[proc->cmd.arg.vu8].v64;
+
+        proc->code.ip += 2;
+    }
+    else
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->cmd.arg.vu64 & proc->memmask].v64;
+        else
+            arg = proc->cmd.arg.v64;
+
+        proc->code.ip += proc->cmd.size;
+    }
+
+    proc->stack.stkint[proc->stack.spint-1] += arg;
+
+    return EXIT_SUCCESS;
+}
+
+static int sub_exec (proc_t *proc)
+{
+    assert (proc);
+    assert (proc->stack.spint < proc->stack.size);
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRSUB, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    int64_t arg = 0;
+
+    if (proc->cmd.flgreg)
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask].v64;
+        else
+            arg = proc->regs[proc->cmd.arg.vu8].v64;
+
+        proc->code.ip += 2;
+    }
+    else
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->cmd.arg.vu64 & proc->memmask].v64;
+        else
+            arg = proc->cmd.arg.v64;
+
+        proc->code.ip += proc->cmd.size;
+    }
+
+    proc->stack.stkint[proc->stack.spint-1] -= arg;
+
+    return EXIT_SUCCESS;
+}
+
+static int mul_exec (proc_t *proc)
+{
+    assert (proc);
+    assert (proc->stack.spint < proc->stack.size);
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRMUL, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    int64_t arg = 0;
+
+    if (proc->cmd.flgreg)
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask].v64;
+        else
+            arg = proc->regs[proc->cmd.arg.vu8].v64;
+
+        proc->code.ip += 2;
+    }
+    else
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->cmd.arg.vu64 & proc->memmask].v64;
+        else
+            arg = proc->cmd.arg.v64;
+
+        proc->code.ip += proc->cmd.size;
+    }
+
+    proc->stack.stkint[proc->stack.spint-1] *= arg;
+
+    return EXIT_SUCCESS;
+}
+
+static int div_exec (proc_t *proc)
+{
+    assert (proc);
+    assert (proc->stack.spint < proc->stack.size);
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRDIV, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    int64_t arg = 0;
+
+    if (proc->cmd.flgreg)
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask].v64;
+        else
+            arg = proc->regs[proc->cmd.arg.vu8].v64;
+
+        proc->code.ip += 2;
+    }
+    else
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->cmd.arg.vu64 & proc->memmask].v64;
+        else
+            arg = proc->cmd.arg.v64;
+
+        proc->code.ip += proc->cmd.size;
+    }
+
+    if (arg == 0)
+    {
+        proc_seterr (proc, PROC_ERRZERO, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    if (arg == -1 && proc->stack.stkint[proc->stack.spint-1] == INT64_MIN)
+    {
+        proc_seterr (proc, PROC_ERROVERFLOW, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    proc->stack.stkint[proc->stack.spint-1] /= arg;
+
+    return EXIT_SUCCESS;
+}
+
+static int mod_exec (proc_t *proc)
+{
+    assert (proc);
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRMOD, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    int64_t arg = 0;
+
+    if (proc->cmd.flgreg)
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask].v64;
+        else
+            arg = proc->regs[proc->cmd.arg.vu8].v64;
+
+        proc->code.ip += 2;
+    }
+    else
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->cmd.arg.vu64 & proc->memmask].v64;
+        else
+            arg = proc->cmd.arg.v64;
+
+        proc->code.ip += proc->cmd.size;
+    }
+
+    if (arg == 0)
+    {
+        proc_seterr (proc, PROC_ERRZERO, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    if (arg == -1 && proc->stack.stkint[proc->stack.spint-1] == INT64_MIN)
+    {
+        proc_seterr (proc, PROC_ERROVERFLOW, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    proc->stack.stkint[proc->stack.spint-1] %= arg;
+
+    return EXIT_SUCCESS;
+}
+
+static int cmp_exec (proc_t *proc)
+{
+    assert (proc);
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRCMP, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    int64_t top = proc->stack.stkint[proc->stack.spint-1];
+    int64_t arg = 0;
 
     if (proc->cmd.flgreg)
     {
         if (proc->cmd.flgmem)
-            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE].v64;
+            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask].v64;
         else
             arg = proc->regs[proc->cmd.arg.vu8].v64;
 
-        proc->code.ip += 2;
+        proc->code.ip += 2;
+    }
+    else
+    {
+        if (proc->cmd.flgmem)
+            arg = proc->memory[proc->cmd.arg.vu64 & proc->memmask].v64;
+        else
+            arg = proc->cmd.arg.v64;
+
+        proc->code.ip += proc->cmd.size;
+    }
+    
+
+    if (top == arg)
+        proc->cmp = PROC_CMPEQ;
+    else if (top < arg)
+        proc->cmp = PROC_CMPLESS;
+    else
+        proc->cmp = PROC_CMPGREAT;
+
+    return EXIT_SUCCESS;
+}
+
+static int ret_exec (proc_t *proc)
+{
+    assert (proc);
+    assert (proc->stack.spret < proc->stack.size);
+
+    if (proc->stack.spret == 0 && proc->parent)
+    {
+        proc->status = PROC_STHLT;
+
+        return EXIT_SUCCESS;
+    }
+
+    if (proc->stack.spret == 0)
+    {
+        proc_seterr (proc, PROC_ERRRET, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    proc->stack.spret--; 
+    proc->code.ip = proc->stack.stkret[proc->stack.spret];
+
+    return EXIT_SUCCESS;
+}
+
+static int hlt_exec (proc_t *proc)
+{
+    assert (proc);
+
+    proc->status = PROC_STHLT;
+    proc->code.ip += 1;
+
+    return EXIT_SUCCESS;
+}
+
+static int call_exec (proc_t *proc)
+{
+    assert (proc);
+
+    if (proc->stack.spret >= proc->stack.size)
+    {
+        proc_seterr (proc, PROC_ERRCALL, NULL);
+
+        return EXIT_FAILURE;
     }
+
+    proc->stack.stkret[proc->stack.spret++] = proc->code.ip + proc->cmd.size;
+
+    if (proc->stack.spret > proc->stack.rethwm)
+        proc->stack.rethwm = proc->stack.spret;
+    proc->code.ip = proc->cmd.arg.vu64;
+
+    return EXIT_SUCCESS;
+}
+
+static int jmp_exec (proc_t *proc)
+{
+    assert (proc);
+
+    proc->code.ip = proc->cmd.arg.vu64;
+
+    return EXIT_SUCCESS;
+}
+
+static int je_exec (proc_t *proc)
+{
+    assert (proc);
+
+    if (proc->cmp == PROC_CMPEQ)
+        proc->code.ip = proc->cmd.arg.vu64;
+    else
+        proc->code.ip += proc->cmd.size;
+
+    return EXIT_SUCCESS;
+}
+
+static int jl_exec (proc_t *proc)
+{
+    assert (proc);
+
+    if (proc->cmp == PROC_CMPLESS)
+        proc->code.ip = proc->cmd.arg.vu64;
+    else
+        proc->code.ip += proc->cmd.size;
+
+    return EXIT_SUCCESS;
+}
+
+static int jle_exec (proc_t *proc)
+{
+    assert (proc);
+
+    if (proc->cmp == PROC_CMPLESS || proc->cmp == PROC_CMPEQ)
+        proc->code.ip = proc->cmd.arg.vu64;
     else
+        proc->code.ip += proc->cmd.size;
+
+    return EXIT_SUCCESS;
+}
+
+static int out_exec (proc_t *proc)
+{
+    assert (proc);
+
+    int ret = proc->io.output (proc->io.ctx, proc->regs[0].v64);
+
+    if (ret == PROC_IOWAIT)
     {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->cmd.arg.vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->cmd.arg.v64;
+        proc->status = PROC_STWAIT;
 
-        proc->code.ip += 9;
+        return EXIT_SUCCESS;
     }
 
-    proc->stack.stkint[proc->stack.spint-1] += arg;
+    if (ret)
+    {
+        proc_seterr (proc, PROC_ERRIO, "output failed");
+
+        return EXIT_FAILURE;
+    }
 
+    proc->code.ip += 1;
+    
     return EXIT_SUCCESS;
 }
 
-static int sub_exec (proc_t *proc)
+static int in_exec (proc_t *proc)
+{
+    assert (proc);
+
+    int ret = proc->io.input (proc->io.ctx, &proc->regs[0].v64);
+
+    if (ret == PROC_IOWAIT)
+    {
+        proc->status = PROC_STWAIT;
+
+        return EXIT_SUCCESS;
+    }
+
+    if (ret)
+    {
+        proc_seterr (proc, PROC_ERRIO, "input failed");
+
+        return EXIT_FAILURE;
+    }
+
+    proc->code.ip += 1;
+    
+    return EXIT_SUCCESS;
+}
+
+static int send_exec (proc_t *proc)
+{
+    assert (proc);
+
+    struct proc_chan *chan = NULL;
+    uint64_t          id   = proc->cmd.flgreg ? proc->regs[proc->cmd.arg.vu8].vu64 : proc->cmd.arg.vu64;
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRSEND, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    if (id >= proc->chancount || !(chan = proc->chan[id]) )
+    {
+        proc_seterr (proc, PROC_ERRCHAN, "no such channel");
+
+        return EXIT_FAILURE;
+    }
+
+    switch (chan_send (chan, proc->stack.stkint[proc->stack.spint - 1]) )
+    {
+        case CHAN_OK:
+            break;
+        case CHAN_WAIT:
+            proc->status = PROC_STYIELD;
+            return EXIT_SUCCESS;
+        case CHAN_CLOSED:
+        default:
+            proc_seterr (proc, PROC_ERRCHAN, "channel closed");
+            return EXIT_FAILURE;
+    }
+
+    proc->stack.spint--;
+    proc->code.ip += proc->cmd.size;
+
+    return EXIT_SUCCESS;
+}
+
+static int recv_exec (proc_t *proc)
+{
+    assert (proc);
+
+    struct proc_chan *chan = NULL;
+    uint64_t          id   = proc->cmd.flgreg ? proc->regs[proc->cmd.arg.vu8].vu64 : proc->cmd.arg.vu64;
+
+    if (proc->stack.spint >= proc->stack.size)
+    {
+        proc_seterr (proc, PROC_ERRRECV, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    if (id >= proc->chancount || !(chan = proc->chan[id]) )
+    {
+        proc_seterr (proc, PROC_ERRCHAN, "no such channel");
+
+        return EXIT_FAILURE;
+    }
+
+    switch (chan_recv (chan, &proc->stack.stkint[proc->stack.spint]) )
+    {
+        case CHAN_OK:
+            proc->stack.spint++;
+            proc->cmp = PROC_CMPEQ;
+            break;
+        case CHAN_WAIT:
+            proc->status = PROC_STYIELD;
+            return EXIT_SUCCESS;
+        case CHAN_CLOSED:
+        default:
+            proc->cmp = PROC_CMPLESS;
+            break;
+    }
+
+    proc->code.ip += proc->cmd.size;
+
+    if (proc->stack.spint > proc->stack.inthwm)
+        proc->stack.inthwm = proc->stack.spint;
+
+    return EXIT_SUCCESS;
+}
+
+static int spawn_exec (proc_t *proc)
+{
+    assert (proc);
+
+    proc_t     *child  = NULL;
+    const char *errstr = NULL;
+    int         err    = 0;
+
+    if (proc->stack.spint >= proc->stack.size)
+    {
+        proc_seterr (proc, PROC_ERRSPAWN, "stack is full");
+
+        return EXIT_FAILURE;
+    }
+
+    do
+    {
+        errno = 0;
+
+        if (proc->threads.count == proc->threads.size)
+        {
+            uint64_t            size = proc->threads.size ? proc->threads.size * 2 : PROC_THREADMIN;
+            struct proc_thread *data = realloc (proc->threads.data, size * sizeof (*data) );
+
+            if (!data)
+                break;
+
+            proc->threads.data = data;
+            proc->threads.size = size;
+        }
+
+        if (!(child = proc_fork (proc, proc->cmd.arg.vu64) ) )
+            break;
+
+        if ( (err = pthread_create (&proc->threads.data[proc->threads.count].handle, NULL, thread_main, child) ) )
+        {
+            errstr = strerror (err);
+            break;
+        }
+
+        proc->threads.data[proc->threads.count].proc = child;
+
+        proc->stack.stkint[proc->stack.spint++] = (int64_t) proc->threads.count++;
+
+        if (proc->stack.spint > proc->stack.inthwm)
+            proc->stack.inthwm = proc->stack.spint;
+
+        proc->code.ip += proc->cmd.size;
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    if (!errstr)
+        errstr = strerror (errno);
+
+    if (child)
+    {
+        proc_release (child);
+        free (child);
+    }
+
+    proc_seterr (proc, PROC_ERRSPAWN, errstr);
+
+    return EXIT_FAILURE;
+}
+
+static int join_exec (proc_t *proc)
+{
+    assert (proc);
+
+    struct proc_error error = {};
+    uint64_t          id    = 0;
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRJOIN, "stack is empty");
+
+        return EXIT_FAILURE;
+    }
+
+    id = proc->stack.stkint[proc->stack.spint - 1];
+
+    if (id >= proc->threads.count || !proc->threads.data[id].proc)
+    {
+        proc_seterr (proc, PROC_ERRJOIN, "no such thread");
+
+        return EXIT_FAILURE;
+    }
+
+    error = thread_join (proc, id);
+
+    proc->stack.spint--;
+
+    if (error.err)
+    {
+        proc_seterr (proc, error.err, error.str);
+
+        return EXIT_FAILURE;
+    }
+
+    proc->code.ip += 1;
+
+    return EXIT_SUCCESS;
+}
+
+static int xadd_exec (proc_t *proc)
+{
+    assert (proc);
+
+    uint64_t addr = (proc->cmd.flgreg ? proc->regs[proc->cmd.arg.vu8].vu64 : proc->cmd.arg.vu64) & proc->memmask;
+
+    if (proc->stack.spint == 0)
+    {
+        proc_seterr (proc, PROC_ERRXADD, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    proc->stack.stkint[proc->stack.spint - 1] = __atomic_fetch_add (&proc->memory[addr].v64,
+                                                                    proc->stack.stkint[proc->stack.spint - 1],
+                                                                    __ATOMIC_SEQ_CST);
+
+    mem_mark (proc, addr);
+
+    proc->code.ip += proc->cmd.size;
+
+    return EXIT_SUCCESS;
+}
+
+static int cas_exec (proc_t *proc)
+{
+    assert (proc);
+
+    uint64_t addr     = (proc->cmd.flgreg ? proc->regs[proc->cmd.arg.vu8].vu64 : proc->cmd.arg.vu64) & proc->memmask;
+    int64_t  expected = 0;
+
+    if (proc->stack.spint < 2)
+    {
+        proc_seterr (proc, PROC_ERRCAS, NULL);
+
+        return EXIT_FAILURE;
+    }
+
+    expected = proc->stack.stkint[proc->stack.spint - 2];
+
+    if (__atomic_compare_exchange_n (&proc->memory[addr].v64, &expected, proc->stack.stkint[proc->stack.spint - 1], 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) )
+    {
+        proc->cmp = PROC_CMPEQ;
+
+        mem_mark (proc, addr);
+    }
+    else
+        proc->cmp = PROC_CMPLESS;
+
+    proc->stack.spint--;
+    proc->stack.stkint[proc->stack.spint - 1] = expected;
+
+    proc->code.ip += proc->cmd.size;
+
+    return EXIT_SUCCESS;
+}
+
+static int fence_exec (proc_t *proc)
+{
+    assert (proc);
+
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+    proc->code.ip += 1;
+
+    return EXIT_SUCCESS;
+}
+
+static int pfor_exec (proc_t *proc)
 {
     assert (proc);
-    assert (proc->stack.spint < PROC_STKSIZE);
 
-    if (proc->stack.spint == 0)
+    struct pfor_job  job    = {};
+    struct proc_error error = {};
+    int64_t          count  = 0;
+    uint64_t         total  = 0;
+    int64_t          acc    = 0;
+    uint8_t          any    = 0;
+    int              err    = 0;
+
+    if (proc->stack.spint < 2)
     {
-        proc_seterr (proc, PROC_ERRSUB, NULL);
+        proc_seterr (proc, PROC_ERRPFOR, "not enough values in stack");
 
         return EXIT_FAILURE;
     }
 
-    int64_t arg = 0;
+    job.base = (uint64_t) proc->stack.stkint[proc->stack.spint - 1];
+    count    = proc->stack.stkint[proc->stack.spint - 2];
+    job.func = proc->cmd.arg.vu64;
+    job.code = proc->cmd.code;
 
-    if (proc->cmd.flgreg)
+    if (count < 0 || job.base > proc->memmask || (uint64_t) count > proc->memmask + 1 - job.base)
     {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->regs[proc->cmd.arg.vu8].v64;
+        proc_seterr (proc, PROC_ERRPFOR, "range is out of memory");
 
-        proc->code.ip += 2;
+        return EXIT_FAILURE;
     }
-    else
+
+    total     = (uint64_t) count;
+    job.count = (total + PROC_PFORGRAIN - 1) / PROC_PFORGRAIN;
+
+    if (job.count > pfor_cpus () )
+        job.count = pfor_cpus ();
+
+    if (job.count == 0)
+        job.count = 1;
+
+    do
     {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->cmd.arg.vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->cmd.arg.v64;
+        errno = 0;
 
-        proc->code.ip += 9;
-    }
+        if (!(job.worker = calloc (job.count, sizeof (*job.worker) ) ) )
+            break;
 
-    proc->stack.stkint[proc->stack.spint-1] -= arg;
+        for (uint64_t i = 0; i < job.count; i++)
+        {
+            job.worker[i].job   = &job;
+            job.worker[i].range = (total * i / job.count) | (total * (i + 1) / job.count) << 32;
 
-    return EXIT_SUCCESS;
-}
+            if (!(job.worker[i].vm = proc_fork (proc, job.func) ) )
+                break;
+        }
 
-static int mul_exec (proc_t *proc)
-{
-    assert (proc);
-    assert (proc->stack.spint < PROC_STKSIZE);
+        if (!job.worker[job.count - 1].vm)
+            break;
 
-    if (proc->stack.spint == 0)
-    {
-        proc_seterr (proc, PROC_ERRMUL, NULL);
+        for (uint64_t i = 1; i < job.count; i++)
+            job.worker[i].started = !pthread_create (&job.worker[i].handle, NULL, pfor_main, &job.worker[i]);
 
-        return EXIT_FAILURE;
+        pfor_main (&job.worker[0]);
+
+        for (uint64_t i = 1; i < job.count; i++)
+            if (job.worker[i].started)
+                pthread_join (job.worker[i].handle, NULL);
     }
+    while (0);
 
-    int64_t arg = 0;
+    if (!job.worker || !job.worker[job.count - 1].vm)
+        err = errno;
 
-    if (proc->cmd.flgreg)
+    for (uint64_t i = 0; job.worker && i < job.count; i++)
     {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->regs[proc->cmd.arg.vu8].v64;
+        proc_t *vm = job.worker[i].vm;
 
-        proc->code.ip += 2;
-    }
-    else
-    {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->cmd.arg.vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->cmd.arg.v64;
+        if (!vm)
+            continue;
 
-        proc->code.ip += 9;
-    }
+        if (vm->status == PROC_STERR && !error.err)
+            error = vm->error;
 
-    proc->stack.stkint[proc->stack.spint-1] *= arg;
+        for (uint64_t j = 0; j < PROC_PAGEWORDS; j++)
+            proc->memdirty[j] |= vm->memdirty[j];
 
-    return EXIT_SUCCESS;
-}
+        if (job.worker[i].any)
+        {
+            int64_t val = job.worker[i].acc;
 
-static int div_exec (proc_t *proc)
-{
-    assert (proc);
-    assert (proc->stack.spint < PROC_STKSIZE);
+            if (!any || (job.code == CMD_PFOR) )
+                acc = any ? acc + val : val;
+            else if (job.code == CMD_PFORMIN)
+                acc = (val < acc) ? val : acc;
+            else
+                acc = (val > acc) ? val : acc;
 
-    if (proc->stack.spint == 0)
-    {
-        proc_seterr (proc, PROC_ERRDIV, NULL);
+            any = 1;
+        }
 
-        return EXIT_FAILURE;
+        proc_release (vm);
+        free (vm);
     }
 
-    int64_t arg = 0;
+    free (job.worker);
 
-    if (proc->cmd.flgreg)
+    if (err)
     {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->regs[proc->cmd.arg.vu8].v64;
+        proc_seterr (proc, PROC_ERRPFOR, strerror (err) );
 
-        proc->code.ip += 2;
+        return EXIT_FAILURE;
     }
-    else
+
+    if (job.failed)
     {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->cmd.arg.vu64 % PROC_MEMSIZE].v64;
+        if (error.err)
+            proc_seterr (proc, error.err, error.str);
         else
-            arg = proc->cmd.arg.v64;
+            proc_seterr (proc, PROC_ERRPFOR, "function did not return");
 
-        proc->code.ip += 9;
+        return EXIT_FAILURE;
     }
 
-    proc->stack.stkint[proc->stack.spint-1] /= arg;
+    proc->regs[PROC_PFORREG].v64 = acc;
+    proc->stack.spint           -= 2;
 
+    proc->code.ip += proc->cmd.size;
 
     return EXIT_SUCCESS;
 }
 
-static int mod_exec (proc_t *proc)
+static int pformin_exec (proc_t *proc)
 {
-    assert (proc);
+    return pfor_exec (proc);
+}
 
-    if (proc->stack.spint == 0)
-    {
-        proc_seterr (proc, PROC_ERRMOD, NULL);
+static int pformax_exec (proc_t *proc)
+{
+    return pfor_exec (proc);
+}
 
-        return EXIT_FAILURE;
-    }
+static void *pfor_main (void *arg)
+{
+    assert (arg);
+
+    struct pfor_worker *worker = arg;
+    uint64_t            lo     = 0;
+    uint64_t            hi     = 0;
+
+    while (!__atomic_load_n (&worker->job->failed, __ATOMIC_ACQUIRE) &&
+           (pfor_take (worker, &lo, &hi) || pfor_steal (worker) ) )
+        for (; lo < hi; lo++)
+            if (pfor_call (worker, lo) )
+            {
+                __atomic_store_n (&worker->job->failed, 1, __ATOMIC_RELEASE);
+                break;
+            }
+
+    return NULL;
+}
 
-    int64_t arg = 0;
+static int pfor_take (struct pfor_worker *worker, uint64_t *lo, uint64_t *hi)
+{
+    assert (worker);
+    assert (lo);
+    assert (hi);
 
-    if (proc->cmd.flgreg)
-    {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->regs[proc->cmd.arg.vu8].v64;
+    uint64_t range = __atomic_load_n (&worker->range, __ATOMIC_ACQUIRE);
+    uint64_t next  = 0;
 
-        proc->code.ip += 2;
-    }
-    else
+    do
     {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->cmd.arg.vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->cmd.arg.v64;
+        *lo = range & UINT32_MAX;
+        *hi = range >> 32;
 
-        proc->code.ip += 9;
-    }
+        if (*lo >= *hi)
+            return 0;
 
-    proc->stack.stkint[proc->stack.spint-1] %= arg;
+        next = *lo + PROC_PFORGRAIN;
 
-    return EXIT_SUCCESS;
+        if (next < *hi)
+            *hi = next;
+    }
+    while (!__atomic_compare_exchange_n (&worker->range, &range, *hi | (range >> 32) << 32, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) );
+
+    return 1;
 }
 
-static int cmp_exec (proc_t *proc)
+static int pfor_steal (struct pfor_worker *worker)
 {
-    assert (proc);
+    assert (worker);
 
-    if (proc->stack.spint == 0)
+    struct pfor_job *job  = worker->job;
+    uint64_t         self = (uint64_t) (worker - job->worker);
+
+    for (uint64_t i = 1; i < job->count; i++)
     {
-        proc_seterr (proc, PROC_ERRCMP, NULL);
+        struct pfor_worker *victim = &job->worker[(self + i) % job->count];
+        uint64_t            range  = __atomic_load_n (&victim->range, __ATOMIC_ACQUIRE);
+        uint64_t            lo     = 0;
+        uint64_t            hi     = 0;
+        uint64_t            mid    = 0;
 
-        return EXIT_FAILURE;
-    }
+        do
+        {
+            lo  = range & UINT32_MAX;
+            hi  = range >> 32;
+            mid = lo + (hi - lo) / 2;
 
-    int64_t top = proc->stack.stkint[proc->stack.spint-1];
-    int64_t arg = 0;
+            if (lo >= hi)
+                break;
+        }
+        while (!__atomic_compare_exchange_n (&victim->range, &range, lo | mid << 32, 0,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) );
 
-    if (proc->cmd.flgreg)
-    {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->regs[proc->cmd.arg.vu8].v64;
+        if (lo < hi)
+        {
+            __atomic_store_n (&worker->range, mid | hi << 32, __ATOMIC_RELEASE);
 
-        proc->code.ip += 2;
+            return 1;
+        }
     }
-    else
-    {
-        if (proc->cmd.flgmem)
-            arg = proc->memory[proc->cmd.arg.vu64 % PROC_MEMSIZE].v64;
-        else
-            arg = proc->cmd.arg.v64;
 
-        proc->code.ip += 9;
-    }
-    
+    return 0;
+}
 
-    if (top == arg)
-        proc->cmp = PROC_CMPEQ;
-    else if (top < arg)
-        proc->cmp = PROC_CMPLESS;
+static int pfor_call (struct pfor_worker *worker, uint64_t index)
+{
+    assert (worker);
+
+    proc_t  *vm  = worker->vm;
+    int64_t  val = 0;
+
+    vm->stack.spint = 0;
+    vm->stack.spret = 0;
+
+    vm->stack.stkint[vm->stack.spint++] = (int64_t) index;
+    vm->stack.stkint[vm->stack.spint++] = (int64_t) (worker->job->base + index);
+
+    vm->code.ip = worker->job->func;
+
+    while (!proc_run_budget (vm, PROC_THREADBUDGET) && vm->status == PROC_STYIELD &&
+           !__atomic_load_n (&worker->job->failed, __ATOMIC_ACQUIRE) )
+        sched_yield ();
+
+    if (vm->status != PROC_STHLT)
+        return EXIT_FAILURE;
+
+    val = vm->regs[PROC_PFORREG].v64;
+
+    if (!worker->any || worker->job->code == CMD_PFOR)
+        worker->acc = worker->any ? worker->acc + val : val;
+    else if (worker->job->code == CMD_PFORMIN)
+        worker->acc = (val < worker->acc) ? val : worker->acc;
     else
-        proc->cmp = PROC_CMPGREAT;
+        worker->acc = (val > worker->acc) ? val : worker->acc;
+
+    worker->any = 1;
 
     return EXIT_SUCCESS;
 }
 
-static int ret_exec (proc_t *proc)
+static uint64_t pfor_cpus (void)
 {
-    assert (proc);
-    assert (proc->stack.spret < PROC_STKSIZE);
+    static uint64_t cpus = 0;
 
-    if (proc->stack.spret == 0)
+    uint64_t count = __atomic_load_n (&cpus, __ATOMIC_RELAXED);
+
+    if (!count)
     {
-        proc_seterr (proc, PROC_ERRRET, NULL);
+        long online = sysconf (_SC_NPROCESSORS_ONLN);
 
-        return EXIT_FAILURE;
+        count = (online < 1) ? 1 : (online > PROC_PFORMAX) ? PROC_PFORMAX : (uint64_t) online;
+
+        __atomic_store_n (&cpus, count, __ATOMIC_RELAXED);
     }
 
-    proc->stack.spret--; 
-    proc->code.ip = proc->stack.stkret[proc->stack.spret];
+    return count;
+}
 
-    return EXIT_SUCCESS;
+static void *thread_main (void *arg)
+{
+    assert (arg);
+
+    proc_t *proc = arg;
+
+    while (!proc_run_budget (proc, PROC_THREADBUDGET) && proc->status == PROC_STYIELD &&
+           !__atomic_load_n (&proc->stop, __ATOMIC_ACQUIRE) )
+        sched_yield ();
+
+    thread_reap (proc, __atomic_load_n (&proc->stop, __ATOMIC_ACQUIRE) );
+
+    return NULL;
 }
 
-static int hlt_exec (proc_t *proc)
+static struct proc_error thread_join (proc_t *proc, uint64_t id)
 {
     assert (proc);
+    assert (id < proc->threads.count);
 
-    proc->status = PROC_STHLT;
+    struct proc_error  error = {};
+    proc_t            *child = proc->threads.data[id].proc;
 
-    return EXIT_SUCCESS;
+    assert (child);
+
+    pthread_join (proc->threads.data[id].handle, NULL);
+
+    if (child->status == PROC_STERR)
+        error = child->error;
+
+    for (uint64_t i = 0; i < PROC_PAGEWORDS; i++)
+        proc->memdirty[i] |= child->memdirty[i];
+
+    proc_release (child);
+    free (child);
+
+    proc->threads.data[id].proc = NULL;
+
+    return error;
 }
 
-static int call_exec (proc_t *proc)
+static void thread_reap (proc_t *proc, int stop)
 {
     assert (proc);
 
-    if (proc->stack.spret >= PROC_STKSIZE)
-    {
-        proc_seterr (proc, PROC_ERRCALL, NULL);
+    for (uint64_t i = 0; stop && i < proc->threads.count; i++)
+        if (proc->threads.data[i].proc)
+            __atomic_store_n (&proc->threads.data[i].proc->stop, 1, __ATOMIC_RELEASE);
 
-        return EXIT_FAILURE;
-    }
+    for (uint64_t i = 0; i < proc->threads.count; i++)
+        if (proc->threads.data[i].proc)
+            thread_join (proc, i);
 
-    proc->stack.stkret[proc->stack.spret++] = proc->code.ip + 9;
-    proc->code.ip = proc->cmd.arg.vu64;
+    free (proc->threads.data);
 
-    return EXIT_SUCCESS;
+    proc->threads = (struct proc_threads) {};
 }
 
-static int jmp_exec (proc_t *proc)
+static int unkn_exec (proc_t *proc)
 {
     assert (proc);
 
-    proc->code.ip = proc->cmd.arg.vu64;
+    proc_seterr (proc, PROC_ERRUNKN, NULL); 
 
-    return EXIT_SUCCESS;
+    return EXIT_FAILURE;
 }
 
-static int je_exec (proc_t *proc)
+static void unkn_log (proc_t *proc)
 {
     assert (proc);
+    assert (proc->log);
+    
+    fprintf (proc->log, "0x%016lx: unknown;\n", proc->code.ip);
+    fflush (proc->log);
+}
 
-    if (proc->cmp == PROC_CMPEQ)
-        proc->code.ip = proc->cmd.arg.vu64;
-    else
-        proc->code.ip += 9;
+static uint64_t unkn_check (proc_t *proc, uint8_t *mark)
+{
+    assert (proc);
+    assert (mark);
 
-    return EXIT_SUCCESS;
+    return 0;
 }
 
-static int jl_exec (proc_t *proc)
+static uint64_t pushtype_check (proc_t *proc, uint8_t *mark)
 {
     assert (proc);
+    assert (mark);
 
-    if (proc->cmp == PROC_CMPLESS)
-        proc->code.ip = proc->cmd.arg.vu64;
-    else
-        proc->code.ip += 9;
+    if (proc->cmd.flgreg)
+        return 2;
 
-    return EXIT_SUCCESS;
+    if (proc->cmd.flgmem && proc->cmd.arg.vu64 > proc->memmask)
+        return 0;
+
+    return proc->cmd.size;
 }
 
-static int jle_exec (proc_t *proc)
+static uint64_t poptype_check (proc_t *proc, uint8_t *mark)
 {
     assert (proc);
+    assert (mark);
 
-    if (proc->cmp == PROC_CMPLESS || proc->cmp == PROC_CMPEQ)
-        proc->code.ip = proc->cmd.arg.vu64;
-    else
-        proc->code.ip += 9;
+    if (proc->cmd.flgreg)
+        return 2;
 
-    return EXIT_SUCCESS;
+    if (proc->cmd.flgmem)
+        return (proc->cmd.arg.vu64 > proc->memmask) ? 0 : proc->cmd.size;
+
+    return 1;
 }
 
-static int out_exec (proc_t *proc)
+static uint64_t jmptype_check (proc_t *proc, uint8_t *mark)
 {
     assert (proc);
+    assert (mark);
 
-    printf ("%ld\n", proc->regs[0].v64);
+    if (proc->cmd.flgreg || proc->cmd.flgmem)
+        return 0;
 
-    proc->code.ip += 1;
-    
-    return EXIT_SUCCESS;
+    *mark |= PROC_MARKJMP;
+
+    return proc->cmd.size;
 }
 
-static int in_exec (proc_t *proc)
+static uint64_t calltype_check (proc_t *proc, uint8_t *mark)
+{
+    return jmptype_check (proc, mark);
+}
+
+static uint64_t stdtype_check (proc_t *proc, uint8_t *mark)
 {
     assert (proc);
+    assert (mark);
 
-    scanf ("%ld", &proc->regs[0].v64);
+    if (proc->cmd.flgreg || proc->cmd.flgmem)
+        return 0;
 
-    proc->code.ip += 1;
-    
-    return EXIT_SUCCESS;
+    return 1;
 }
 
-
-static int unkn_exec (proc_t *proc)
+static uint64_t chantype_check (proc_t *proc, uint8_t *mark)
 {
     assert (proc);
+    assert (mark);
 
-    proc_seterr (proc, PROC_ERRUNKN, NULL); 
+    if (proc->cmd.flgmem)
+        return 0;
 
-    return EXIT_FAILURE;
+    return proc->cmd.size;
 }
 
-static void unkn_log (proc_t *proc)
+static uint64_t atomtype_check (proc_t *proc, uint8_t *mark)
 {
     assert (proc);
-    assert (proc->log);
-    
-    fprintf (proc->log, "0x%016lx: unknown;\n", proc->code.ip);
-    fflush (proc->log);
+    assert (mark);
+
+    if (!proc->cmd.flgmem)
+        return 0;
+
+    if (proc->cmd.flgreg)
+        return 2;
+
+    return (proc->cmd.arg.vu64 > proc->memmask) ? 0 : proc->cmd.size;
 }
 
 static void pushtype_log (proc_t *proc, const char *command)
@@ -715,12 +2787,12 @@ static void pushtype_log (proc_t *proc, const char *command)
     {
         if (proc->cmd.flgreg)
             fprintf (proc->log, " [r%hhu] = [0x%016lx] = %ld;\n", 
-                     proc->cmd.arg.vu8, proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE,
-                     proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE].v64);
+                     proc->cmd.arg.vu8, proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask,
+                     proc->memory[proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask].v64);
         else
             fprintf (proc->log, " [0x%016lx] = %ld;\n", 
-                     proc->cmd.arg.vu64 % PROC_MEMSIZE,
-                     proc->memory[proc->cmd.arg.vu64 % PROC_MEMSIZE].v64);
+                     proc->cmd.arg.vu64 & proc->memmask,
+                     proc->memory[proc->cmd.arg.vu64 & proc->memmask].v64);
     }
     else
     {
@@ -746,10 +2818,10 @@ static void poptype_log (proc_t *proc, const char *command)
     {
         if (proc->cmd.flgreg)
             fprintf (proc->log, " [r%hhu] = [0x%016lx];\n", 
-                     proc->cmd.arg.vu8, proc->regs[proc->cmd.arg.vu8].vu64 % PROC_MEMSIZE);
+                     proc->cmd.arg.vu8, proc->regs[proc->cmd.arg.vu8].vu64 & proc->memmask);
         else
             fprintf (proc->log, " [0x%016lx];\n", 
-                     proc->cmd.arg.vu64 % PROC_MEMSIZE);
+                     proc->cmd.arg.vu64 & proc->memmask);
     }
     else
     {
@@ -778,6 +2850,16 @@ static void calltype_log (proc_t *proc, const char *command)
     return jmptype_log (proc, command);
 }
 
+static void chantype_log (proc_t *proc, const char *command)
+{
+    return pushtype_log (proc, command);
+}
+
+static void atomtype_log (proc_t *proc, const char *command)
+{
+    return poptype_log (proc, command);
+}
+
 static void stdtype_log (proc_t *proc, const char *command)
 {
     assert (proc);
@@ -798,3 +2880,16 @@ static void COMMAND##_log (proc_t *proc)\
     PROC_GEN_LOG(COMMAND, CODE, TYPE)
 
 PROC_GEN_CODE
+
+#undef PROC_GEN_CMD
+
+#define PROC_GEN_CHECK(COMMAND, CODE, TYPE)\
+static uint64_t COMMAND##_check (proc_t *proc, uint8_t *mark)\
+{\
+     return TYPE##_check (proc, mark);\
+}
+
+#define PROC_GEN_CMD(COMMAND, CODE, TYPE)\
+    PROC_GEN_CHECK(COMMAND, CODE, TYPE)
+
+PROC_GEN_CODE
@@ -2,12 +2,18 @@
 #define PROCESSOR_H_INCLUDED
 
 #include "setup.h"
+#include "object.h"
 #include <stdio.h>
+#include <pthread.h>
+
+#define PROC_CACHEMAGIC   0x48434450
+#define PROC_CACHEVERSION 0x04
 
 enum PROC_ERR
 {
     PROC_NOERR, 
     PROC_ERRCREATE,
+    PROC_ERRIMAGE,
     PROC_ERRIP, 
     PROC_ERRUNKN,
     PROC_ERRPUSH,
@@ -20,6 +26,20 @@ enum PROC_ERR
     PROC_ERRCMP,
     PROC_ERRCALL,
     PROC_ERRRET,
+    PROC_ERRSNAP,
+    PROC_ERRCLONE,
+    PROC_ERRMAP,
+    PROC_ERRIO,
+    PROC_ERRSEND,
+    PROC_ERRRECV,
+    PROC_ERRCHAN,
+    PROC_ERRSPAWN,
+    PROC_ERRJOIN,
+    PROC_ERRXADD,
+    PROC_ERRCAS,
+    PROC_ERRPFOR,
+    PROC_ERRZERO,
+    PROC_ERROVERFLOW,
 };
 
 enum PROC_STAT
@@ -27,6 +47,8 @@ enum PROC_STAT
     PROC_STHLT,
     PROC_STRUN,
     PROC_STERR,
+    PROC_STYIELD,
+    PROC_STWAIT,
 };
 
 enum PROC_OPT
@@ -34,6 +56,46 @@ enum PROC_OPT
     PROC_OPTLOG = 0x01,
 };
 
+enum PROC_IORET
+{
+    PROC_IOWAIT = 0x02,
+};
+
+enum PROC_MAPFLAGS
+{
+    PROC_MAPRW = 0x01,
+};
+
+enum PROC_PAGES
+{
+    PROC_PAGECELLS = 0x200,
+    PROC_PAGEWORDS = PROC_MEMSIZE / PROC_PAGECELLS / 64,
+};
+
+enum PROC_THREADS
+{
+    PROC_THREADMIN    = 0x10,
+    PROC_THREADBUDGET = 0x10000,
+};
+
+enum PROC_PFOR
+{
+    PROC_PFORMAX   = 0x40,
+    PROC_PFORGRAIN = 0x10,
+    PROC_PFORREG   = 0x80,
+};
+
+enum PROC_MARKS
+{
+    PROC_MARKCMD = 0x01,
+    PROC_MARKJMP = 0x02,
+};
+
+enum PROC_CMDIDX
+{
+    PROC_IDXBITS = 64,
+};
+
 enum PROC_CMPVAL
 {
     PROC_CMPEQ,
@@ -41,11 +103,29 @@ enum PROC_CMPVAL
     PROC_CMPLESS,
 };
 
-struct proc_code
+struct proc_image
 {
     void     *data;
     uint64_t  size;
-    uint64_t  ip;
+    uint64_t  mapsize;
+    uint8_t   flat;
+};
+
+/* one bit per code byte, set where a command starts; base counts the commands before the word */
+struct proc_cmdidx
+{
+    uint64_t starts;
+    uint64_t base;
+};
+
+struct proc_code
+{
+    const void               *data;
+    uint64_t                  size;
+    uint64_t                  ip;
+    const struct proc_cmd    *decoded;
+    const struct proc_cmdidx *cmdidx;
+    uint64_t                  cmdcount;
 };
 
 struct proc_stack
@@ -54,6 +134,15 @@ struct proc_stack
     uint64_t *stkret;
     uint64_t  spint;
     uint64_t  spret;
+    uint64_t  size;
+    uint64_t  inthwm;
+    uint64_t  rethwm;
+};
+
+struct proc_symtab
+{
+    struct obj_sym *data;
+    uint64_t        size;
 };
 
 struct proc_cmd
@@ -62,32 +151,130 @@ struct proc_cmd
     uint8_t   code;
     uint8_t   flgreg;
     uint8_t   flgmem;
+    uint8_t   size;
     union val arg;
 };
 
+struct proc_data
+{
+    const union val *data;
+    uint64_t         size;
+};
+
+typedef int (*proc_input_t)  (void *ctx, int64_t *val);
+typedef int (*proc_output_t) (void *ctx, int64_t val);
+
+struct proc_io
+{
+    proc_input_t   input;
+    proc_output_t  output;
+    void          *ctx;
+};
+
+struct proc_chan;
+struct processor;
+
+struct proc_thread
+{
+    struct processor *proc;
+    pthread_t         handle;
+};
+
+struct proc_threads
+{
+    struct proc_thread *data;
+    uint64_t            size;
+    uint64_t            count;
+};
+
 struct proc_error
 {
     enum PROC_ERR err;
     const char   *str;
 };
 
+struct proc_cachekey
+{
+    uint64_t path;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t  mtime[2];
+    int64_t  ctime[2];
+};
+
+struct proc_cachehdr
+{
+    uint32_t             magic;
+    uint32_t             version;
+    struct proc_cachekey key;
+    uint64_t             codesize;
+    uint64_t             cmdcount;
+    uint32_t             cmdsize;
+    uint32_t             opcount;
+};
+
+typedef struct proc_program
+{
+    struct proc_image    image;
+    struct proc_image    cache;
+    struct proc_code     code;
+    struct proc_data     data;
+    struct proc_symtab   symtab;
+    uint64_t             memsize;
+    uint64_t             stksize;
+    struct proc_error    error;
+} prog_t;
+
 typedef struct processor
 {
+    const prog_t        *prog;
+    prog_t              *own;
+    struct proc_image    image;
     struct proc_code     code;
     struct proc_stack    stack;        
     union  val          *memory;
+    uint64_t             memmask;
+    uint64_t             memdirty[PROC_PAGEWORDS];
+    uint64_t             memfile[PROC_PAGEWORDS];
+    uint64_t             memshared[PROC_PAGEWORDS];
     struct proc_cmd      cmd;
     union  val           regs[PROC_REGCOUNT];
     enum   PROC_CMPVAL   cmp;
     enum   PROC_STAT     status;
     struct proc_error    error;
+    struct proc_io       io;
+    struct proc_chan   **chan;
+    uint64_t             chancount;
+    struct proc_threads  threads;
+    struct processor    *parent;
+    uint8_t              stop;
     uint8_t              options;
     FILE                *log;
 } proc_t;
 
-int  proc_create (proc_t *proc, const char *filename);
-int  proc_run    (proc_t *proc);
-void proc_delete (proc_t *proc);
-void proc_error  (proc_t *proc);
+int  prog_create             (prog_t *prog, const char *filename);
+int  prog_create_from_buffer (prog_t *prog, const void *data, uint64_t size);
+void prog_delete             (prog_t *prog);
+void prog_error              (prog_t *prog);
+void prog_setcache           (const char *dir);
+
+int  proc_attach             (proc_t *proc, const prog_t *prog, int options);
+int  proc_create             (proc_t *proc, const char *filename, int options);
+int  proc_create_from_buffer (proc_t *proc, const void *data, uint64_t size, int options);
+int  proc_restore            (proc_t *proc, const char *filename, int options);
+int  proc_snapshot           (proc_t *proc, const char *filename);
+int  proc_clone              (proc_t *proc, proc_t *clone, size_t count);
+int  proc_mapfile            (proc_t *proc, const char *filename, const char *target, int flags);
+void proc_setio              (proc_t *proc, proc_input_t input, proc_output_t output, void *ctx);
+void proc_setchan            (proc_t *proc, struct proc_chan **chan, uint64_t count);
+int  proc_run                (proc_t *proc);
+int  proc_run_budget         (proc_t *proc, uint64_t budget);
+int  proc_reset              (proc_t *proc);
+void proc_delete             (proc_t *proc);
+void proc_error              (proc_t *proc);
+void proc_perror             (FILE *stream, const struct proc_error *error);
+
+const struct proc_cmd *proc_decoded (const struct proc_code *code, uint64_t ip);
 
 #endif
@@ -0,0 +1,343 @@
+#include "scheduler.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+enum SCHED_CONSTS
+{
+    SCHED_MINSIZE = 0x40,
+    SCHED_EVENTS  = 0x40,
+};
+
+static int     sched_grow     (sched_t *sched);
+static proc_t *sched_pop      (sched_t *sched);
+static int     sched_park     (sched_t *sched, proc_t *proc);
+static int     sched_poll     (sched_t *sched, int timeout);
+static void    sched_finish   (sched_t *sched, proc_t *proc);
+static int     sched_nowriter (int fd);
+
+static int sched_input  (void *ctx, int64_t *val);
+/* a FIFO reads empty before its first writer opens it, but only reports a hangup once a writer has left */
+static int sched_nowriter (int fd)
+{
+    struct stat   st   = {};
+    struct pollfd wait = {fd, POLLIN, 0};
+
+    return !fstat (fd, &st) && S_ISFIFO (st.st_mode) && !poll (&wait, 1, 0);
+}
+
+static int sched_output (void *ctx, int64_t val);
+
+int sched_create (sched_t *sched, uint64_t budget)
+{
+    assert (sched);
+    assert (budget);
+
+    memset (sched, 0, sizeof (*sched) );
+
+    sched->budget = budget;
+
+    if ( (sched->epoll = epoll_create1 (EPOLL_CLOEXEC) ) == -1)
+    {
+        sched->error = (struct proc_error) {PROC_ERRCREATE, strerror (errno)};
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int sched_add (sched_t *sched, proc_t *proc)
+{
+    assert (sched);
+    assert (proc);
+
+    if (sched->count == sched->size && sched_grow (sched) )
+        return EXIT_FAILURE;
+
+    sched->queue[(sched->head + sched->count++) % sched->size] = proc;
+
+    return EXIT_SUCCESS;
+}
+
+void sched_setio (proc_t *proc, struct sched_io *io, int in, int out)
+{
+    assert (proc);
+    assert (io);
+
+    memset (io, 0, sizeof (*io) );
+
+    io->in     = in;
+    io->out    = out;
+    io->waitfd = -1;
+
+    proc_setio (proc, sched_input, sched_output, io);
+}
+
+int sched_run (sched_t *sched)
+{
+    assert (sched);
+
+    proc_t *proc = NULL;
+    size_t  pass = 0;
+
+    while (sched->count || sched->waiting)
+    {
+        if (!pass)
+        {
+            if (sched->waiting && sched_poll (sched, sched->count ? 0 : -1) )
+                return EXIT_FAILURE;
+
+            pass = sched->count;
+
+            continue;
+        }
+
+        pass--;
+
+        proc = sched_pop (sched);
+
+        proc_run_budget (proc, sched->budget);
+
+        if (proc->status == PROC_STYIELD)
+            sched->queue[(sched->head + sched->count++) % sched->size] = proc;
+        else if (proc->status != PROC_STWAIT || sched_park (sched, proc) )
+            sched_finish (sched, proc);
+    }
+
+    return sched->failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void sched_delete (sched_t *sched)
+{
+    assert (sched);
+
+    free (sched->queue);
+
+    if (sched->epoll > 0)
+        close (sched->epoll);
+
+    memset (sched, 0, sizeof (*sched) );
+}
+
+void sched_error (sched_t *sched)
+{
+    assert (sched);
+
+    proc_t proc = {};
+
+    proc.error = sched->error;
+
+    proc_error (&proc);
+}
+
+static int sched_grow (sched_t *sched)
+{
+    assert (sched);
+
+    size_t   size  = sched->size ? sched->size * 2 : SCHED_MINSIZE;
+    proc_t **queue = realloc (sched->queue, size * sizeof (*queue) );
+
+    if (!queue)
+    {
+        sched->error = (struct proc_error) {PROC_ERRCREATE, strerror (errno)};
+        return EXIT_FAILURE;
+    }
+
+    memcpy (queue + sched->size, queue, sched->head * sizeof (*queue) );
+
+    sched->queue = queue;
+    sched->size  = size;
+
+    return EXIT_SUCCESS;
+}
+
+static proc_t *sched_pop (sched_t *sched)
+{
+    assert (sched);
+
+    proc_t *proc = NULL;
+
+    if (!sched->count)
+        return NULL;
+
+    proc        = sched->queue[sched->head];
+    sched->head = (sched->head + 1) % sched->size;
+
+    sched->count--;
+
+    return proc;
+}
+
+static int sched_park (sched_t *sched, proc_t *proc)
+{
+    assert (sched);
+    assert (proc);
+
+    struct sched_io    *io    = proc->io.ctx;
+    struct epoll_event  event = {};
+
+    if (proc->io.input != sched_input)
+    {
+        proc->error  = (struct proc_error) {PROC_ERRIO, "no event source to wait on"};
+        proc->status = PROC_STERR;
+
+        return EXIT_FAILURE;
+    }
+
+    event.events   = io->events;
+    event.data.ptr = proc;
+
+    if (epoll_ctl (sched->epoll, EPOLL_CTL_ADD, io->waitfd, &event) == -1)
+    {
+        proc->error  = (struct proc_error) {PROC_ERRIO, strerror (errno)};
+        proc->status = PROC_STERR;
+
+        return EXIT_FAILURE;
+    }
+
+    sched->waiting++;
+
+    return EXIT_SUCCESS;
+}
+
+static int sched_poll (sched_t *sched, int timeout)
+{
+    assert (sched);
+
+    struct epoll_event event[SCHED_EVENTS] = {};
+    int                count               = 0;
+
+    if ( (count = epoll_wait (sched->epoll, event, SCHED_EVENTS, timeout) ) == -1)
+    {
+        if (errno == EINTR)
+            return EXIT_SUCCESS;
+
+        sched->error = (struct proc_error) {PROC_ERRIO, strerror (errno)};
+
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        proc_t          *proc = event[i].data.ptr;
+        struct sched_io *io   = proc->io.ctx;
+
+        epoll_ctl (sched->epoll, EPOLL_CTL_DEL, io->waitfd, NULL);
+
+        sched->queue[(sched->head + sched->count++) % sched->size] = proc;
+        sched->waiting--;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void sched_finish (sched_t *sched, proc_t *proc)
+{
+    assert (sched);
+    assert (proc);
+
+    if (proc->status == PROC_STERR)
+        sched->failed++;
+
+    if (sched->done)
+        sched->done (sched->ctx, proc);
+}
+
+static int sched_input (void *ctx, int64_t *val)
+{
+    assert (ctx);
+    assert (val);
+
+    struct sched_io *io    = ctx;
+    ssize_t          count = 0;
+    size_t           end   = 0;
+    char            *last  = NULL;
+
+    while (1)
+    {
+        while (io->inpos < io->inlen && isspace ( (unsigned char) io->inbuf[io->inpos]) )
+            io->inpos++;
+
+        for (end = io->inpos; end < io->inlen && !isspace ( (unsigned char) io->inbuf[end]); end++)
+            ;
+
+        if (io->inpos < end && (end < io->inlen || io->eof) )
+        {
+            io->inbuf[end] = '\0';
+
+            *val = strtoll (io->inbuf + io->inpos, &last, 10);
+
+            io->inpos = (end < io->inlen) ? end + 1 : end;
+
+            return (last == io->inbuf + end) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (io->eof)
+            return EXIT_FAILURE;
+
+        memmove (io->inbuf, io->inbuf + io->inpos, io->inlen - io->inpos);
+
+        io->inlen -= io->inpos;
+        io->inpos  = 0;
+
+        if (io->inlen == SCHED_INSIZE)
+            return EXIT_FAILURE;
+
+        if ( (count = read (io->in, io->inbuf + io->inlen, SCHED_INSIZE - io->inlen) ) > 0)
+            io->inlen += (size_t) count;
+        else if (!count && !sched_nowriter (io->in) )
+            io->eof = 1;
+        else if (!count || errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            io->waitfd = io->in;
+            io->events = EPOLLIN;
+
+            return PROC_IOWAIT;
+        }
+        else if (errno != EINTR)
+            return EXIT_FAILURE;
+    }
+}
+
+static int sched_output (void *ctx, int64_t val)
+{
+    assert (ctx);
+
+    struct sched_io *io    = ctx;
+    ssize_t          count = 0;
+
+    if (!io->outlen)
+    {
+        io->outlen = (size_t) snprintf (io->outbuf, sizeof (io->outbuf), "%ld\n", val);
+        io->outpos = 0;
+    }
+
+    while (io->outpos < io->outlen)
+    {
+        if ( (count = write (io->out, io->outbuf + io->outpos, io->outlen - io->outpos) ) > 0)
+            io->outpos += (size_t) count;
+        else if (count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+        {
+            io->waitfd = io->out;
+            io->events = EPOLLOUT;
+
+            return PROC_IOWAIT;
+        }
+        else if (count == 0 || errno != EINTR)
+        {
+            io->outlen = 0;
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    io->outlen = 0;
+
+    return EXIT_SUCCESS;
+}
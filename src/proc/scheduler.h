@@ -0,0 +1,53 @@
+#ifndef SCHEDULER_H_INCLUDED
+#define SCHEDULER_H_INCLUDED
+
+#include "processor.h"
+#include <stddef.h>
+#include <stdint.h>
+
+enum SCHED_IOSIZES
+{
+    SCHED_INSIZE  = 0x1000,
+    SCHED_OUTSIZE = 0x20,
+};
+
+typedef void (*sched_done_t) (void *ctx, proc_t *proc);
+
+struct sched_io
+{
+    int       in;
+    int       out;
+    int       waitfd;
+    uint32_t  events;
+    uint8_t   eof;
+    size_t    inpos;
+    size_t    inlen;
+    size_t    outpos;
+    size_t    outlen;
+    char      inbuf[SCHED_INSIZE + 1];
+    char      outbuf[SCHED_OUTSIZE];
+};
+
+typedef struct proc_sched
+{
+    proc_t           **queue;
+    size_t             size;
+    size_t             head;
+    size_t             count;
+    size_t             waiting;
+    int                epoll;
+    uint64_t           budget;
+    size_t             failed;
+    sched_done_t       done;
+    void              *ctx;
+    struct proc_error  error;
+} sched_t;
+
+int  sched_create (sched_t *sched, uint64_t budget);
+int  sched_add    (sched_t *sched, proc_t *proc);
+void sched_setio  (proc_t *proc, struct sched_io *io, int in, int out);
+int  sched_run    (sched_t *sched);
+void sched_delete (sched_t *sched);
+void sched_error  (sched_t *sched);
+
+#endif
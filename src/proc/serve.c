@@ -0,0 +1,805 @@
+#define _GNU_SOURCE
+
+#include "serve.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+struct serve_conn
+{
+    serve_t *serve;
+    int      fd;
+};
+
+struct serve_io
+{
+    char *pos;
+    char *end;
+    FILE *out;
+};
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static const char        *serve_strerror (enum SERVE_ERR err);
+static void               serve_signal   (int sig);
+static void              *serve_client   (void *arg);
+static char              *serve_read     (int fd, size_t *len);
+static int                serve_write    (int fd, const void *data, size_t size);
+static int                serve_exec     (serve_t *serve, proc_t *vm, const char **errstr);
+static struct serve_prog *serve_acquire  (serve_t *serve, const char *path, proc_t **vm, struct proc_error *error);
+static struct serve_prog *serve_lookup   (serve_t *serve, const char *path, const struct stat *st);
+static void               serve_release  (serve_t *serve, struct serve_prog *entry, proc_t *vm);
+static void               serve_free     (struct serve_prog *entry);
+
+static int serve_input  (void *ctx, int64_t *val);
+static int serve_output (void *ctx, int64_t val);
+
+int serve_create (serve_t *serve, const char *path)
+{
+    assert (serve);
+    assert (path);
+
+    struct sockaddr_un addr = {AF_UNIX, {}};
+    struct stat        st   = {};
+
+    memset (serve, 0, sizeof (*serve) );
+
+    serve->path   = path;
+    serve->sock   = -1;
+    serve->budget = SERVE_BUDGET;
+
+    pthread_mutex_init (&serve->lock, NULL);
+    pthread_cond_init  (&serve->done, NULL);
+
+    if (strlen (path) >= sizeof (addr.sun_path) )
+    {
+        serve->error = (struct serve_error) {SERVE_ERRCREATE, "socket path is too long"};
+
+        return EXIT_FAILURE;
+    }
+
+    strcpy (addr.sun_path, path);
+
+    if (!stat (path, &st) && S_ISSOCK (st.st_mode) )
+        unlink (path);
+
+    errno = 0;
+
+    if ( (serve->sock = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0) ) == -1 ||
+         bind (serve->sock, (struct sockaddr *) &addr, sizeof (addr) ) ||
+         listen (serve->sock, SERVE_BACKLOG) )
+    {
+        serve->error = (struct serve_error) {SERVE_ERRCREATE, strerror (errno)};
+
+        return EXIT_FAILURE;
+    }
+
+    serve->listening = 1;
+
+    return EXIT_SUCCESS;
+}
+
+int serve_run (serve_t *serve)
+{
+    assert (serve);
+    assert (serve->listening);
+
+    struct sigaction action = {};
+    struct pollfd    wait   = {serve->sock, POLLIN, 0};
+    sigset_t         block  = {};
+    sigset_t         old    = {};
+
+    action.sa_handler = serve_signal;
+
+    sigaction (SIGINT,  &action, NULL);
+    sigaction (SIGTERM, &action, NULL);
+    signal    (SIGPIPE, SIG_IGN);
+
+    sigemptyset (&block);
+    sigaddset   (&block, SIGINT);
+    sigaddset   (&block, SIGTERM);
+
+    /* SIGINT and SIGTERM only get through while waiting, so a stop can't slip in between the serve_stop check
+       and the wait; workers inherit the mask and leave the signals to this thread */
+    pthread_sigmask (SIG_BLOCK, &block, &old);
+
+    while (!serve_stop)
+    {
+        struct serve_conn *conn   = NULL;
+        pthread_attr_t     attr   = {};
+        pthread_t          thread = 0;
+        int                fd     = -1;
+
+        pthread_mutex_lock (&serve->lock);
+
+        /* a stop while waiting for a free request makes the running ones end within a slice */
+        while (serve->active >= SERVE_MAXCONN && !serve_stop)
+        {
+            pthread_sigmask (SIG_SETMASK, &old, NULL);
+            pthread_cond_wait (&serve->done, &serve->lock);
+            pthread_sigmask (SIG_BLOCK, &block, NULL);
+        }
+
+        pthread_mutex_unlock (&serve->lock);
+
+        if (serve_stop)
+            break;
+
+        if (ppoll (&wait, 1, NULL, &old) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            serve->error = (struct serve_error) {SERVE_ERRACCEPT, strerror (errno)};
+            break;
+        }
+
+        if ( (fd = accept4 (serve->sock, NULL, NULL, SOCK_CLOEXEC) ) == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            serve->error = (struct serve_error) {SERVE_ERRACCEPT, strerror (errno)};
+            break;
+        }
+
+        if (!(conn = malloc (sizeof (*conn) ) ) )
+        {
+            close (fd);
+            continue;
+        }
+
+        *conn = (struct serve_conn) {serve, fd};
+
+        pthread_mutex_lock (&serve->lock);
+        serve->active++;
+        pthread_mutex_unlock (&serve->lock);
+
+        pthread_attr_init (&attr);
+        pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+
+        if (pthread_create (&thread, &attr, serve_client, conn) )
+        {
+            close (fd);
+            free (conn);
+
+            pthread_mutex_lock (&serve->lock);
+            serve->active--;
+            pthread_mutex_unlock (&serve->lock);
+        }
+
+        pthread_attr_destroy (&attr);
+    }
+
+    pthread_mutex_lock (&serve->lock);
+
+    while (serve->active)
+        pthread_cond_wait (&serve->done, &serve->lock);
+
+    pthread_mutex_unlock (&serve->lock);
+
+    pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+    return serve->error.err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int serve_connect (serve_t *serve, const char *path)
+{
+    assert (serve);
+    assert (path);
+
+    struct sockaddr_un addr = {AF_UNIX, {}};
+
+    memset (serve, 0, sizeof (*serve) );
+
+    serve->path = path;
+    serve->sock = -1;
+
+    pthread_mutex_init (&serve->lock, NULL);
+    pthread_cond_init  (&serve->done, NULL);
+
+    if (strlen (path) >= sizeof (addr.sun_path) )
+    {
+        serve->error = (struct serve_error) {SERVE_ERRCONNECT, "socket path is too long"};
+
+        return EXIT_FAILURE;
+    }
+
+    strcpy (addr.sun_path, path);
+
+    errno = 0;
+
+    if ( (serve->sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) ) == -1 ||
+         connect (serve->sock, (struct sockaddr *) &addr, sizeof (addr) ) )
+    {
+        serve->error = (struct serve_error) {SERVE_ERRCONNECT, strerror (errno)};
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int serve_request (serve_t *serve, const char *program, int input, FILE *output)
+{
+    assert (serve);
+    assert (program);
+    assert (output);
+
+    char     buf[SERVE_BUFSIZE] = {};
+    char    *real               = NULL;
+    FILE    *reply              = NULL;
+    ssize_t  len                = 0;
+    int      status             = -1;
+
+    errno = 0;
+
+    if (!(real = realpath (program, NULL) ) )
+    {
+        serve->error = (struct serve_error) {SERVE_ERRPROG, strerror (errno)};
+
+        return EXIT_FAILURE;
+    }
+
+    len = snprintf (buf, sizeof (buf), "run %s\n", real);
+
+    free (real);
+
+    if (len >= (ssize_t) sizeof (buf) || serve_write (serve->sock, buf, (size_t) len) )
+    {
+        serve->error = (struct serve_error) {SERVE_ERRCONNECT, strerror (errno)};
+
+        return EXIT_FAILURE;
+    }
+
+    while ( (len = read (input, buf, sizeof (buf) ) ) > 0)
+        if (serve_write (serve->sock, buf, (size_t) len) )
+            break;
+
+    shutdown (serve->sock, SHUT_WR);
+
+    if (!(reply = fdopen (dup (serve->sock), "r") ) )
+    {
+        serve->error = (struct serve_error) {SERVE_ERRCONNECT, strerror (errno)};
+
+        return EXIT_FAILURE;
+    }
+
+    while (fgets (buf, sizeof (buf), reply) )
+    {
+        char *msg = NULL;
+
+        if (strncmp (buf, "exit ", 5) )
+        {
+            fputs (buf, output);
+            continue;
+        }
+
+        status = (int) strtol (buf + 5, &msg, 10);
+
+        if (status && *msg == ' ')
+            fputs (msg + 1, stderr);
+    }
+
+    fclose (reply);
+
+    if (status == -1)
+    {
+        serve->error = (struct serve_error) {SERVE_ERRREPLY, NULL};
+
+        return EXIT_FAILURE;
+    }
+
+    return status ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void serve_delete (serve_t *serve)
+{
+    assert (serve);
+
+    if (serve->sock != -1)
+        close (serve->sock);
+
+    if (serve->listening)
+        unlink (serve->path);
+
+    for (size_t i = 0; i < serve->count; i++)
+        serve_free (serve->prog[i]);
+
+    free (serve->prog);
+
+    pthread_mutex_destroy (&serve->lock);
+    pthread_cond_destroy  (&serve->done);
+
+    memset (serve, 0, sizeof (*serve) );
+
+    serve->sock = -1;
+}
+
+void serve_error (serve_t *serve)
+{
+    assert (serve);
+
+    fprintf (stderr, "%s: %s", serve->path ? serve->path : "serve", serve_strerror (serve->error.err) );
+
+    if (serve->error.str)
+        fprintf (stderr, ": %s", serve->error.str);
+
+    fprintf (stderr, "\n");
+}
+
+static const char *serve_strerror (enum SERVE_ERR err)
+{
+    switch (err)
+    {
+        case SERVE_NOERR:
+            return "No errors";
+        case SERVE_ERRCREATE:
+            return "Can't create socket";
+        case SERVE_ERRACCEPT:
+            return "Can't accept connection";
+        case SERVE_ERRCONNECT:
+            return "Can't connect to server";
+        case SERVE_ERRPROG:
+            return "Can't read program";
+        case SERVE_ERRREPLY:
+            return "Bad reply from server";
+    }
+
+    return "Undefined error";
+}
+
+static void serve_signal (int sig)
+{
+    (void) sig;
+
+    serve_stop = 1;
+}
+
+static void *serve_client (void *arg)
+{
+    assert (arg);
+
+    struct serve_conn *conn   = arg;
+    serve_t           *serve  = conn->serve;
+    int                fd     = conn->fd;
+    struct serve_prog *entry  = NULL;
+    struct serve_io    io     = {};
+    struct proc_error  error  = {};
+    prog_t             prog   = {};
+    proc_t            *vm     = NULL;
+    const char        *errstr = NULL;
+    char              *req    = NULL;
+    char              *body   = NULL;
+    size_t             len    = 0;
+
+    free (conn);
+
+    do
+    {
+        if (!(io.out = fdopen (fd, "w") ) )
+        {
+            close (fd);
+            break;
+        }
+
+        if (!(req = serve_read (fd, &len) ) )
+        {
+            errstr = "can't read request";
+            break;
+        }
+
+        if (!(body = memchr (req, '\n', len) ) )
+        {
+            errstr = "bad request";
+            break;
+        }
+
+        *body++ = '\0';
+
+        if (!strncmp (req, "run ", 4) )
+        {
+            if (!(entry = serve_acquire (serve, req + 4, &vm, &error) ) )
+                break;
+        }
+        else if (!strncmp (req, "exec ", 5) )
+        {
+            size_t size = strtoull (req + 5, NULL, 0);
+
+            if (size > (size_t) (req + len - body) )
+            {
+                errstr = "image is truncated";
+                break;
+            }
+
+            if (prog_create_from_buffer (&prog, body, size) )
+            {
+                error = prog.error;
+                break;
+            }
+
+            body += size;
+
+            if (!(vm = calloc (1, sizeof (*vm) ) ) || proc_attach (vm, &prog, 0) )
+            {
+                error = vm ? vm->error : (struct proc_error) {PROC_ERRCREATE, strerror (errno)};
+                break;
+            }
+        }
+        else
+        {
+            errstr = "bad request";
+            break;
+        }
+
+        io.pos = body;
+        io.end = req + len;
+
+        proc_setio (vm, serve_input, serve_output, &io);
+
+        if (serve_exec (serve, vm, &errstr) )
+            error = vm->error;
+    }
+    while (0);
+
+    if (io.out)
+    {
+        if (error.err)
+        {
+            fprintf (io.out, "exit 1 ");
+            proc_perror (io.out, &error);
+        }
+        else if (errstr)
+            fprintf (io.out, "exit 1 %s\n", errstr);
+        else
+            fprintf (io.out, "exit 0\n");
+
+        fclose (io.out);
+    }
+
+    if (entry)
+        serve_release (serve, entry, vm);
+    else if (vm)
+    {
+        if (vm->prog)
+            proc_delete (vm);
+
+        free (vm);
+    }
+
+    if (prog.image.data)
+        prog_delete (&prog);
+
+    free (req);
+
+    pthread_mutex_lock (&serve->lock);
+
+    serve->active--;
+
+    pthread_cond_signal (&serve->done);
+
+    pthread_mutex_unlock (&serve->lock);
+
+    return NULL;
+}
+
+static char *serve_read (int fd, size_t *len)
+{
+    assert (len);
+
+    size_t  size = SERVE_BUFSIZE;
+    char   *data = malloc (size + 1);
+    ssize_t ret  = 0;
+
+    *len = 0;
+
+    while (data && (ret = read (fd, data + *len, size - *len) ) > 0)
+    {
+        *len += (size_t) ret;
+
+        if (*len == size)
+        {
+            char *next = (size < SERVE_MAXREQ) ? realloc (data, size * 2 + 1) : NULL;
+
+            if (!next)
+                break;
+
+            data  = next;
+            size *= 2;
+        }
+    }
+
+    if (!data || ret)
+    {
+        free (data);
+
+        return NULL;
+    }
+
+    data[*len] = '\0';
+
+    return data;
+}
+
+static int serve_write (int fd, const void *data, size_t size)
+{
+    assert (data);
+
+    while (size)
+    {
+        ssize_t ret = write (fd, data, size);
+
+        if (ret < 0 && errno == EINTR)
+            continue;
+
+        if (ret <= 0)
+            return EXIT_FAILURE;
+
+        data  = (const char *) data + ret;
+        size -= (size_t) ret;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* runs the budget in slices, so a shutdown does not wait for a long request */
+static int serve_exec (serve_t *serve, proc_t *vm, const char **errstr)
+{
+    assert (serve);
+    assert (vm);
+    assert (errstr);
+
+    uint64_t left = serve->budget;
+
+    while (!serve_stop && (!serve->budget || left) )
+    {
+        uint64_t slice = (serve->budget && left < SERVE_SLICE) ? left : SERVE_SLICE;
+
+        if (proc_run_budget (vm, slice) )
+            return EXIT_FAILURE;
+
+        if (vm->status != PROC_STYIELD)
+            return EXIT_SUCCESS;
+
+        if (serve->budget)
+            left -= slice;
+    }
+
+    *errstr = serve_stop ? "server is shutting down" : "timeout: instruction budget exhausted";
+
+    return EXIT_SUCCESS;
+}
+
+/* cached programs are checked against the file on every request and reloaded when it changed;
+   a program is loaded and verified outside the lock, which is only taken to look it up and publish it */
+static struct serve_prog *serve_acquire (serve_t *serve, const char *path, proc_t **vm, struct proc_error *error)
+{
+    assert (serve);
+    assert (path);
+    assert (vm);
+    assert (error);
+
+    struct serve_prog *entry  = NULL;
+    struct serve_prog *loaded = NULL;
+    struct stat        st     = {};
+
+    if (stat (path, &st) )
+    {
+        *error = (struct proc_error) {PROC_ERRCREATE, strerror (errno)};
+
+        return NULL;
+    }
+
+    pthread_mutex_lock (&serve->lock);
+
+    if ( (entry = serve_lookup (serve, path, &st) ) )
+    {
+        entry->users++;
+
+        *vm = entry->idlecount ? entry->idle[--entry->idlecount] : NULL;
+    }
+
+    pthread_mutex_unlock (&serve->lock);
+
+    if (!entry)
+    {
+        if (!(loaded = calloc (1, sizeof (*loaded) ) ) || !(loaded->path = strdup (path) ) )
+        {
+            *error = (struct proc_error) {PROC_ERRCREATE, strerror (errno)};
+
+            free (loaded);
+
+            return NULL;
+        }
+
+        if (prog_create (&loaded->prog, path) )
+        {
+            *error = loaded->prog.error;
+
+            serve_free (loaded);
+
+            return NULL;
+        }
+
+        loaded->dev   = st.st_dev;
+        loaded->ino   = st.st_ino;
+        loaded->size  = st.st_size;
+        loaded->mtime = st.st_mtim;
+
+        pthread_mutex_lock (&serve->lock);
+
+        /* another request may have published the same file meanwhile */
+        do
+        {
+            if ( (entry = serve_lookup (serve, path, &st) ) )
+                break;
+
+            if (serve->count == serve->size)
+            {
+                size_t              size = serve->size ? serve->size * 2 : SERVE_CACHEMIN;
+                struct serve_prog **data = realloc (serve->prog, size * sizeof (*data) );
+
+                if (!data)
+                {
+                    *error = (struct proc_error) {PROC_ERRCREATE, strerror (errno)};
+                    break;
+                }
+
+                serve->prog = data;
+                serve->size = size;
+            }
+
+            entry  = loaded;
+            loaded = NULL;
+
+            serve->prog[serve->count++] = entry;
+        }
+        while (0);
+
+        if (entry)
+        {
+            entry->users++;
+
+            *vm = entry->idlecount ? entry->idle[--entry->idlecount] : NULL;
+        }
+
+        pthread_mutex_unlock (&serve->lock);
+
+        if (loaded)
+            serve_free (loaded);
+    }
+
+    if (!entry || *vm)
+        return entry;
+
+    if (!(*vm = calloc (1, sizeof (**vm) ) ) || proc_attach (*vm, &entry->prog, 0) )
+    {
+        *error = *vm ? (*vm)->error : (struct proc_error) {PROC_ERRCREATE, strerror (errno)};
+
+        serve_release (serve, entry, *vm);
+
+        *vm = NULL;
+
+        return NULL;
+    }
+
+    return entry;
+}
+
+/* called with the lock held: the entry for an unchanged file, a changed one is dropped */
+static struct serve_prog *serve_lookup (serve_t *serve, const char *path, const struct stat *st)
+{
+    assert (serve);
+    assert (path);
+    assert (st);
+
+    for (size_t i = 0; i < serve->count; i++)
+    {
+        struct serve_prog *cur = serve->prog[i];
+
+        if (strcmp (cur->path, path) )
+            continue;
+
+        if (cur->dev == st->st_dev && cur->ino == st->st_ino && cur->size == st->st_size &&
+            cur->mtime.tv_sec == st->st_mtim.tv_sec && cur->mtime.tv_nsec == st->st_mtim.tv_nsec)
+            return cur;
+
+        cur->stale     = 1;
+        serve->prog[i] = serve->prog[--serve->count];
+
+        if (!cur->users)
+            serve_free (cur);
+
+        break;
+    }
+
+    return NULL;
+}
+
+static void serve_release (serve_t *serve, struct serve_prog *entry, proc_t *vm)
+{
+    assert (serve);
+    assert (entry);
+
+    int last = 0;
+
+    if (vm && vm->prog && proc_reset (vm) )
+        proc_delete (vm);
+
+    pthread_mutex_lock (&serve->lock);
+
+    if (vm && vm->prog && !entry->stale && entry->idlecount < SERVE_IDLE)
+    {
+        entry->idle[entry->idlecount++] = vm;
+
+        vm = NULL;
+    }
+
+    last = !--entry->users && entry->stale;
+
+    pthread_mutex_unlock (&serve->lock);
+
+    if (vm)
+    {
+        if (vm->prog)
+            proc_delete (vm);
+
+        free (vm);
+    }
+
+    if (last)
+        serve_free (entry);
+}
+
+static void serve_free (struct serve_prog *entry)
+{
+    assert (entry);
+
+    for (size_t i = 0; i < entry->idlecount; i++)
+    {
+        proc_delete (entry->idle[i]);
+        free (entry->idle[i]);
+    }
+
+    if (entry->prog.image.data)
+        prog_delete (&entry->prog);
+
+    free (entry->path);
+    free (entry);
+}
+
+static int serve_input (void *ctx, int64_t *val)
+{
+    assert (ctx);
+    assert (val);
+
+    struct serve_io *io   = ctx;
+    char            *next = NULL;
+
+    *val = strtoll (io->pos, &next, 10);
+
+    if (next == io->pos || next > io->end)
+        return EXIT_FAILURE;
+
+    io->pos = next;
+
+    return EXIT_SUCCESS;
+}
+
+static int serve_output (void *ctx, int64_t val)
+{
+    assert (ctx);
+
+    struct serve_io *io = ctx;
+
+    return (fprintf (io->out, "%ld\n", val) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+#ifndef SERVE_H_INCLUDED
+#define SERVE_H_INCLUDED
+
+#include "processor.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/* request: "run <path>" or "exec <size>" line, <size> image bytes for exec, then input up to EOF;
+   reply:   output values, one per line, then "exit 0" or "exit 1 <error>";
+   a request runs at most budget instructions, 0 is no limit; at most SERVE_MAXCONN requests run at once,
+   more wait in the listen backlog */
+
+enum SERVE_CONSTS
+{
+    SERVE_BACKLOG  = 0x40,
+    SERVE_IDLE     = 0x10,
+    SERVE_CACHEMIN = 0x10,
+    SERVE_BUFSIZE  = 0x1000,
+    SERVE_MAXREQ   = 0x1000000,
+    SERVE_BUDGET   = 0x40000000,
+    SERVE_SLICE    = 0x100000,
+    SERVE_MAXCONN  = 0x20,
+};
+
+enum SERVE_ERR
+{
+    SERVE_NOERR,
+    SERVE_ERRCREATE,
+    SERVE_ERRACCEPT,
+    SERVE_ERRCONNECT,
+    SERVE_ERRPROG,
+    SERVE_ERRREPLY,
+};
+
+struct serve_prog
+{
+    char            *path;
+    dev_t            dev;
+    ino_t            ino;
+    off_t            size;
+    struct timespec  mtime;
+    prog_t           prog;
+    proc_t          *idle[SERVE_IDLE];
+    size_t           idlecount;
+    size_t           users;
+    uint8_t          stale;
+};
+
+struct serve_error
+{
+    enum SERVE_ERR  err;
+    const char     *str;
+};
+
+typedef struct serve
+{
+    const char          *path;
+    int                  sock;
+    uint8_t              listening;
+    struct serve_prog  **prog;
+    size_t               count;
+    size_t               size;
+    size_t               active;
+    uint64_t             budget;
+    pthread_mutex_t      lock;
+    pthread_cond_t       done;
+    struct serve_error   error;
+} serve_t;
+
+int  serve_create  (serve_t *serve, const char *path);
+int  serve_run     (serve_t *serve);
+int  serve_connect (serve_t *serve, const char *path);
+int  serve_request (serve_t *serve, const char *program, int input, FILE *output);
+void serve_delete  (serve_t *serve);
+void serve_error   (serve_t *serve);
+
+#endif
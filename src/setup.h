@@ -21,6 +21,16 @@
     PROC_GEN_CMD(jle , CMD_JLE , jmptype)\
     PROC_GEN_CMD(in  , CMD_IN  , stdtype)\
     PROC_GEN_CMD(out , CMD_OUT , stdtype)\
+    PROC_GEN_CMD(send, CMD_SEND, chantype)\
+    PROC_GEN_CMD(recv, CMD_RECV, chantype)\
+    PROC_GEN_CMD(spawn, CMD_SPAWN, calltype)\
+    PROC_GEN_CMD(join, CMD_JOIN, stdtype)\
+    PROC_GEN_CMD(xadd, CMD_XADD, atomtype)\
+    PROC_GEN_CMD(cas , CMD_CAS , atomtype)\
+    PROC_GEN_CMD(fence, CMD_FENCE, stdtype)\
+    PROC_GEN_CMD(pfor, CMD_PFOR, calltype)\
+    PROC_GEN_CMD(pformin, CMD_PFORMIN, calltype)\
+    PROC_GEN_CMD(pformax, CMD_PFORMAX, calltype)\
 
 #define PROC_GEN_CMD(cmd, CODE, TYPE)\
     CODE,
@@ -39,6 +49,16 @@ enum PROC_CMDFLAGS
     CMD_FLGMEM = 0x40,
 };
 
+enum PROC_ARGCLASS
+{
+    ARG_CLS8    = 0x00,
+    ARG_CLS16   = 0x01,
+    ARG_CLS32   = 0x02,
+    ARG_CLS64   = 0x03,
+    ARG_CLSMASK = 0x03,
+    ARG_SHIFT   = 0x02,
+};
+
 enum PROC_CONSTS
 {
     PROC_CMDCOUNT = 0x100,
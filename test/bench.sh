@@ -0,0 +1,39 @@
+#!/bin/sh
+# Load-time benchmark, run by "make bench" against the tools in bin/.
+#
+# Builds an image of about 6 MB of code that halts at once, then times loading
+# it without the program cache, on a cache miss and on a cache hit (proc -C).
+
+bin=$(cd "${1:-../bin}" && pwd) || exit 1
+tmp=$(mktemp -d) || exit 1
+runs=${RUNS:-10}
+
+trap 'rm -rf "$tmp"' EXIT
+trap 'exit 1' INT TERM
+
+# time_us <cache to drop or -> <proc arguments>: microseconds per load, over $runs loads
+time_us ()
+{
+    drop=$1
+    shift
+    start=$(date +%s%N)
+
+    for i in $(seq "$runs")
+    do
+        [ "$drop" = - ] || rm -rf "$drop"
+        "$bin/proc" -q "$@" > /dev/null || exit 1
+    done
+
+    echo $(( ($(date +%s%N) - start) / 1000 / runs ))
+}
+
+awk 'BEGIN { print "hlt"; for (i = 0; i < 600000; i++) print "push 1000\npop r1\npush r1\nadd 7\npop r2" }' \
+    > "$tmp/bench.assm"
+(cd "$tmp" && "$bin/assm" bench.assm > /dev/null) || exit 1
+
+cd "$tmp" || exit 1
+
+echo "Image: $(wc -c < bench.proc) bytes, $runs runs"
+echo "No cache:   $(time_us - bench.proc) us"
+echo "Cache miss: $(time_us cache -C cache bench.proc) us"
+echo "Cache hit:  $(time_us - -C cache bench.proc) us"
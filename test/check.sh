@@ -0,0 +1,769 @@
+#!/bin/sh
+# Regression suite, run by "make check" against the tools in bin/.
+#
+# Every <name>.assm that has a <name>.out is assembled and run with <name>.in
+# (if present) on stdin. Its stdout and stderr followed by an "exit <status>"
+# line must match <name>.out. A <name>.err instead holds the error the
+# assembler must report. The check_* functions drive features that take more
+# than one program run.
+
+bin=$(cd "${1:-../bin}" && pwd) || exit 1
+src=$(cd "$(dirname "$0")" && pwd) || exit 1
+tmp=$(mktemp -d) || exit 1
+
+trap 'rm -rf "$tmp"' EXIT
+trap 'exit 1' INT TERM
+
+passed=0
+failed=0
+
+fail ()
+{
+    failed=$((failed + 1))
+    echo "FAIL: $*"
+}
+
+expect ()
+{
+    if [ "$2" = "$3" ]
+    then
+        passed=$((passed + 1))
+    else
+        fail "$1"
+        printf 'expected:\n%s\ngot:\n%s\n' "$2" "$3"
+    fi
+}
+
+# assemble <name> [assm options]: test/<name>.assm into $tmp/<name>.proc
+assemble ()
+{
+    unit=$1
+    shift
+    cp "$src/$unit.assm" "$tmp/$unit.assm" && (cd "$tmp" && "$bin/assm" "$@" "$unit.assm" > /dev/null)
+}
+
+# run_reset <reset arguments>: output, errors and exit status of test/reset.c
+run_reset ()
+{
+    (cd "$tmp" && ./reset "$@" 2>&1; echo "exit $?")
+}
+
+# build <name>: test/<name>.c against bin/libproc.a into $tmp/<name>
+build ()
+{
+    ${CC:-gcc} -Wall -Wextra -Werror -I"$src/../src" -I"$src/../src/proc" -o "$tmp/$1" "$src/$1.c" "$bin/libproc.a" -pthread
+}
+
+# run <input> <proc arguments>: output, errors and exit status of one run
+run ()
+{
+    input=$1
+    shift
+    (cd "$tmp" && "$bin/proc" -q "$@" < "$input" 2>&1; echo "exit $?")
+}
+
+check_programs ()
+{
+    for file in "$src"/*.assm
+    do
+        name=$(basename "$file" .assm)
+
+        if [ -f "$src/$name.err" ]
+        then
+            cp "$file" "$tmp/$name.assm"
+            expect "$name" "$(cat "$src/$name.err")" "$(cd "$tmp" && "$bin/assm" "$name.assm" 2>&1 > /dev/null)"
+            continue
+        fi
+
+        [ -f "$src/$name.out" ] || continue
+
+        input=/dev/null
+        [ -f "$src/$name.in" ] && input="$src/$name.in"
+
+        if ! assemble "$name"
+        then
+            fail "$name: assembly"
+            continue
+        fi
+
+        expect "$name" "$(cat "$src/$name.out")" "$(run "$input" "$name.proc")"
+    done
+}
+
+# objects link in any order, the entry is the "main" or -e symbol
+check_link ()
+{
+    for unit in linkmain linklib linkaux linkdup
+    do
+        assemble $unit -c || fail "$unit: assembly"
+    done
+
+    link ()
+    {
+        (cd "$tmp" && "$bin/link" "$@" 2>&1; echo "exit $?")
+    }
+
+    expect "link: main first" "exit 0" "$(link -o main.proc linkmain.obj linklib.obj)"
+    expect "link: main first, run" "$(printf '49\n42\nexit 0')" "$(echo 7 | run /dev/stdin main.proc)"
+
+    expect "link: main last" "exit 0" "$(link -o last.proc linklib.obj linkaux.obj linkmain.obj)"
+    expect "link: main last, run" "$(printf '49\n42\nexit 0')" "$(echo 7 | run /dev/stdin last.proc)"
+
+    expect "link: undefined" "$(printf 'ERROR: linkmain.obj: obj_patch: Undefined symbol: "SQUARE"\nexit 1')" \
+           "$(link -o undef.proc linkmain.obj linkaux.obj)"
+
+    expect "link: duplicate" "$(printf 'ERROR: linkdup.obj: sym_insert: Redefinition: "SQUARE": linklib.obj\nexit 1')" \
+           "$(link -o dup.proc linkmain.obj linklib.obj linkdup.obj)"
+
+    expect "link: no entry" \
+           "$(printf 'ERROR: link_entry: Undefined symbol: "main": entry point is required to link several objects\nexit 1')" \
+           "$(link -o noentry.proc linklib.obj linkaux.obj)"
+
+    expect "link: bad entry" "$(printf 'ERROR: link_entry: Undefined symbol: "start": entry point\nexit 1')" \
+           "$(link -e start -o bad.proc linkmain.obj linklib.obj)"
+
+    expect "link: named entry" "exit 0" "$(link -e START -o start.proc linklib.obj linkaux.obj)"
+    expect "link: named entry, run" "$(printf '125\nexit 0')" "$(run /dev/null start.proc)"
+}
+
+# header memory hint: "<memsize> <stksize>" of an image
+hints ()
+{
+    od -A n -t x8 -j 16 -N 16 "$tmp/$1" | awk '{ print $1, $2 }'
+}
+
+# memory is sized from the highest address in use, the stack from -s
+check_hints ()
+{
+    expect "hints: factorial" "0000000000000200 0000000000010000" "$(hints factorial.proc)"
+    expect "hints: sum" "0000000000010000 0000000000010000" "$(hints sum.proc)"
+
+    assemble hints -s 256 || fail "hints: assembly"
+    expect "hints: res and -s" "0000000000000400 0000000000000100" "$(hints hints.proc)"
+    expect "hints: run" "$(printf '7\nexit 0')" "$(run /dev/null hints.proc)"
+
+    assemble hints -c || fail "hints: object"
+    (cd "$tmp" && "$bin/link" -s 512 -o linked.proc hints.obj) || fail "hints: link"
+    expect "hints: link" "0000000000000400 0000000000000200" "$(hints linked.proc)"
+
+    expect "hints: bad stack" "exit 1" "$(cd "$tmp" && "$bin/assm" -s 0x100000 hints.assm > /dev/null 2>&1; echo "exit $?")"
+}
+
+# assm -C: unchanged units hit the cache, edited ones miss
+check_cache ()
+{
+    cache ()
+    {
+        (cd "$tmp" && "$bin/assm" -C cache cache.assm 2>&1; echo "exit $?")
+    }
+
+    cp "$src/cache.assm" "$tmp/cache.assm"
+
+    expect "cache: cold" "$(printf 'Cache: 0 hits, 2 misses\nexit 0')" "$(cache)"
+    mv "$tmp/cache.proc" "$tmp/cold.proc"
+
+    expect "cache: warm" "$(printf 'Cache: 2 hits, 0 misses\nexit 0')" "$(cache)"
+    expect "cache: run" "$(printf '125\nexit 0')" "$(run /dev/null cache.proc)"
+    expect "cache: warm image" "same" "$(cmp -s "$tmp/cold.proc" "$tmp/cache.proc" && echo same)"
+
+    sed 's/mul r0/add r0/' "$src/cache.assm" > "$tmp/cache.assm"
+    expect "cache: edited func" "$(printf 'Cache: 1 hits, 1 misses\nexit 0')" "$(cache)"
+    expect "cache: edited run" "$(printf '15\nexit 0')" "$(run /dev/null cache.proc)"
+
+    sed 's/push 5/push 4/' "$src/cache.assm" > "$tmp/cache.assm"
+    expect "cache: edited main" "$(printf 'Cache: 1 hits, 1 misses\nexit 0')" "$(cache)"
+    expect "cache: edited main run" "$(printf '64\nexit 0')" "$(run /dev/null cache.proc)"
+}
+
+# code section size of an image
+codesize ()
+{
+    od -A n -t u8 -j 40 -N 8 "$tmp/$1" | tr -d ' '
+}
+
+# operands take 1, 2, 4 or 9 bytes: 6, 14 and 30-bit signed values stay short
+check_relax ()
+{
+    for case in 31:6 32:7 -32:6 -33:7 8191:7 8192:9 -8192:7 -8193:9 \
+                536870911:9 536870912:14 -536870912:9 -536870913:14 \
+                9223372036854775807:14 -9223372036854775808:14
+    do
+        value=${case%:*}
+        printf 'push %s\npop r0\nout\nhlt\n' "$value" > "$tmp/relax.assm"
+        (cd "$tmp" && "$bin/assm" relax.assm > /dev/null) || fail "relax $value: assembly"
+        expect "relax $value" "${case#*:} $value" "$(codesize relax.proc) $(run /dev/null relax.proc | head -n 1)"
+    done
+
+    # the jump target crosses 31 and 8191 as the skipped code grows
+    for case in 29:37 30:39 8188:8197 8189:8200
+    do
+        count=${case%:*}
+        awk -v count="$count" 'BEGIN { print "jmp END"; for (i = 0; i < count; i++) print "fence";
+                                       print "label END\npush 1\npop r0\nout\nhlt" }' > "$tmp/relax.assm"
+        (cd "$tmp" && "$bin/assm" relax.assm > /dev/null) || fail "relax jump $count: assembly"
+        expect "relax jump $count" "${case#*:} 1" "$(codesize relax.proc) $(run /dev/null relax.proc | head -n 1)"
+    done
+
+    # jumps in both directions across chunk boundaries assemble the same for any number of threads
+    awk 'BEGIN { print "jmp MID\nlabel TOP"; for (i = 0; i < 15000; i++) print "fence";
+                 print "jmp END\nlabel MID"; for (i = 0; i < 15000; i++) print "fence";
+                 print "jmp TOP"; for (i = 0; i < 15000; i++) print "fence";
+                 print "label END\npush 1\npop r0\nout\nhlt" }' > "$tmp/relax.assm"
+    (cd "$tmp" && "$bin/assm" -j 1 relax.assm > /dev/null && mv relax.proc relax1.proc &&
+                  "$bin/assm" -j 4 relax.assm > /dev/null) || fail "relax threads: assembly"
+    cmp -s "$tmp/relax1.proc" "$tmp/relax.proc" || fail "relax threads: -j 1 and -j 4 images differ"
+    expect "relax threads" "1" "$(run /dev/null relax.proc | head -n 1)"
+}
+
+# res initializers survive the assembly cache and separate linking
+check_res ()
+{
+    expected=$(cat "$src/res.out")
+
+    for pass in cold warm
+    do
+        assemble res -C cache > /dev/null || fail "res: $pass cache assembly"
+        expect "res: $pass cache" "$expected" "$(run /dev/null res.proc)"
+    done
+
+    assemble res -c || fail "res: object"
+    (cd "$tmp" && "$bin/link" -o reslink.proc linkaux.obj res.obj) || fail "res: link"
+    expect "res: linked after another object" "$expected" "$(run /dev/null reslink.proc)"
+}
+
+# a snapshot taken at hlt resumes with memory, registers and stacks intact
+check_snapshot ()
+{
+    assemble snap || fail "snapshot: assembly"
+
+    expect "snapshot: take" "exit 0" "$(echo 7 | run /dev/stdin -s snap.snap snap.proc)"
+
+    # restored memory is private, the second restore sees the same state
+    for pass in first second
+    do
+        expect "snapshot: $pass restore" "$(printf '18\n100\n7\nexit 0')" "$(run /dev/null -r snap.snap)"
+    done
+
+    head -c 100 "$tmp/snap.snap" > "$tmp/short.snap"
+    expect "snapshot: truncated" "$(printf 'Bad image: Not a snapshot\nexit 1')" "$(run /dev/null -r short.snap)"
+    expect "snapshot: image" "$(printf 'Bad image: Not a snapshot\nexit 1')" "$(run /dev/null -r snap.proc)"
+}
+
+# clones start at the parent's hlt and never see each other's writes
+check_clone ()
+{
+    assemble snap || fail "clone: assembly"
+
+    expect "clone: sequential" "$(printf '18\n100\n7\n18\n100\n7\n18\n100\n7\nexit 0')" \
+           "$(echo 7 | run /dev/stdin -n 3 snap.proc)"
+    expect "clone: scheduled" "$(printf '18\n18\n100\n100\n7\n7\nexit 0')" \
+           "$(echo 7 | run /dev/stdin -n 2 -t 3 snap.proc)"
+
+    echo 7 | run /dev/stdin -s clone.snap snap.proc > /dev/null
+    expect "clone: restored" "$(printf '18\n100\n7\n18\n100\n7\nexit 0')" "$(run /dev/null -n 2 -r clone.snap)"
+}
+
+# proc_reset brings privately mapped file pages back to the file contents
+check_reset ()
+{
+    build reset || fail "reset: build"
+    assemble mapreset || fail "reset: assembly"
+
+    printf '\005\000\000\000\000\000\000\000' > "$tmp/cell.bin"
+
+    expect "reset: private map" "$(printf '5\n0\n5\n0\n5\n0\nexit 0')" "$(run_reset -m cell.bin@DATA mapreset.proc 3)"
+    expect "reset: private file" "0500000000000000" "$(od -A n -t x1 "$tmp/cell.bin" | tr -d ' ')"
+
+    expect "reset: shared map" "$(printf '5\n0\n6\n0\nexit 0')" "$(run_reset -m cell.bin@DATA:rw mapreset.proc 2)"
+    expect "reset: shared file" "0700000000000000" "$(od -A n -t x1 "$tmp/cell.bin" | tr -d ' ')"
+}
+
+# pooled VMs come back with the memory, registers and flags they were loaded with
+check_pool ()
+{
+    assemble isolate || fail "pool: assembly"
+
+    expect "pool: one vm" "$(printf '3\n0\n0\n3\n0\n0\n3\n0\n0\nexit 0')" "$(run_reset -p 1 isolate.proc 3)"
+    expect "pool: two vms" "$(printf '3\n0\n0\n3\n0\n0\n3\n0\n0\n3\n0\n0\nexit 0')" "$(run_reset -p 2 isolate.proc 4)"
+    expect "pool: reset" "$(printf '3\n0\n0\n3\n0\n0\nexit 0')" "$(run_reset isolate.proc 2)"
+}
+
+# batch <proc arguments>: the errors and exit status of a batch, then every job output in order
+batch ()
+{
+    rm -f "$tmp"/job*.out
+
+    (cd "$tmp" && "$bin/proc" "$@" 2>&1 > /dev/null; echo "exit $?"
+     for i in 1 2 3 4 5 6 7
+     do
+         cat "job$i.out" 2> /dev/null
+     done)
+}
+
+# jobs of two programs give the same outputs on one or several threads and under a budget
+check_batch ()
+{
+    assemble factorial || fail "batch: assembly"
+    assemble sum || fail "batch: assembly"
+
+    (cd "$tmp" && printf 'push 1\ndiv 0\nhlt\n' > zero.assm && "$bin/assm" zero.assm > /dev/null) || fail "batch: assembly"
+
+    cp "$src/sum.in" "$tmp/sum.in"
+
+    {
+        echo "# factorials and a sum"
+        for i in 1 2 3 4 5 6
+        do
+            echo "$i" > "$tmp/job$i.in"
+            echo "factorial.proc job$i.in job$i.out"
+        done
+        echo
+        echo "sum.proc sum.in job7.out"
+    } > "$tmp/jobs"
+
+    expected=$(printf 'exit 0\n1\n2\n6\n24\n120\n720\n0\n10\n11\n12\n55')
+
+    expect "batch: one thread" "$expected" "$(batch -b jobs -j 1)"
+    expect "batch: threads" "$expected" "$(batch -b jobs -j 3)"
+    expect "batch: budget" "$expected" "$(batch -b jobs -j 2 -t 5)"
+
+    expect "batch: report" "Jobs: 7 (0 failed), threads: 2," \
+           "$(cd "$tmp" && "$bin/proc" -b jobs -j 2 | head -n 1 | cut -d ' ' -f 1-6)"
+
+    (cat "$tmp/jobs"; echo "zero.proc job1.in zero.out") > "$tmp/failing"
+
+    expect "batch: failed job" "$(printf 'failing:10: Division by zero\n%s' "$(echo "$expected" | sed 's/exit 0/exit 1/')")" \
+           "$(batch -b failing -j 2)"
+
+    # an empty or non-numeric input fails the job the same way in every mode
+    : > "$tmp/empty.in"
+    echo "five" > "$tmp/word.in"
+    printf 'factorial.proc empty.in job1.out\nfactorial.proc word.in job2.out\nfactorial.proc job3.in job3.out\n' \
+           > "$tmp/short"
+
+    for mode in "-j 1" "-l 4" "-t 100" "-w 1"
+    do
+        expect "batch $mode: short input" \
+               "$(printf 'exit 1\nshort:1: I/O error: input failed\nshort:2: I/O error: input failed\n6')" \
+               "$(rm -f "$tmp"/job*.out
+                  cd "$tmp" && "$bin/proc" -b short $mode 2> errors > /dev/null; echo "exit $?"
+                  sort errors; cat job1.out job2.out job3.out 2> /dev/null)"
+    done
+}
+
+# forked workers give the same outputs, and a killed worker costs only its current job;
+# runs the manifests written by check_batch
+check_workers ()
+{
+    expect "workers: one" "$expected" "$(batch -b jobs -w 1)"
+    expect "workers: several" "$expected" "$(batch -b jobs -w 3)"
+    expect "workers: failed job" "$(printf 'failing:10: Division by zero\n%s' "$(echo "$expected" | sed 's/exit 0/exit 1/')")" \
+           "$(batch -b failing -w 2)"
+
+    (cd "$tmp" && printf 'label LOOP\njmp LOOP\n' > loop.assm && "$bin/assm" loop.assm > /dev/null) || fail "workers: assembly"
+    (echo "loop.proc job1.in loop.out"; grep -v '^#' "$tmp/jobs") > "$tmp/looping"
+
+    rm -f "$tmp"/job*.out
+    (cd "$tmp" && exec "$bin/proc" -b looping -w 1 > report 2> errors) &
+    coordinator=$!
+
+    for i in 1 2 3 4 5 6 7 8 9 10
+    do
+        worker=$(pgrep -P "$coordinator")
+        [ -n "$worker" ] && break
+        sleep 0.1
+    done
+
+    sleep 0.2
+    [ -n "$worker" ] && kill -KILL $worker
+
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+    do
+        kill -0 "$coordinator" 2> /dev/null || break
+        sleep 0.1
+    done
+
+    kill -KILL "$coordinator" 2> /dev/null
+    wait "$coordinator"
+    status=$?
+
+    expect "workers: killed" "$(printf 'looping:1: worker killed by signal 9\nexit 1\nRestarts: 1\n%s' "$(echo "$expected" | tail -n +2)")" \
+           "$(cat "$tmp/errors"; echo "exit $status"; grep Restarts "$tmp/report"; for i in 1 2 3 4 5 6 7; do cat "$tmp/job$i.out"; done)"
+}
+
+# a job waiting on an empty FIFO is parked, and the other jobs of its thread run meanwhile
+check_iowait ()
+{
+    assemble factorial || fail "iowait: assembly"
+
+    rm -f "$tmp/fifo.in" "$tmp/fifo.out" "$tmp/file.out"
+    mkfifo "$tmp/fifo.in" || fail "iowait: mkfifo"
+    echo 3 > "$tmp/file.in"
+    printf 'factorial.proc fifo.in fifo.out\nfactorial.proc file.in file.out\n' > "$tmp/waiting"
+
+    # keep a writer open, so the empty FIFO reads EAGAIN rather than EOF
+    exec 3<> "$tmp/fifo.in"
+
+    (cd "$tmp" && exec "$bin/proc" -b waiting -j 1 -t 100 > /dev/null 2> errors 3>&-) &
+    batch=$!
+
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+    do
+        [ -s "$tmp/file.out" ] && break
+        sleep 0.1
+    done
+
+    expect "iowait: other job first" "6" "$(cat "$tmp/file.out" 2> /dev/null)"
+    expect "iowait: parked job" "" "$(cat "$tmp/fifo.out" 2> /dev/null)"
+
+    echo 5 >&3
+    exec 3>&-
+
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+    do
+        kill -0 "$batch" 2> /dev/null || break
+        sleep 0.1
+    done
+
+    kill -KILL "$batch" 2> /dev/null
+    wait "$batch"
+    status=$?
+
+    expect "iowait: resumed job" "$(printf '120\nexit 0')" "$(cat "$tmp/fifo.out" "$tmp/errors"; echo "exit $status")"
+
+    # a FIFO that no writer has opened yet waits for one, and reads EOF once a writer has come and gone
+    late_writer ()
+    {
+        rm -f "$tmp/fifo.out" "$tmp/file.out"
+
+        (cd "$tmp" && exec "$bin/proc" -b waiting -j 1 -t 100 > /dev/null 2> errors) &
+        batch=$!
+
+        for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+        do
+            [ -s "$tmp/file.out" ] && break
+            sleep 0.1
+        done
+
+        expect "iowait: no writer, other job first" "6" "$(cat "$tmp/file.out" 2> /dev/null)"
+        expect "iowait: no writer, parked job" "running" "$(kill -0 "$batch" 2> /dev/null && echo running)"
+
+        # opening the FIFO waits for a reader, so bound the writer in case the job already gave up
+        timeout 5 sh -c 'printf "$1" > "$2"' sh "$1" "$tmp/fifo.in"
+
+        for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+        do
+            kill -0 "$batch" 2> /dev/null || break
+            sleep 0.1
+        done
+
+        kill -KILL "$batch" 2> /dev/null
+        wait "$batch"
+        status=$?
+    }
+
+    late_writer '5\n'
+    expect "iowait: late writer" "$(printf '120\nexit 0')" "$(cat "$tmp/fifo.out" "$tmp/errors"; echo "exit $status")"
+
+    late_writer ''
+    expect "iowait: late writer, no input" "$(printf 'waiting:1: I/O error: input failed\nexit 1')" \
+           "$(cat "$tmp/fifo.out" "$tmp/errors"; echo "exit $status")"
+    # a parked job holds only its own slot: more quick jobs than one thread has slots all finish meanwhile;
+    # jobs start from the end of a thread's share, so the FIFO job goes last
+    rm -f "$tmp"/quick*.out "$tmp/fifo.out"
+    i=0
+    while [ $i -lt 300 ]
+    do
+        i=$((i + 1))
+        echo "factorial.proc file.in quick$i.out"
+    done > "$tmp/parked"
+    echo "factorial.proc fifo.in fifo.out" >> "$tmp/parked"
+
+    (cd "$tmp" && exec "$bin/proc" -b parked -j 1 -t 1000 > /dev/null 2> errors) &
+    batch=$!
+
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30
+    do
+        [ "$(cat "$tmp"/quick*.out 2> /dev/null | grep -c '^6$')" = 300 ] && break
+        sleep 0.1
+    done
+
+    expect "iowait: quick jobs around a parked one" "300 running" \
+           "$(cat "$tmp"/quick*.out 2> /dev/null | grep -c '^6$') $(kill -0 "$batch" 2> /dev/null && echo running)"
+
+    timeout 5 sh -c 'echo 5 > "$1"' sh "$tmp/fifo.in"
+
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+    do
+        kill -0 "$batch" 2> /dev/null || break
+        sleep 0.1
+    done
+
+    kill -KILL "$batch" 2> /dev/null
+    wait "$batch"
+    status=$?
+
+    expect "iowait: parked job after quick ones" "$(printf '120\nexit 0')" \
+           "$(cat "$tmp/fifo.out" "$tmp/errors"; echo "exit $status")"
+}
+
+# pipeline stages pass values through channels, replicated stages share them
+check_chan ()
+{
+    for unit in chgen chsquare chsum chflood chstop
+    do
+        assemble $unit || fail "$unit: assembly"
+    done
+
+    expect "chan: pipeline" "$(printf '1000\n333833500\nexit 0')" "$(run /dev/null -p chgen.proc chsquare.proc chsum.proc)"
+    expect "chan: replicated" "$(printf '1000\n333833500\nexit 0')" "$(run /dev/null -p chgen.proc chsquare.proc:4 chsum.proc)"
+    expect "chan: fan-in" "$(printf '2000\n667667000\nexit 0')" "$(run /dev/null -p chgen.proc:2 chsquare.proc:3 chsum.proc)"
+
+    expect "chan: closed" "$(printf 'chflood.proc: Channel error: channel closed\nexit 1')" "$(run /dev/null -p chflood.proc chstop.proc)"
+    expect "chan: no channel" "$(printf 'Channel error: no such channel\nexit 1')" "$(run /dev/null chflood.proc)"
+}
+
+# lanes run the batch jobs in lockstep with the scalar results, a trapping lane fails alone;
+# runs the manifests written by check_batch
+check_lanes ()
+{
+    for width in 4 8 16
+    do
+        expect "lanes $width" "$expected" "$(batch -b jobs -l $width)"
+    done
+
+    assemble divtrap || fail "lanes: assembly"
+    assemble modtrap || fail "lanes: assembly"
+
+    i=0
+    for case in divtrap:-1 divtrap:2 divtrap:0 modtrap:-1 modtrap:3 divtrap:3
+    do
+        i=$((i + 1))
+        echo "${case#*:}" > "$tmp/trap$i.in"
+        echo "${case%:*}.proc trap$i.in job$i.out"
+    done > "$tmp/traps"
+
+    for width in 4 8
+    do
+        # the order of the failures depends on the lane groups
+        expect "lanes $width: traps" \
+               "$(printf 'exit 1\ntraps:1: Division overflow\ntraps:3: Division by zero\ntraps:4: Division overflow\n%s\n%s\n%s\n%s\n%s' \
+                         -4611686018427387904 0 -2 -3074457345618258602 -2)" \
+               "$(rm -f "$tmp"/job*.out
+                  cd "$tmp" && "$bin/proc" -b traps -l $width 2> errors > /dev/null; echo "exit $?"
+                  sort errors; cat job1.out job2.out job3.out job4.out job5.out job6.out 2> /dev/null)"
+    done
+}
+
+# client <program> [input]: a daemon request, its output, errors and exit status
+client ()
+{
+    (cd "$tmp" && echo "${2:-}" | "$bin/proc" -c "$tmp/daemon.sock" "$1" 2>&1; echo "exit $?")
+}
+
+# the daemon serves requests concurrently, reloads changed programs, survives traps and times out
+check_serve ()
+{
+    assemble factorial || fail "serve: assembly"
+    assemble divtrap || fail "serve: assembly"
+    (cd "$tmp" && printf 'label LOOP\njmp LOOP\n' > loop.assm && "$bin/assm" loop.assm > /dev/null) || fail "serve: assembly"
+
+    "$bin/proc" -S "$tmp/daemon.sock" -t 1000000 &
+    daemon=$!
+
+    for i in 1 2 3 4 5 6 7 8 9 10
+    do
+        [ -S "$tmp/daemon.sock" ] && break
+        sleep 0.1
+    done
+
+    expect "serve: run" "$(printf '120\nexit 0')" "$(client factorial.proc 5)"
+
+    clients=
+    for i in 1 2 3 4 5 6 7 8
+    do
+        client factorial.proc $i > "$tmp/client$i.out" &
+        clients="$clients $!"
+    done
+    wait $clients
+
+    expect "serve: concurrent" "$(printf '1\nexit 0\n2\nexit 0\n6\nexit 0\n24\nexit 0\n120\nexit 0\n720\nexit 0\n5040\nexit 0\n40320\nexit 0')" \
+           "$(for i in 1 2 3 4 5 6 7 8; do cat "$tmp/client$i.out"; done)"
+
+    expect "serve: trap" "$(printf 'Division overflow\nexit 1')" "$(client divtrap.proc -1)"
+    expect "serve: after trap" "$(printf '6\nexit 0')" "$(client factorial.proc 3)"
+
+    expect "serve: timeout" "$(printf 'timeout: instruction budget exhausted\nexit 1')" "$(client loop.proc)"
+
+    # a rebuilt program is reloaded on its next request
+    sleep 0.01
+    (cd "$tmp" && sed 's/mul r128/add r128/' factorial.assm > reload.assm && "$bin/assm" reload.assm > /dev/null &&
+     mv reload.proc factorial.proc) || fail "serve: rebuild"
+    expect "serve: reload" "$(printf '15\nexit 0')" "$(client factorial.proc 5)"
+
+    expect "serve: missing" "$(printf 'exit 1')" "$(client missing.proc 2> /dev/null | tail -n 1)"
+
+    kill -TERM $daemon
+    wait $daemon
+    expect "serve: shutdown" "0 removed" "$? $([ -S "$tmp/daemon.sock" ] || echo removed)"
+
+    # a shutdown ends a running request instead of waiting for its budget
+    "$bin/proc" -S "$tmp/daemon.sock" &
+    daemon=$!
+
+    for i in 1 2 3 4 5 6 7 8 9 10
+    do
+        [ -S "$tmp/daemon.sock" ] && break
+        sleep 0.1
+    done
+
+    client loop.proc > "$tmp/client.out" &
+    looping=$!
+
+    sleep 0.3
+    kill -TERM $daemon
+
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+    do
+        kill -0 $daemon 2> /dev/null || break
+        sleep 0.1
+    done
+
+    kill -KILL $daemon 2> /dev/null
+    wait $daemon
+    status=$?
+    wait $looping
+
+    expect "serve: shutdown while running" "$(printf 'server is shutting down\nexit 1\n0')" "$(cat "$tmp/client.out"; echo $status)"
+
+    # at most SERVE_MAXCONN requests run at once, one thread each; the rest wait in the backlog
+    maxconn=$(($(sed -n 's/^ *SERVE_MAXCONN *= *\(0x[0-9a-f]*\),/\1/p' "$src/../src/proc/serve.h")))
+
+    "$bin/proc" -S "$tmp/daemon.sock" &
+    daemon=$!
+
+    for i in 1 2 3 4 5 6 7 8 9 10
+    do
+        [ -S "$tmp/daemon.sock" ] && break
+        sleep 0.1
+    done
+
+    clients=
+    for i in $(seq $((maxconn + 8)))
+    do
+        client loop.proc > /dev/null &
+        clients="$clients $!"
+    done
+
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+    do
+        [ "$(awk '/^Threads/ { print $2 }' /proc/$daemon/status)" -gt "$maxconn" ] && break
+        sleep 0.1
+    done
+
+    sleep 0.2
+    expect "serve: request cap" "$((maxconn + 1))" "$(awk '/^Threads/ { print $2 }' /proc/$daemon/status)"
+
+    kill -TERM $daemon
+
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+    do
+        kill -0 $daemon 2> /dev/null || break
+        sleep 0.1
+    done
+
+    kill -KILL $daemon 2> /dev/null
+    wait $daemon
+    status=$?
+    wait $clients
+
+    expect "serve: shutdown at the cap" "0" "$status"
+}
+
+# patch <file> <offset> <octal bytes>: overwrite bytes in place
+patch ()
+{
+    printf "$3" | dd of="$1" bs=1 seek="$2" conv=notrunc 2> /dev/null
+}
+
+# proc -C: a warm load maps the cached decoded commands, an entry for another build of the image is replaced
+check_progcache ()
+{
+    assemble factorial || fail "progcache: assembly"
+
+    pcache ()
+    {
+        (cd "$tmp" && echo 5 | "$bin/proc" -q -C pcache "${1:-factorial.proc}" 2>&1; echo "exit $?")
+    }
+
+    entries ()
+    {
+        set -- "$tmp"/pcache/*
+        [ -e "$1" ] && echo $# || echo 0
+    }
+
+    expect "progcache: cold" "$(printf '120\nexit 0')" "$(pcache)"
+    expect "progcache: entries" "1" "$(entries)"
+
+    set -- "$tmp"/pcache/*
+    entry=$1
+    cp "$entry" "$tmp/entry"
+
+    inode=$(ls -i "$entry" | cut -d ' ' -f 1)
+    expect "progcache: warm" "$(printf '120\nexit 0')" "$(pcache)"
+    expect "progcache: hit keeps the entry" "$inode" "$(ls -i "$entry" | cut -d ' ' -f 1)"
+
+    # the entry header is 96 bytes: magic, version, the image key from 8, then the code size at 72
+    for case in "magic:0:\\000" "key:8:\\000" "codesize:72:\\377"
+    do
+        name=${case%%:*}
+        case=${case#*:}
+        cp "$tmp/entry" "$entry"
+        patch "$entry" "${case%%:*}" "${case#*:}"
+
+        expect "progcache: bad $name" "$(printf '120\nexit 0')" "$(pcache)"
+        expect "progcache: bad $name rewritten" "same" "$(cmp -s "$entry" "$tmp/entry" && echo same)"
+    done
+
+    head -c 100 "$tmp/entry" > "$entry"
+    expect "progcache: truncated" "$(printf '120\nexit 0')" "$(pcache)"
+    expect "progcache: truncated rewritten" "same" "$(cmp -s "$entry" "$tmp/entry" && echo same)"
+
+    # a rebuilt image replaces the entry of the old one, a copy elsewhere gets its own
+    sleep 0.01
+    assemble factorial || fail "progcache: assembly"
+    expect "progcache: rebuilt" "$(printf '120\nexit 0')" "$(pcache)"
+    expect "progcache: rebuilt entries" "1" "$(entries)"
+    expect "progcache: rebuilt entry" "differs" "$(cmp -s "$entry" "$tmp/entry" || echo differs)"
+
+    cp "$tmp/factorial.proc" "$tmp/copy.proc"
+    expect "progcache: copy" "$(printf '120\nexit 0')" "$(pcache copy.proc)"
+    expect "progcache: copy entries" "2" "$(entries)"
+
+    # an image that no longer verifies drops its entry and stores none
+    patch "$tmp/copy.proc" "$(od -A n -t u8 -j 32 -N 8 "$tmp/copy.proc" | tr -d ' ')" "\\377"
+    expect "progcache: broken" "$(printf 'Bad image: Bad command\nexit 1')" "$(pcache copy.proc)"
+    expect "progcache: broken entries" "1" "$(entries)"
+}
+
+check_programs
+check_link
+check_cache
+check_hints
+check_relax
+check_res
+check_snapshot
+check_clone
+check_reset
+check_pool
+check_batch
+check_lanes
+check_iowait
+check_chan
+check_workers
+check_serve
+check_progcache
+
+echo "Passed: $passed, failed: $failed"
+
+[ "$failed" -eq 0 ]
@@ -0,0 +1,156 @@
+/* Runs one program several times on the same VM, with proc_reset between the runs,
+   or with -p through a pool of reusable VMs */
+
+#include "processor.h"
+#include "pool.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int run_pool (const char *filename, size_t count, size_t runs);
+
+int main (int argc, char **argv)
+{
+    const char *map   = NULL;
+    size_t      pool  = 0;
+    size_t      runs  = 0;
+    int         opt   = 0;
+
+    while ( (opt = getopt (argc, argv, "m:p:") ) != -1)
+        switch (opt)
+        {
+            case 'm':
+                map = optarg;
+                break;
+            case 'p':
+                pool = strtoul (optarg, NULL, 0);
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+
+    if (optind != argc - 2 || (pool && map) )
+    {
+        fprintf (stderr, "Usage: %s [-m file@target[:rw] | -p vms] <name of file> <runs>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    runs = strtoul (argv[optind + 1], NULL, 0);
+
+    if (pool)
+        return run_pool (argv[optind], pool, runs);
+
+    proc_t proc = {};
+
+    do
+    {
+        if (proc_create (&proc, argv[optind], 0) )
+            break;
+
+        if (map)
+        {
+            char  spec[0x100] = "";
+            char *target      = NULL;
+            char *mode        = NULL;
+
+            strncpy (spec, map, sizeof (spec) - 1);
+
+            if (!(target = strchr (spec, '@') ) )
+            {
+                fprintf (stderr, "Bad map: %s\n", map);
+                proc_delete (&proc);
+                return EXIT_FAILURE;
+            }
+
+            *target++ = '\0';
+
+            if ( (mode = strchr (target, ':') ) )
+                *mode++ = '\0';
+
+            if (proc_mapfile (&proc, spec, target, (mode && !strcmp (mode, "rw") ) ? PROC_MAPRW : 0) )
+                break;
+        }
+
+        size_t run = 0;
+
+        for (run = 0; run < runs; run++)
+            if (proc_run (&proc) || proc_reset (&proc) )
+                break;
+
+        if (run < runs)
+            break;
+
+        proc_delete (&proc);
+
+        return EXIT_SUCCESS;
+    }
+    while (0);
+
+    proc_error (&proc);
+
+    proc_delete (&proc);
+
+    return EXIT_FAILURE;
+}
+
+static int run_pool (const char *filename, size_t count, size_t runs)
+{
+    assert (filename);
+
+    pool_t  pool = {};
+    FILE   *file = fopen (filename, "rb");
+    char   *data = NULL;
+    long    size = 0;
+
+    if (!file || fseek (file, 0, SEEK_END) || (size = ftell (file) ) < 0 || fseek (file, 0, SEEK_SET) ||
+        !(data = malloc ( (size_t) size + 1) ) || fread (data, 1, (size_t) size, file) != (size_t) size)
+    {
+        perror (filename);
+
+        if (file)
+            fclose (file);
+
+        free (data);
+
+        return EXIT_FAILURE;
+    }
+
+    fclose (file);
+
+    if (pool_create (&pool, data, (uint64_t) size, count, 0) )
+    {
+        pool_error (&pool);
+        free (data);
+        return EXIT_FAILURE;
+    }
+
+    free (data);
+
+    /* acquire every VM once per round, so each one is reused */
+    for (size_t run = 0; run < runs; run += count)
+    {
+        proc_t *vm[count];
+        size_t  round = (runs - run < count) ? runs - run : count;
+
+        for (size_t i = 0; i < round; i++)
+            vm[i] = pool_acquire (&pool);
+
+        for (size_t i = 0; i < round; i++)
+            if (proc_run (vm[i]) )
+            {
+                proc_error (vm[i]);
+                pool_delete (&pool);
+                return EXIT_FAILURE;
+            }
+
+        for (size_t i = 0; i < round; i++)
+            pool_release (&pool, vm[i]);
+    }
+
+    pool_delete (&pool);
+
+    return EXIT_SUCCESS;
+}